@@ -0,0 +1,130 @@
+#include "BlockCache.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static const int BLOCK = 8;
+
+
+DirtyBlocks::DirtyBlocks() {
+
+    _window = Rect(0, 0, 0, 0);
+    _x0 = _y0 = _cols = _rows = 0;
+}
+
+
+// Blocks of window that are not fully inside known start dirty, the others clean
+void DirtyBlocks::reset(Rect window, Rect known) {
+
+    _window = window;
+    _x0 = window.x/BLOCK;
+    _y0 = window.y/BLOCK;
+    _cols = window.width > 0 ? (window.x + window.width - 1)/BLOCK - _x0 + 1 : 0;
+    _rows = window.height > 0 ? (window.y + window.height - 1)/BLOCK - _y0 + 1 : 0;
+    _dirty.assign(_cols*_rows, 1);
+
+    for(int by = 0; by < _rows; by++){
+        for(int bx = 0; bx < _cols; bx++){
+            Rect block = Rect((_x0 + bx)*BLOCK, (_y0 + by)*BLOCK, BLOCK, BLOCK) & window;
+            _dirty[by*_cols + bx] = (block & known) != block;
+        }
+    }
+}
+
+
+// Room for the blocks of any window of a frame of frame_size
+void DirtyBlocks::reserve(Size frame_size) {
+
+    _dirty.reserve(((frame_size.width + BLOCK - 1)/BLOCK)*((frame_size.height + BLOCK - 1)/BLOCK));
+}
+
+
+/* Comparison with the previous frame
+* previous holds the plane of the previous frame from previous_origin on (the origin is
+* (0,0) for a full frame plane). Both planes have the same type; every known block whose
+* bytes differ is marked dirty
+*/
+void DirtyBlocks::compare(const Mat& current, const Mat& previous, Point previous_origin) {
+
+    size_t pixel_size = current.elemSize();
+    for(int by = 0; by < _rows; by++){
+        for(int bx = 0; bx < _cols; bx++){
+            uchar& dirty = _dirty[by*_cols + bx];
+            if(dirty){
+                continue;
+            }
+            Rect block = Rect((_x0 + bx)*BLOCK, (_y0 + by)*BLOCK, BLOCK, BLOCK) & _window;
+            for(int y = block.y; y < block.y + block.height && !dirty; y++){
+                const uchar* now = current.ptr<uchar>(y) + block.x*pixel_size;
+                const uchar* before = previous.ptr<uchar>(y - previous_origin.y) + (block.x - previous_origin.x)*pixel_size;
+                dirty = memcmp(now, before, block.width*pixel_size) != 0;
+            }
+        }
+    }
+}
+
+
+// True if box lies inside the window and covers no dirty block
+bool DirtyBlocks::clean(Rect box) const {
+
+    if((box & _window) != box || box.area() == 0){
+        return false;
+    }
+    for(int by = box.y/BLOCK - _y0; by <= (box.y + box.height - 1)/BLOCK - _y0; by++){
+        for(int bx = box.x/BLOCK - _x0; bx <= (box.x + box.width - 1)/BLOCK - _x0; bx++){
+            if(_dirty[by*_cols + bx]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Parts of box covered by dirty blocks; false if box is not inside the window
+bool DirtyBlocks::regions(Rect box, vector<Rect>& dirty) const {
+
+    dirty.clear();
+    if((box & _window) != box || box.area() == 0){
+        return false;
+    }
+    for(int by = box.y/BLOCK - _y0; by <= (box.y + box.height - 1)/BLOCK - _y0; by++){
+        for(int bx = box.x/BLOCK - _x0; bx <= (box.x + box.width - 1)/BLOCK - _x0; bx++){
+            if(_dirty[by*_cols + bx]){
+                dirty.push_back(Rect((_x0 + bx)*BLOCK, (_y0 + by)*BLOCK, BLOCK, BLOCK) & box);
+            }
+        }
+    }
+    return true;
+}
+
+
+int DirtyBlocks::blocks() const {
+    return (int)_dirty.size();
+}
+
+
+int DirtyBlocks::dirty() const {
+    return (int)count(_dirty.begin(), _dirty.end(), 1);
+}
+
+
+// Bins of HIST_OUT_OF_RANGE pixels (>= bins) are not counted, as in bin_histogram
+void update_histogram(float* hist, int bins, const Mat& previous_bins, const Mat& current_bins, Rect region) {
+
+    for(int y = region.y; y < region.y + region.height; y++){
+        const uchar* before = previous_bins.ptr<uchar>(y) + region.x;
+        const uchar* now = current_bins.ptr<uchar>(y) + region.x;
+        for(int x = 0; x < region.width; x++){
+            if(before[x] != now[x]){
+                if(before[x] < bins){
+                    hist[before[x]]--;
+                }
+                if(now[x] < bins){
+                    hist[now[x]]++;
+                }
+            }
+        }
+    }
+}
@@ -13,18 +13,156 @@ ColorTracker::ColorTracker(Rect gt, int desired_bins, int in_levels, int in_step
 
     candidate_levels = in_levels;
     candidate_step = in_step;
+    scale_step = 1;
+    num_particles = 0;
+    particle_noise = 4;
+    static_threshold = 0;
+    prune_candidates = false;
+    max_samples = 0;
+    cache_blocks = false;
+    sliding_histograms = false;
+    kernel_weights = false;
+    joint_histogram = false;
+    loss_distance = 0;
+    loss_margin = 0;
+    loss_frames = 3;
+    _use_integral_histograms = false;
     _model_initialized = false;
     _track_type = type;
+    score_mode = SCORE_HISTOGRAM;
+
+    // Buffers are sized once here and reused on every frame
+    _color_spaces.resize(6);
+    _bin_planes.resize(6);
+    _previous_bin_planes.resize(6);
+    _sliding_histograms.resize(6);
+    _sliding_boxes.resize(6);
+    _integral_histograms.resize(6);
+    _model.histograms.resize(6);
+    _hist_candidate.create(bins, 1, CV_32F);
+    _scores.reserve(6);
+    _bgr_planes.resize(3);
+    _hsv_planes.resize(3);
+    _dense_features.resize(1);
+    _num_channels = (int)count(type.begin(), type.end(), true);
+    _best_score = DBL_MAX;
+    _prune_stats.candidates = 0;
+    _prune_stats.pruned = 0;
+    _velocity = Point2f(0, 0);
+    _last_step = Point(0, 0);
+    _lost_frames = 0;
+    _cache_window = Rect(0, 0, 0, 0);
+    _cache_stats.lookups = 0;
+    _cache_stats.hits = 0;
+    _cache_stats.blocks = 0;
+    _cache_stats.dirty_blocks = 0;
+    _redetect_stats.lost_frames = 0;
+    _redetect_stats.searches = 0;
+    _redetect_stats.recoveries = 0;
+    frame_candidates.boxes.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    frame_candidates.scores.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    _offsets.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    _scales.reserve(3);
+
+    for(int i = 0;i < 6; i++){
+        if(i==3){
+            build_bin_lut(bins, 0, 180, _bin_luts[i]);
+        }
+        else{
+            build_bin_lut(bins, 0, 256, _bin_luts[i]);
+        }
+    }
 }
 
 /* Track
 * Searches for the candidate closest to the target and return its bounding box
+* In particle mode the box is centered on the weighted mean of the particles instead
 */
 Rect ColorTracker::track(Mat frame) {    
+    return track(frame, 0);
+}
+
+
+/* Track within a time budget
+* With budget_ms > 0 the candidates are evaluated from the predicted position outwards
+* in rings and the search stops at the deadline, returning the best candidate so far.
+* Particle mode always evaluates every particle. The re-detection pass, when it runs,
+* is not cut by the deadline.
+* Frames whose search window is unchanged since the last tracked frame (static_threshold > 0)
+* keep the previous box and are not counted by the budget; the motion state still advances
+* by a frame without displacement. With color ratios the window is the one around the
+* predicted box that would be searched, and in particle mode the region of the particle boxes
+*/
+Rect ColorTracker::track(Mat frame, double budget_ms) {    
+    bool first_frame = !_model_initialized;
+
+    // An unchanged window gives the same candidates and scores as the last tracked frame
+    _gate.threshold = static_threshold;
+    if(_gate.unchanged(frame, _search_window(frame.size()))){
+        _hold_motion(frame.size());
+        return _model.box;
+    }
+
+    _budget.start(budget_ms);
     _generate_candidate(frame);
-    int idx = min_element(frame_candidates.scores.begin(),frame_candidates.scores.end()) - frame_candidates.scores.begin();
-    _model.box = frame_candidates.boxes[idx];
-    return frame_candidates.boxes[idx];
+
+    if(_particle_mode() && !first_frame){
+        _particle_filter.update(frame_candidates.scores);
+        _model.box = _particle_filter.estimate_box(_model.box.size(), frame.size());
+    }
+    else{
+        int idx = min_element(frame_candidates.scores.begin(),frame_candidates.scores.end()) - frame_candidates.scores.begin();
+        if(score_mode == SCORE_COLOR_RATIO && !first_frame){
+            _update_velocity(frame_candidates.boxes[idx]);
+        }
+        _model.box = frame_candidates.boxes[idx];
+    }
+
+    if(!first_frame && _redetection()){
+        _check_target(frame);
+    }
+
+    int planned = (int)frame_candidates.boxes.size();
+    if(!first_frame && !_particle_mode()){
+        planned = (int)(_offsets.size()*_candidate_scales().size());
+    }
+    _budget.finish((int)frame_candidates.boxes.size(), planned);
+    return _model.box;
+}
+
+
+// Candidates evaluated and deadline overruns of the frames tracked with a budget
+const budget_stats& ColorTracker::get_budget_stats() const {
+    return _budget.stats();
+}
+
+
+// Frames checked by the static region gate and frames that reused the previous box
+const gate_stats& ColorTracker::get_gate_stats() const {
+    return _gate.stats();
+}
+
+
+// Candidate histograms served from the previous frame and changed blocks of the search windows
+const cache_stats& ColorTracker::get_cache_stats() const {
+    return _cache_stats;
+}
+
+
+// Candidates abandoned by branch and bound, per channel at which they were abandoned
+const prune_stats& ColorTracker::get_prune_stats() const {
+    return _prune_stats;
+}
+
+
+// Frames flagged as lost and re-detection passes over the whole sequence
+const redetect_stats& ColorTracker::get_redetect_stats() const {
+    return _redetect_stats;
+}
+
+
+const JointModel& ColorTracker::get_joint_model() const {
+    return _joint_model;
 }
 
 
@@ -38,31 +176,87 @@ void ColorTracker::_generate_candidate(Mat frame) {
 
     frame_candidates.boxes.clear();
     frame_candidates.scores.clear();
+    _best_score = DBL_MAX;
+
+    // Color ratios are read straight from the BGR frame, no color planes are needed
+    if(score_mode == SCORE_COLOR_RATIO){
+        _hypothesis_search(frame);
+        return;
+    }
 
-    int numCandidates = 0;
-    Mat mask = Mat::zeros(frame.rows, frame.cols, CV_8U);
-    _color_spaces.clear();
     _get_color_space(frame);
     
     if(!_model_initialized){       
         _model_initialized = true;
-        _init_model(mask);
+        _quantize_color_spaces(_model.box);
+        _init_model();
+        if(_block_cache()){
+            _reserve_cache(frame.size());
+        }
+        if(_particle_mode()){
+            _particle_filter.init(num_particles, Point2f(_model.box.x + _model.box.width/2.f, _model.box.y + _model.box.height/2.f), particle_noise);
+        }
+    }
+
+    else if(_particle_mode()){
+        _particle_search(frame);
     }
 
     else{
         
-        int initialValue = -candidate_levels*candidate_step;
-        int finalValue = candidate_levels*candidate_step;
+        Rect window = _search_window(frame.size());
+        if(_block_cache()){
+            _cache_frame(window);
+        }
+        else{
+            _quantize_color_spaces(window);
+        }
+        if(score_mode == SCORE_BACKPROJECTION || score_mode == SCORE_DENSE){
+            _backproject(window);
+        }
+        if(_dense_search()){
+            _dense_match();
+        }
 
-        for (int ix = initialValue; ix <= finalValue; ix = ix + candidate_step){
-            for (int iy = initialValue; iy <= finalValue; iy = iy + candidate_step){
-                int x = _model.box.x + ix;
-                int y = _model.box.y + iy;
+        // Candidates of every scale share the integral histograms of the window, unless they
+        // would take more than INTEGRAL_HISTOGRAM_BUDGET; the candidates are then counted one by one
+        const vector<double>& scales = _candidate_scales();
+        _window_origin = window.tl();
+        _use_integral_histograms = scales.size() > 1 && score_mode == SCORE_HISTOGRAM && !kernel_weights && !joint_histogram
+                                  && _integral_histograms_bytes(window.size()) <= INTEGRAL_HISTOGRAM_BUDGET;
+        if(_use_integral_histograms){
+            for(int i = 0;i < 6; i++){
+                if(_track_type[i]){
+                    integral_histogram(_bin_planes[i], window, bins, _integral_histograms[i]);
+                }
+            }
+        }
+        else{
+            for(int i = 0;i < 6; i++){
+                _integral_histograms[i].release();
+            }
+        }
 
-                if( (x>=0) && (y>=0) && ( (x+_model.box.width) <= frame.cols ) && ( (y+_model.box.height)<=frame.rows ) ){
-                    Rect candidate_box = Rect(x,y,_model.box.width,_model.box.height);                   
+        // Sliding histograms walk the grid in a snake, along the axis with the shorter strips
+        int order = _budget.active() ? GRID_RINGS : GRID_RASTER;
+        if(_sliding()){
+            order = _model.box.height <= _model.box.width ? GRID_SNAKE_ROWS : GRID_SNAKE_COLUMNS;
+            for(int i = 0;i < 6; i++){
+                _sliding_boxes[i] = Rect(0, 0, 0, 0);
+            }
+        }
+        grid_offsets(candidate_levels, candidate_step, order, _offsets);
+
+        for (size_t s = 0; s < scales.size(); s++){
+            Rect base_box = _scaled_box(scales[s]);
+            for (size_t k = 0; k < _offsets.size() && !_budget.expired(frame_candidates.boxes.size()); k++){
+                int x = base_box.x + _offsets[k].x;
+                int y = base_box.y + _offsets[k].y;
+
+                if( (x>=0) && (y>=0) && ( (x+base_box.width) <= frame.cols ) && ( (y+base_box.height)<=frame.rows ) ){
+                    Rect candidate_box = Rect(x,y,base_box.width,base_box.height);                   
                     frame_candidates.boxes.push_back(candidate_box);
-                    frame_candidates.scores.push_back(_get_distance(candidate_box,mask));  
+                    frame_candidates.scores.push_back(_score(candidate_box));  
                 }
             }
         }
@@ -71,40 +265,529 @@ void ColorTracker::_generate_candidate(Mat frame) {
 
 
 
+// Distance between one candidate and the model according to score_mode
+float ColorTracker::_score(Rect candidate_box) {
+
+    if(_dense_search()){
+        return _dense_scores.at<float>(candidate_box.y - _likelihood_origin.y, candidate_box.x - _likelihood_origin.x);
+    }
+    if(score_mode == SCORE_BACKPROJECTION || score_mode == SCORE_DENSE){
+        return _get_backprojection_distance(candidate_box);
+    }
+    float distance = _get_distance(candidate_box, false);
+    if(_pruning()){
+        _best_score = min(_best_score, (double)distance);
+    }
+    return distance;
+}
+
+
+/* Branch and bound
+* Only for histogram scoring on the candidate grid, where only the argmin matters:
+* particle weights need every exact distance
+*/
+bool ColorTracker::_pruning() {
+    return prune_candidates && score_mode == SCORE_HISTOGRAM && !_particle_mode();
+}
+
+
+// Counts one candidate scored with pruning that stopped after stages of total_stages channels
+void ColorTracker::_record_pruning(int stages, int total_stages) {
+
+    _prune_stats.candidates++;
+    if(stages < total_stages){
+        _prune_stats.pruned++;
+        if((int)_prune_stats.pruned_at.size() < total_stages){
+            _prune_stats.pruned_at.resize(total_stages, 0);
+        }
+        _prune_stats.pruned_at[stages-1]++;
+    }
+}
+
+
+// Dense scoring needs every offset of the window to be a candidate, otherwise box sums are cheaper
+bool ColorTracker::_dense_search() {
+    return score_mode == SCORE_DENSE && candidate_step == 1 && !_particle_mode();
+}
+
+
+// Particle search replaces the candidate grid when num_particles > 0; color ratios keep their own search
+bool ColorTracker::_particle_mode() {
+    return num_particles > 0 && score_mode != SCORE_COLOR_RATIO;
+}
+
+
+/* Particle search
+* One candidate per particle, at the current box size. The per frame structures
+* (bin planes, likelihood map) cover only the region spanned by the particles
+*/
+void ColorTracker::_particle_search(Mat frame) {
+
+    _particle_filter.predict(_model.box.size(), frame.size());
+
+    for(int i = 0; i < _particle_filter.size(); i++){
+        frame_candidates.boxes.push_back(_particle_filter.box(i, _model.box.size()));
+    }
+
+    Rect window = _particle_window(frame.size());
+    _quantize_color_spaces(window);
+    if(score_mode == SCORE_BACKPROJECTION || score_mode == SCORE_DENSE){
+        _backproject(window);
+    }
+    _use_integral_histograms = false;
+
+    for(size_t i = 0; i < frame_candidates.boxes.size(); i++){
+        frame_candidates.scores.push_back(_score(frame_candidates.boxes[i]));
+    }
+}
+
+
+// Region spanned by the boxes of the particles, at the current box size
+Rect ColorTracker::_particle_window(Size frame_size) {
+
+    Rect window = _particle_filter.box(0, _model.box.size());
+    for(int i = 1; i < _particle_filter.size(); i++){
+        window |= _particle_filter.box(i, _model.box.size());
+    }
+    return window & Rect(0, 0, frame_size.width, frame_size.height);
+}
+
+
+/* Search window
+* Region covered by all candidates of the current frame: the particle boxes in particle mode
+* (once the particles exist), otherwise the grid at the largest scale, or around the predicted
+* box with color ratios. Particles are resampled on every tracked frame, so their region only
+* stays the same while the static gate holds them
+*/
+Rect ColorTracker::_search_window(Size frame_size) {
+
+    if(_particle_mode() && _model_initialized){
+        return _particle_window(frame_size);
+    }
+
+    Rect box;
+    if(score_mode == SCORE_COLOR_RATIO){
+        box = _predict_box(frame_size);
+    }
+    else{
+        const vector<double>& scales = _candidate_scales();
+        box = _scaled_box(*max_element(scales.begin(), scales.end()));
+    }
+    int margin = candidate_levels*candidate_step;
+    Rect window(box.x - margin, box.y - margin, box.width + 2*margin, box.height + 2*margin);
+    return window & Rect(0, 0, frame_size.width, frame_size.height);
+}
+
+
+// Loss detection for every score mode except color ratios, which keep their own motion model
+bool ColorTracker::_redetection() {
+    return loss_distance > 0 && score_mode != SCORE_COLOR_RATIO;
+}
+
+
+/* Loss detector
+* The target is considered lost when the best distance of the frame is above loss_distance,
+* or when a distinct candidate (IoU < 0.5 with the best) comes within loss_margin of it,
+* i.e. the response has no clear peak. Pruned candidates hold lower bounds, so with pruning
+* the margin test can only err towards a (verified) re-detection
+*/
+bool ColorTracker::_target_lost() {
+
+    const vector<double>& scores = frame_candidates.scores;
+    if(scores.empty()){
+        return false;
+    }
+    int best = min_element(scores.begin(), scores.end()) - scores.begin();
+    if(scores[best] > loss_distance){
+        return true;
+    }
+
+    Rect best_box = frame_candidates.boxes[best];
+    double second = DBL_MAX;
+    for(size_t k = 0; k < scores.size(); k++){
+        Rect box = frame_candidates.boxes[k];
+        double overlap = (box & best_box).area()/(double)(box | best_box).area();
+        if(overlap < 0.5){
+            second = min(second, scores[k]);
+        }
+    }
+    return second - scores[best] < loss_margin;
+}
+
+
+/* Re-detection
+* After loss_frames consecutive lost frames the whole frame is searched at a coarse level.
+* The box found there replaces the tracked one only if its histogram distance to the model
+* is lower, then the local search resumes around it
+*/
+void ColorTracker::_check_target(Mat frame) {
+
+    if(!_target_lost()){
+        _lost_frames = 0;
+        return;
+    }
+    _redetect_stats.lost_frames++;
+    if(++_lost_frames < loss_frames){
+        return;
+    }
+    _lost_frames = 0;
+    _redetect_stats.searches++;
+
+    Rect found = _global_search(frame.size());
+    if(found == _model.box){
+        return;
+    }
+
+    // Both boxes are compared with exact histograms, outside the search statistics and the cache
+    _quantize_color_spaces(found);
+    _quantize_color_spaces(_model.box);
+    _use_integral_histograms = false;
+    if(_get_distance(found, true) < _get_distance(_model.box, true)){
+        _model.box = found;
+        _redetect_stats.recoveries++;
+        if(_particle_mode()){
+            _particle_filter.init(num_particles, Point2f(found.x + found.width/2.f, found.y + found.height/2.f), particle_noise);
+        }
+    }
+}
+
+
+/* Full frame search
+* The back-projection of the model is evaluated on a lattice of the full frame: the stride
+* doubles while the frame has more than 320x240 samples and the box keeps at least 8 pixels
+* per side. Color values are sampled rather than averaged, which keeps hue valid. Every box
+* position of the coarse map is scored with four integral image reads
+*/
+Rect ColorTracker::_global_search(Size frame_size) {
+
+    Size box = _model.box.size();
+    int stride = 1;
+    while(min(box.width, box.height)/(2*stride) >= 8 && frame_size.area()/(stride*stride) > 320*240){
+        stride *= 2;
+    }
+
+    int rows = frame_size.height/stride;
+    int cols = frame_size.width/stride;
+    int box_rows = max(box.height/stride, 1);
+    int box_cols = max(box.width/stride, 1);
+    if(box_rows > rows || box_cols > cols){
+        return _model.box;
+    }
+
+    _redetect_likelihood.create(rows, cols, CV_32F);
+    _redetect_likelihood = Scalar(0);
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i]){
+            const float* weights = _backprojection_weights[i];
+            const uchar* lut = _bin_luts[i];
+            for(int y = 0; y < rows; y++){
+                const uchar* src = _color_spaces[i].ptr<uchar>(y*stride);
+                float* row = _redetect_likelihood.ptr<float>(y);
+                for(int x = 0; x < cols; x++){
+                    row[x] += weights[lut[src[x*stride]]];
+                }
+            }
+        }
+    }
+    integral(_redetect_likelihood, _redetect_integral, CV_64F);
+
+    double best = -DBL_MAX;
+    Point best_position(0, 0);
+    for(int y = 0; y + box_rows <= rows; y++){
+        const double* top = _redetect_integral.ptr<double>(y);
+        const double* bottom = _redetect_integral.ptr<double>(y + box_rows);
+        for(int x = 0; x + box_cols <= cols; x++){
+            double sum = bottom[x + box_cols] - bottom[x] - top[x + box_cols] + top[x];
+            if(sum > best){
+                best = sum;
+                best_position = Point(x, y);
+            }
+        }
+    }
+
+    int x = min(best_position.x*stride, frame_size.width - box.width);
+    int y = min(best_position.y*stride, frame_size.height - box.height);
+    return Rect(x, y, box.width, box.height);
+}
+
+
+/* Candidate scales
+* With scale_step > 1 the box is also tested shrunk and grown by scale_step; the current
+* size comes first so it wins ties. Histogram and back-projection scores do not depend on
+* the box area and are the only ones compared across scales
+*/
+const vector<double>& ColorTracker::_candidate_scales() {
+
+    _scales.assign(1, 1.);
+    if(scale_step > 1 && (score_mode == SCORE_HISTOGRAM || score_mode == SCORE_BACKPROJECTION)){
+        _scales.push_back(1./scale_step);
+        _scales.push_back(scale_step);
+    }
+    return _scales;
+}
+
+
+// Model box resized by scale around its center, never below 8x8 pixels
+Rect ColorTracker::_scaled_box(double scale) {
+
+    int width = max(cvRound(_model.box.width*scale), min(_model.box.width, 8));
+    int height = max(cvRound(_model.box.height*scale), min(_model.box.height, 8));
+    return Rect(_model.box.x + (_model.box.width - width)/2, _model.box.y + (_model.box.height - height)/2, width, height);
+}
+
+
+// Memory of the integral histograms of window, one per tracked channel
+size_t ColorTracker::_integral_histograms_bytes(Size window) {
+
+    return integral_histogram_bytes(window, bins)*count(_track_type.begin(), _track_type.end(), true);
+}
+
+
+/* Candidate histogram
+* Histogram of one channel over a candidate, from the integral histogram in multi-scale search.
+* Otherwise at most max_samples pixels of the box are counted, on a fixed lattice.
+* With kernel_weights every pixel counts with the Epanechnikov weight of its place in the box.
+* An exact histogram is counted from the bin plane, never from the block cache or a sliding one
+*/
+void ColorTracker::_candidate_histogram(int channel, Rect candidate_box, bool exact, float* hist) {
+
+    if(kernel_weights){
+        weighted_bin_histogram(_bin_planes[channel], candidate_box, bins, _kernel_table(candidate_box.size()), hist);
+    }
+    else if(_use_integral_histograms){
+        integral_histogram_box(_integral_histograms[channel], candidate_box - _window_origin, bins, hist);
+    }
+    else if(_block_cache() && !exact){
+        _cached_histogram(channel, candidate_box, hist);
+    }
+    else if(_sliding() && !exact){
+        _sliding_histogram(channel, candidate_box, hist);
+    }
+    else{
+        sampled_bin_histogram(_bin_planes[channel], candidate_box, bins, sample_stride(candidate_box.size(), max_samples), hist);
+    }
+}
+
+
+/* Sliding histograms
+* Only for single scale histogram scoring of the full candidate grid with every pixel counted.
+* Not with a deadline, whose ring order does not keep consecutive candidates adjacent, nor
+* with the block cache, which already reuses the histograms
+*/
+bool ColorTracker::_sliding() {
+    return sliding_histograms && !cache_blocks && score_mode == SCORE_HISTOGRAM && !_particle_mode()
+        && max_samples <= 0 && scale_step <= 1 && !_budget.active() && !kernel_weights && !joint_histogram;
+}
+
+
+/* Kernel table
+* Epanechnikov weights of a box size, built the first time a box of that size is scored and
+* shared by every later candidate of the same size. Multi-scale search uses a handful of
+* sizes; the tables are dropped if many more appear
+*/
+const float* ColorTracker::_kernel_table(Size box) {
+
+    for(size_t k = 0; k < _kernel_tables.size(); k++){
+        if(_kernel_tables[k].cols == box.width && _kernel_tables[k].rows == box.height){
+            return _kernel_tables[k].ptr<float>();
+        }
+    }
+    if(_kernel_tables.size() >= 16){
+        _kernel_tables.clear();
+    }
+    _kernel_tables.push_back(Mat(box, CV_32F));
+    epanechnikov_weights(box, _kernel_tables.back().ptr<float>());
+    return _kernel_tables.back().ptr<float>();
+}
+
+
+// Joint histograms replace the per channel histograms in histogram scoring only
+bool ColorTracker::_joint() {
+    return joint_histogram && score_mode == SCORE_HISTOGRAM;
+}
+
+
+/* Joint histogram tracking
+* Bhattacharyya distance between the sparse joint histogram of the tracked channels in the
+* model and the counts of the model bins in the candidate, read from the index plane of the
+* window (with the Epanechnikov weights of the box with kernel_weights). A single distance
+* replaces the L2 mix of the channel distances
+*/
+float ColorTracker::_get_joint_distance(Rect candidate_box) {
+
+    _joint_model.histogram(_joint_indices, candidate_box, kernel_weights ? _kernel_table(candidate_box.size()) : NULL, _joint_hist.data());
+    return (float)_joint_model.distance(_joint_hist.data());
+}
+
+
+/* Sliding histogram
+* Each channel keeps the counts of the last box it was computed for; the next candidate is
+* obtained from them by strips when that is cheaper than counting the box again. Channels
+* skipped by pruning simply slide further on their next candidate
+*/
+void ColorTracker::_sliding_histogram(int channel, Rect candidate_box, float* hist) {
+
+    Mat& counts = _sliding_histograms[channel];
+    counts.create(bins, 1, CV_32F);
+    Rect& last = _sliding_boxes[channel];
+
+    int dx = abs(candidate_box.x - last.x);
+    int dy = abs(candidate_box.y - last.y);
+    if(last.area() > 0 && last.size() == candidate_box.size() && dx*candidate_box.height + dy*candidate_box.width < candidate_box.area()){
+        slide_histogram(_bin_planes[channel], last, candidate_box, bins, counts.ptr<float>());
+    }
+    else{
+        bin_histogram(_bin_planes[channel], candidate_box, bins, counts.ptr<float>());
+    }
+    last = candidate_box;
+    memcpy(hist, counts.ptr<float>(), bins*sizeof(float));
+}
+
+
+/* Block cache
+* Only for single scale histogram scoring on the candidate grid with every pixel counted:
+* the cached histograms are exact counts of a box that the next frame corrects pixel by pixel,
+* which kernel weights, depending on the place of the pixel in the box, do not allow.
+* Joint histograms are counted from the model index plane instead
+*/
+bool ColorTracker::_block_cache() {
+    return cache_blocks && score_mode == SCORE_HISTOGRAM && !_particle_mode() && max_samples <= 0 && scale_step <= 1 && !kernel_weights && !joint_histogram;
+}
+
+
+/* Cache buffers
+* Sized on the first frame like the other buffers: the previous bin planes, the dirty blocks
+* of any window, the dirty parts of a box and a cached histogram per channel for every
+* candidate of the grid
+*/
+void ColorTracker::_reserve_cache(Size frame_size) {
+
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i]){
+            _previous_bin_planes[i].create(frame_size, CV_8U);
+        }
+    }
+    _dirty_blocks.reserve(frame_size);
+    _dirty_regions.reserve((_model.box.width/8 + 2)*(_model.box.height/8 + 2));
+    _histogram_cache.reserve((2*candidate_levels+1)*(2*candidate_levels+1)*_num_channels, vector<float>(bins));
+}
+
+
+/* Cached frame
+* Quantizes the window into the bin planes while keeping those of the last tracked frame,
+* and marks the 8x8 blocks where any tracked channel changed bin since then. Blocks outside
+* the previous window are unknown and count as changed
+*/
+void ColorTracker::_cache_frame(Rect window) {
+
+    _histogram_cache.next_frame();
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i]){
+            swap(_bin_planes[i], _previous_bin_planes[i]);
+        }
+    }
+    _quantize_color_spaces(window);
+
+    _dirty_blocks.reset(window, _cache_window);
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i] && !_previous_bin_planes[i].empty()){
+            _dirty_blocks.compare(_bin_planes[i], _previous_bin_planes[i], Point(0, 0));
+        }
+    }
+    _cache_window = window;
+    _cache_stats.blocks += _dirty_blocks.blocks();
+    _cache_stats.dirty_blocks += _dirty_blocks.dirty();
+}
+
+
+/* Cached histogram
+* A candidate already scored in the last tracked frame takes its counts from then and only
+* recounts the pixels of its dirty blocks; any other candidate is counted and stored
+*/
+void ColorTracker::_cached_histogram(int channel, Rect candidate_box, float* hist) {
+
+    uint64_t key = box_key(candidate_box, channel);
+    bool stale = false;
+    vector<float>* entry = _histogram_cache.find(key, stale);
+    _cache_stats.lookups++;
+
+    if(entry && !stale){
+        _cache_stats.hits++;
+    }
+    else if(entry && _dirty_blocks.regions(candidate_box, _dirty_regions)){
+        for(size_t r = 0; r < _dirty_regions.size(); r++){
+            update_histogram(entry->data(), bins, _previous_bin_planes[channel], _bin_planes[channel], _dirty_regions[r]);
+        }
+        _cache_stats.hits++;
+    }
+    else{
+        if(!entry){
+            entry = &_histogram_cache.insert(key);
+        }
+        entry->resize(bins);
+        bin_histogram(_bin_planes[channel], candidate_box, bins, entry->data());
+    }
+    memcpy(hist, entry->data(), bins*sizeof(float));
+}
+
+
+// Converts the tracked color channels inside window into bin index planes, once per frame
+void ColorTracker::_quantize_color_spaces(Rect window) {
+
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i]){
+            quantize_plane(_color_spaces[i], window, _bin_luts[i], _bin_planes[i]);
+        }
+    }
+    if(_joint() && !_joint_hist.empty()){
+        _joint_model.index_plane(_bin_planes, window, _joint_indices);
+    }
+}
+
+
 /* Color histogram tracking
 * Obtains the histogram of one candidate according to the specified channel in track type 
 * Computes the Battacharyya distance between target and candidate histogram
 * If more than one color channel is specified, the difference distances are mixed using L2 distance
+* Histograms are computed over the candidate region only, in buffers owned by the tracker
+* With pruning, a candidate is abandoned after the channel where it provably loses; its score
+* is then the partial distance, a lower bound that is still not below the best candidate.
+* An exact distance is never pruned and skips the block cache and the sliding histograms,
+* whose state belongs to the candidates of the frame
 */
-float ColorTracker::_get_distance(Rect candidate_box, Mat mask) {
+float ColorTracker::_get_distance(Rect candidate_box, bool exact) {
     
-    Mat hist_candidate;
-    vector<double> scores;
-    double score;
-    mask(candidate_box) = 1;
-
-    float bgrsRanges[] = {0,256};
-    float hRanges[] = {0,180};
-    const float* bgrs_histRange = { bgrsRanges };
-    const float* h_histRange = { hRanges };
-    bool uniform = true, accumulate = false;
-    int nimages = 1,  dimensions = 1;
+    if(_joint()){
+        return _get_joint_distance(candidate_box);
+    }
+
+    float* hist_candidate = _hist_candidate.ptr<float>();
+    _scores.clear();
+    bool pruning = _pruning() && !exact;
+    double sum_squares = 0;
 
     for(int i = 0;i < 6; i++){   
         
         if(_track_type[i]){
-            if(i==3){
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist_candidate, dimensions, &bins, &h_histRange, uniform, accumulate );
-            }
-            else{
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist_candidate, dimensions, &bins, &bgrs_histRange, uniform, accumulate );
+            _candidate_histogram(i, candidate_box, exact, hist_candidate);
+            normalize_histogram(hist_candidate, bins, 1, 100);
+            _scores.push_back(bhattacharyya_distance(hist_candidate, _model.histograms[i].ptr<float>(), bins));
+
+            // The L2 mix only grows with more channels: stop once it cannot beat the best candidate
+            if(pruning){
+                sum_squares += _scores.back()*_scores.back();
+                if((int)_scores.size() < _num_channels && sqrt(sum_squares) >= _best_score){
+                    _record_pruning((int)_scores.size(), _num_channels);
+                    return sqrt(sum_squares);
+                }
             }
-            normalize(hist_candidate, hist_candidate, 1, 100, NORM_MINMAX, -1, Mat() );      
-            score = compareHist(hist_candidate, _model.histograms[i],3);
-            scores.push_back(score);
         }            
     }   
-    return norm(scores, NORM_L2); 
+    if(pruning){
+        _record_pruning((int)_scores.size(), _num_channels);
+        return sqrt(sum_squares);
+    }
+    return norm(_scores, NORM_L2); 
 }
 
 
@@ -112,73 +795,334 @@ float ColorTracker::_get_distance(Rect candidate_box, Mat mask) {
 * Obtains the histogram(s) of region defined by ground truth  
 * Returns "distances" for code consistency
 */
-void ColorTracker::_init_model(Mat mask) {
-    
-    Mat hist;
-    mask(_model.box) = 1;
-
-    float bgrsRanges[] = {0,256};
-    float hRanges[] = {0,180};
-    const float* bgrs_histRange = { bgrsRanges };
-    const float* h_histRange = { hRanges };
-    bool uniform = true, accumulate = false;
-    int nimages = 1,  dimensions = 1;
+void ColorTracker::_init_model() {
 
     for(int i = 0;i < 6; i++){        
         if(_track_type[i]){
-
-            if(i==3){
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist, dimensions, &bins, &h_histRange, uniform, accumulate );
+            _model.histograms[i].create(bins, 1, CV_32F);
+            float* hist = _model.histograms[i].ptr<float>();
+            if(kernel_weights){
+                weighted_bin_histogram(_bin_planes[i], _model.box, bins, _kernel_table(_model.box.size()), hist);
             }
             else{
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist, dimensions, &bins, &bgrs_histRange, uniform, accumulate );
+                sampled_bin_histogram(_bin_planes[i], _model.box, bins, sample_stride(_model.box.size(), max_samples), hist);
             }
-            normalize(hist, hist, 1, 100, NORM_MINMAX, -1, Mat() );      
-            _model.histograms.push_back(hist);
+            normalize_histogram(hist, bins, 1, 100);
         }            
-        else{
-            _model.histograms.push_back(Mat());
-        }
     }
+    if(_joint()){
+        _joint_model.configure(bins, _track_type);
+        _joint_model.build(_bin_planes, _model.box, kernel_weights ? _kernel_table(_model.box.size()) : NULL);
+        _joint_hist.resize(_joint_model.size() + 2);
+        _joint_model.index_plane(_bin_planes, _model.box, _joint_indices);
+    }
+    _init_backprojection();
+    if(_dense_search()){
+        _init_dense();
+    }
+
     frame_candidates.scores.push_back(0);
     frame_candidates.boxes.push_back(_model.box);
 }
 
 
-// Converts the input frame into multiple color channels according to tracking type for color histogram tracking
-void ColorTracker::_get_color_space(Mat frame){
+/* Back-projection model
+* Weight of each bin is sqrt(p) where p is the model histogram normalized to sum 1
+* The mean of the back-projected map over a box with histogram q is then sum(q*sqrt(p)),
+* a linear approximation of the Bhattacharyya coefficient sum(sqrt(q*p)).
+* The reference is that mean over the model box itself, averaged over the tracked channels
+*/
+void ColorTracker::_init_backprojection() {
 
-    vector<Mat> bgr_planes;
-    split(frame, bgr_planes);
-    
-    for(int i = 0;i < 3; i++){        
+    float counts[256];
+    int channels = 0;
+    _backprojection_reference = 0;
+
+    for(int i = 0;i < 6; i++){
+        for(int b = 0; b < 256; b++){
+            _backprojection_weights[i][b] = 0;
+        }
         if(_track_type[i]){
-            _color_spaces.push_back(bgr_planes[i]);
-            }        
-        else{
-            _color_spaces.push_back(Mat()); }
+            bin_histogram(_bin_planes[i], _model.box, bins, counts);
+            double total = 0;
+            for(int b = 0; b < bins; b++){
+                total += counts[b];
+            }
+            for(int b = 0; b < bins && total > 0; b++){
+                double p = counts[b]/total;
+                _backprojection_weights[i][b] = (float)sqrt(p);
+                _backprojection_reference += p*sqrt(p);
+            }
+            channels++;
+        }
     }
 
-    for(int i = 3;i < 5; i++){ 
+    // Weights are pre-divided by the number of channels so the map is their mean
+    for(int i = 0;i < 6; i++){
+        for(int b = 0; b < 256; b++){
+            _backprojection_weights[i][b] /= max(channels, 1);
+        }
+    }
+    _backprojection_reference /= max(channels, 1);
+}
+
+
+/* Back-projection
+* Builds the likelihood map of window once per frame and its integral image,
+* so every candidate inside window is scored with four lookups whatever the bin count
+*/
+void ColorTracker::_backproject(Rect window) {
+
+    _likelihood.create(window.height, window.width, CV_32F);
+    _likelihood = Scalar(0);
+
+    for(int i = 0;i < 6; i++){
         if(_track_type[i]){
-            Mat hsv;
-            vector<Mat> hsv_planes;
-            cvtColor(frame, hsv, 40);
-            split(hsv, hsv_planes);
-            _color_spaces.push_back(hsv_planes[i-3]);
-            }      
-        else{
-            _color_spaces.push_back(Mat());
+            const float* weights = _backprojection_weights[i];
+            for(int y = 0; y < window.height; y++){
+                const uchar* bin_row = _bin_planes[i].ptr<uchar>(window.y + y) + window.x;
+                float* row = _likelihood.ptr<float>(y);
+                for(int x = 0; x < window.width; x++){
+                    row[x] += weights[bin_row[x]];
+                }
+            }
         }
     }
 
-    if(_track_type[5]){
-        Mat gray;
-        cvtColor(frame, gray, CV_BGR2GRAY);
-        _color_spaces.push_back(gray);
+    integral(_likelihood, _likelihood_integral, CV_64F);
+    _likelihood_origin = window.tl();
+}
+
+
+/* Back-projection distance
+* 1 minus the mean likelihood over the candidate relative to the model reference,
+* so that lower is better as for histogram scoring. Candidates concentrated on the
+* most likely colors may score above the reference and get negative distances;
+* the value is not clamped to keep their ranking.
+*/
+float ColorTracker::_get_backprojection_distance(Rect candidate_box) {
+
+    int x0 = candidate_box.x - _likelihood_origin.x;
+    int y0 = candidate_box.y - _likelihood_origin.y;
+    int x1 = x0 + candidate_box.width;
+    int y1 = y0 + candidate_box.height;
+
+    const double* top = _likelihood_integral.ptr<double>(y0);
+    const double* bottom = _likelihood_integral.ptr<double>(y1);
+    double mean = (bottom[x1] - bottom[x0] - top[x1] + top[x0])/candidate_box.area();
+
+    double coefficient = _backprojection_reference > 0 ? mean/_backprojection_reference : 0;
+    return 1. - coefficient;
+}
+
+
+/* Dense model
+* The template is the back-projection of the model box onto itself, so dense scoring
+* compares the spatial layout of the likelihood and not only its mean.
+* Its spectrum is sized for the largest search window
+*/
+void ColorTracker::_init_dense() {
+
+    _backproject(_model.box);
+    int margin = candidate_levels*candidate_step;
+    _dense_matcher.set_template(vector<Mat>(1, _likelihood), _model.box.size() + Size(2*margin, 2*margin));
+}
+
+
+/* Dense matching
+* Mean squared difference between the template and the likelihood map of the window at every
+* offset; _dense_scores(y, x) is the score of the candidate whose corner is the window corner + (x, y).
+* Must run after _backproject(window)
+*/
+void ColorTracker::_dense_match() {
+
+    _dense_features[0] = _likelihood;
+    _dense_matcher.match(_dense_features, _dense_scores);
+}
+
+
+/* Hypothesis testing search (Fieguth & Terzopoulos 1997, eqs. 7-10)
+* The object is predicted at its last position plus the estimated velocity and the
+* lattice of (2*candidate_levels+1)^2 hypotheses with spacing candidate_step around the
+* prediction is tested; candidate_levels = 1 is the 9-ary cluster of the paper.
+* One integral image of the BGR frame over the lattice makes every region mean O(1)
+*/
+void ColorTracker::_hypothesis_search(Mat frame) {
+
+    Rect frame_rect(0, 0, frame.cols, frame.rows);
+
+    if(!_model_initialized){
+        _model_initialized = true;
+        integral(frame(_model.box), _color_integral, CV_64F);
+        _color_integral_origin = _model.box.tl();
+        _init_color_ratio();
+        frame_candidates.scores.push_back(0);
+        frame_candidates.boxes.push_back(_model.box);
+        return;
+    }
+
+    _predicted_box = _predict_box(frame.size());
+    Rect window = _search_window(frame.size());
+    integral(frame(window), _color_integral, CV_64F);
+    _color_integral_origin = window.tl();
+
+    grid_offsets(candidate_levels, candidate_step, _budget.active() ? GRID_RINGS : GRID_RASTER, _offsets);
+    for (size_t k = 0; k < _offsets.size() && !_budget.expired(frame_candidates.boxes.size()); k++){
+        Rect candidate_box = _predicted_box + _offsets[k];
+        if( (candidate_box & frame_rect) == candidate_box ){
+            frame_candidates.boxes.push_back(candidate_box);
+            frame_candidates.scores.push_back(_get_color_ratio_distance(candidate_box));
+        }
+    }
+}
+
+
+/* Color ratio model
+* Regions A-E of Figure 1 in the paper: the center and the four side cells of a 3x3 grid
+* over the box. The target of each region is its mean BGR color in the first frame
+*/
+void ColorTracker::_init_color_ratio() {
+
+    int cw = max(_model.box.width/3, 1);
+    int ch = max(_model.box.height/3, 1);
+    int cells[5][2] = {{0, 1}, {1, 0}, {2, 1}, {1, 2}, {1, 1}};
+    Rect box_rect(Point(0, 0), _model.box.size());
+
+    _ratio_regions.clear();
+    _ratio_targets.clear();
+    for(int i = 0; i < 5; i++){
+        Rect region = Rect(cells[i][0]*cw, cells[i][1]*ch, cw, ch) & box_rect;
+        _ratio_regions.push_back(region);
+        _ratio_targets.push_back(Vec3d(0, 0, 0));
+    }
+
+    // Same region means as the candidates, then kept as targets
+    for(int i = 0; i < 5; i++){
+        Rect region = _ratio_regions[i] + _model.box.tl() - _color_integral_origin;
+        const Vec3d* top = _color_integral.ptr<Vec3d>(region.y);
+        const Vec3d* bottom = _color_integral.ptr<Vec3d>(region.y + region.height);
+        Vec3d sum = bottom[region.x + region.width] - bottom[region.x] - top[region.x + region.width] + top[region.x];
+        _ratio_targets[i] = sum*(1./region.area());
+    }
+}
+
+
+/* Color ratio goodness of fit (eqs. 3-5)
+* For each region the ratios between candidate and target mean color are computed per
+* channel; max/min of the ratios is 1 for a perfect fit up to an intensity factor.
+* The distance is the average over the regions. Means are offset by one so dark regions
+* do not divide by zero
+*/
+float ColorTracker::_get_color_ratio_distance(Rect candidate_box) {
+
+    double psi = 0;
+    for(size_t i = 0; i < _ratio_regions.size(); i++){
+        Rect region = _ratio_regions[i] + candidate_box.tl() - _color_integral_origin;
+        const Vec3d* top = _color_integral.ptr<Vec3d>(region.y);
+        const Vec3d* bottom = _color_integral.ptr<Vec3d>(region.y + region.height);
+        Vec3d sum = bottom[region.x + region.width] - bottom[region.x] - top[region.x + region.width] + top[region.x];
+
+        double highest = 0, lowest = DBL_MAX;
+        for(int c = 0; c < 3; c++){
+            double ratio = (sum[c]/region.area() + 1.)/(_ratio_targets[i][c] + 1.);
+            highest = max(highest, ratio);
+            lowest = min(lowest, ratio);
+        }
+        psi += highest/lowest;
+    }
+    return (float)(psi/_ratio_regions.size());
+}
+
+
+// Last box moved by the estimated velocity, kept inside the frame
+Rect ColorTracker::_predict_box(Size frame_size) {
+
+    Rect box = _model.box + Point(cvRound(_velocity.x), cvRound(_velocity.y));
+    box.x = min(max(box.x, 0), frame_size.width - box.width);
+    box.y = min(max(box.y, 0), frame_size.height - box.height);
+    return box;
+}
+
+
+/* Velocity estimate (eq. 11)
+* The chosen hypothesis is expressed in lattice steps from the prediction and the
+* velocity is corrected per axis on accelerating and decelerating trends, and damped
+* when the prediction was right
+*/
+void ColorTracker::_update_velocity(Rect chosen_box) {
+
+    Point step((chosen_box.x - _predicted_box.x)/candidate_step, (chosen_box.y - _predicted_box.y)/candidate_step);
+    _velocity.x = _trend_velocity(_velocity.x, step.x, _last_step.x, (float)candidate_step);
+    _velocity.y = _trend_velocity(_velocity.y, step.y, _last_step.y, (float)candidate_step);
+    _last_step = step;
+}
+
+
+// One axis of the trend estimator, velocity in pixels per frame
+float ColorTracker::_trend_velocity(float velocity, int step, int last_step, float delta) {
+
+    int step_sign = (step > 0) - (step < 0);
+    int velocity_sign = (velocity > 0) - (velocity < 0);
+    float updated = velocity;
+
+    if(step*last_step > 0){
+        updated += delta*step_sign;
+    }
+    if(step*velocity < 0){
+        updated += delta*step_sign;
+    }
+    if(step == 0){
+        updated -= delta*velocity_sign/2;
     }
+    return updated;
 }
 
 
+/* Motion on a skipped frame
+* A frame skipped by the static gate keeps the box, so the motion models see a frame in
+* which the target did not move: the color ratio velocity is corrected as if the kept box
+* were the chosen hypothesis, and the particles keep their centers with zero velocity
+*/
+void ColorTracker::_hold_motion(Size frame_size) {
+
+    if(!_model_initialized){
+        return;
+    }
+    if(score_mode == SCORE_COLOR_RATIO){
+        _predicted_box = _predict_box(frame_size);
+        _update_velocity(_model.box);
+    }
+    if(_particle_mode()){
+        _particle_filter.hold();
+    }
+}
+
 
+// Converts the input frame into multiple color channels according to tracking type for color histogram tracking
+// Planes are written into buffers owned by the tracker, so after the first frame nothing is allocated
+void ColorTracker::_get_color_space(Mat frame){
 
+    if(_track_type[0] || _track_type[1] || _track_type[2]){
+        split(frame, &_bgr_planes[0]);
+        for(int i = 0;i < 3; i++){        
+            if(_track_type[i]){
+                _color_spaces[i] = _bgr_planes[i];
+            }
+        }
+    }
+
+    if(_track_type[3] || _track_type[4]){
+        cvtColor(frame, _hsv, COLOR_BGR2HSV);
+        split(_hsv, &_hsv_planes[0]);
+        for(int i = 3;i < 5; i++){ 
+            if(_track_type[i]){
+                _color_spaces[i] = _hsv_planes[i-3];
+            }
+        }
+    }
+
+    if(_track_type[5]){
+        cvtColor(frame, _gray, CV_BGR2GRAY);
+        _color_spaces[5] = _gray;
+    }
+}
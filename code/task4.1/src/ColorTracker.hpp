@@ -1,8 +1,18 @@
+#ifndef COLORTRACKER_HPP_
+#define COLORTRACKER_HPP_
+
 #include <stdio.h>
 #include <iostream>
 #include <sstream>
 
 #include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "DenseCorrelation.hpp"
+#include "ParticleFilter.hpp"
+#include "SearchBudget.hpp"
+#include "StaticGate.hpp"
+#include "BlockCache.hpp"
+#include "JointHistogram.hpp"
 
 using namespace std;
 using namespace cv;
@@ -18,6 +28,26 @@ struct candidates {
     vector<double> scores;
 };
 
+struct prune_stats {
+    long candidates;            // candidates scored with pruning enabled
+    long pruned;                // candidates abandoned before their last channel
+    vector<long> pruned_at;     // pruned_at[k]: abandoned after k+1 channels
+};
+
+struct redetect_stats {
+    int lost_frames;            // frames flagged by the loss detector
+    int searches;               // full frame re-detection passes
+    int recoveries;             // passes that moved the target to a better box
+};
+
+// How candidates are compared with the model
+enum color_score_mode {
+    SCORE_HISTOGRAM = 0,        // Bhattacharyya distance between histograms (per candidate histogram)
+    SCORE_BACKPROJECTION = 1,   // model histogram back-projected once per frame, O(1) box sums
+    SCORE_DENSE = 2,            // back-projection map matched against the model's by FFT, every offset at once
+    SCORE_COLOR_RATIO = 3       // mean color ratios of five regions (Fieguth & Terzopoulos 1997), no histograms
+};
+
 class ColorTracker{
     private:
         // Variables
@@ -25,12 +55,128 @@ class ColorTracker{
         model _model;
         vector<bool> _track_type;
         vector<Mat> _color_spaces;
+        vector<Mat> _bin_planes;
+        uchar _bin_luts[6][256];
+
+        // buffers reused across frames
+        vector<Mat> _bgr_planes;
+        vector<Mat> _hsv_planes;
+        Mat _hsv;
+        Mat _gray;
+        Mat _hist_candidate;
+        vector<double> _scores;
+        vector<Point> _offsets;
+
+        // deadline
+        SearchBudget _budget;
+
+        // static region gating
+        StaticGate _gate;
+
+        // sliding histograms along the candidate grid
+        vector<Mat> _sliding_histograms;
+        vector<Rect> _sliding_boxes;
+
+        // Epanechnikov weight tables, one per box size
+        vector<Mat> _kernel_tables;
+
+        // sparse joint histogram of the tracked channels
+        JointModel _joint_model;
+        Mat _joint_indices;
+        vector<float> _joint_hist;
+
+        // block cache of candidate histograms
+        vector<Mat> _previous_bin_planes;
+        DirtyBlocks _dirty_blocks;
+        FrameCache< vector<float> > _histogram_cache;
+        vector<Rect> _dirty_regions;
+        Rect _cache_window;
+        cache_stats _cache_stats;
+
+        // branch and bound
+        int _num_channels;
+        double _best_score;
+        prune_stats _prune_stats;
+
+        // multi-scale search
+        vector<double> _scales;
+        vector<Mat> _integral_histograms;
+        bool _use_integral_histograms;
+        Point _window_origin;
+
+        // back-projection scoring
+        float _backprojection_weights[6][256];
+        double _backprojection_reference;
+        Mat _likelihood;
+        Mat _likelihood_integral;
+        Point _likelihood_origin;
+
+        // dense scoring
+        DenseMatcher _dense_matcher;
+        vector<Mat> _dense_features;
+        Mat _dense_scores;
+
+        // particle filter search
+        ParticleFilter _particle_filter;
+
+        // loss detection and re-detection
+        int _lost_frames;
+        redetect_stats _redetect_stats;
+        Mat _redetect_likelihood;
+        Mat _redetect_integral;
+
+        // color ratio scoring
+        vector<Rect> _ratio_regions;
+        vector<Vec3d> _ratio_targets;
+        Mat _color_integral;
+        Point _color_integral_origin;
+        Rect _predicted_box;
+        Point2f _velocity;
+        Point _last_step;
 
         // functions
-        void _init_model(Mat mask);
+        void _init_model();
         void _get_color_space(Mat frame);
-        float _get_distance(Rect candidate_box, Mat mask);
+        float _get_distance(Rect candidate_box, bool exact);
         void _generate_candidate(Mat frame);
+        float _score(Rect candidate_box);
+        void _init_backprojection();
+        void _backproject(Rect window);
+        float _get_backprojection_distance(Rect candidate_box);
+        bool _dense_search();
+        void _init_dense();
+        void _dense_match();
+        void _hypothesis_search(Mat frame);
+        bool _particle_mode();
+        bool _pruning();
+        void _record_pruning(int stages, int total_stages);
+        void _particle_search(Mat frame);
+        Rect _particle_window(Size frame_size);
+        void _init_color_ratio();
+        float _get_color_ratio_distance(Rect candidate_box);
+        Rect _predict_box(Size frame_size);
+        void _update_velocity(Rect chosen_box);
+        void _hold_motion(Size frame_size);
+        static float _trend_velocity(float velocity, int step, int last_step, float delta);
+        void _quantize_color_spaces(Rect window);
+        Rect _search_window(Size frame_size);
+        const vector<double>& _candidate_scales();
+        Rect _scaled_box(double scale);
+        size_t _integral_histograms_bytes(Size window);
+        void _candidate_histogram(int channel, Rect candidate_box, bool exact, float* hist);
+        bool _redetection();
+        bool _target_lost();
+        void _check_target(Mat frame);
+        Rect _global_search(Size frame_size);
+        bool _block_cache();
+        void _reserve_cache(Size frame_size);
+        void _cache_frame(Rect window);
+        void _cached_histogram(int channel, Rect candidate_box, float* hist);
+        bool _sliding();
+        void _sliding_histogram(int channel, Rect candidate_box, float* hist);
+        const float* _kernel_table(Size box);
+        bool _joint();
+        float _get_joint_distance(Rect candidate_box);
 
 
     public:
@@ -39,11 +185,32 @@ class ColorTracker{
         
         // functions
         Rect track(Mat frame);
+        Rect track(Mat frame, double budget_ms);
+        const budget_stats& get_budget_stats() const;
+        const gate_stats& get_gate_stats() const;
+        const cache_stats& get_cache_stats() const;
+        const prune_stats& get_prune_stats() const;
+        const redetect_stats& get_redetect_stats() const;
+        const JointModel& get_joint_model() const;
 
         //variables
         int candidate_levels;
         int candidate_step;
+        double scale_step;
+        int num_particles;
+        float particle_noise;
+        double static_threshold;
+        bool prune_candidates;
+        int max_samples;
+        bool cache_blocks;
+        bool sliding_histograms;
+        bool kernel_weights;
+        bool joint_histogram;
+        double loss_distance;
+        double loss_margin;
+        int loss_frames;
         int bins;
+        int score_mode;
         int num_candidates;
         candidates frame_candidates;
         
@@ -51,4 +218,4 @@ class ColorTracker{
 };
 
 
-
+#endif /* COLORTRACKER_HPP_ */
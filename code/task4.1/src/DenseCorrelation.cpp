@@ -0,0 +1,92 @@
+#include "DenseCorrelation.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+DenseMatcher::DenseMatcher() {
+    _templ_energy = 0;
+}
+
+
+/* Template
+* templ holds one CV_32F plane per feature channel, all of the same size
+* The DFT size covers the largest window that will be matched, so the circular
+* correlation never wraps for valid placements and the template spectra are
+* computed once for the whole sequence
+*/
+void DenseMatcher::set_template(const vector<Mat>& templ, Size max_window) {
+
+    CV_Assert(!templ.empty());
+    _templ_size = templ[0].size();
+    CV_Assert(max_window.width >= _templ_size.width && max_window.height >= _templ_size.height);
+
+    _dft_size = Size(getOptimalDFTSize(max_window.width), getOptimalDFTSize(max_window.height));
+    _templ_spectra.resize(templ.size());
+    _templ_energy = 0;
+
+    for(size_t c = 0; c < templ.size(); c++){
+        CV_Assert(templ[c].type() == CV_32F && templ[c].size() == _templ_size);
+        _padded.create(_dft_size, CV_32F);
+        _padded = Scalar(0);
+        templ[c].copyTo(_padded(Rect(Point(0, 0), _templ_size)));
+        dft(_padded, _templ_spectra[c], 0, _templ_size.height);
+        _templ_energy += templ[c].dot(templ[c]);
+    }
+}
+
+
+/* Match
+* window holds the same channels as the template, all of the same size and at most
+* the max_window given to set_template. ssd(v, u) is the mean squared difference per
+* pixel between the template and the window region at offset (u, v).
+*/
+void DenseMatcher::match(const vector<Mat>& window, Mat& ssd) {
+
+    CV_Assert(window.size() == _templ_spectra.size());
+    Size size = window[0].size();
+    CV_Assert(size.width <= _dft_size.width && size.height <= _dft_size.height);
+    CV_Assert(size.width >= _templ_size.width && size.height >= _templ_size.height);
+
+    _accumulated.create(_dft_size, CV_32F);
+    _accumulated = Scalar(0);
+    _energy.create(size, CV_32F);
+    _energy = Scalar(0);
+
+    for(size_t c = 0; c < window.size(); c++){
+        CV_Assert(window[c].type() == CV_32F && window[c].size() == size);
+        _padded.create(_dft_size, CV_32F);
+        _padded = Scalar(0);
+        window[c].copyTo(_padded(Rect(Point(0, 0), size)));
+        dft(_padded, _spectrum, 0, size.height);
+        mulSpectrums(_spectrum, _templ_spectra[c], _product, 0, true);
+        add(_accumulated, _product, _accumulated);
+        accumulateSquare(window[c], _energy);
+    }
+
+    idft(_accumulated, _correlation, DFT_SCALE | DFT_REAL_OUTPUT);
+    integral(_energy, _energy_integral, CV_64F);
+
+    int tw = _templ_size.width;
+    int th = _templ_size.height;
+    double area = (double)tw*th;
+    ssd.create(size.height - th + 1, size.width - tw + 1, CV_32F);
+
+    for(int v = 0; v < ssd.rows; v++){
+        const double* top = _energy_integral.ptr<double>(v);
+        const double* bottom = _energy_integral.ptr<double>(v + th);
+        const float* correlation = _correlation.ptr<float>(v);
+        float* row = ssd.ptr<float>(v);
+        for(int u = 0; u < ssd.cols; u++){
+            double energy = bottom[u + tw] - bottom[u] - top[u + tw] + top[u];
+            // Rounding in the DFT can push a perfect match slightly below zero
+            row[u] = (float)(max(energy - 2.*correlation[u] + _templ_energy, 0.)/area);
+        }
+    }
+}
+
+
+// True until set_template has been called
+bool DenseMatcher::empty() const {
+    return _templ_spectra.empty();
+}
@@ -0,0 +1,135 @@
+#include "ParticleFilter.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+ParticleFilter::ParticleFilter() {
+    _position_noise = 0;
+    _velocity_noise = 0;
+    _likelihood_sigma = 0.1;
+}
+
+
+/* Initialization
+* Every particle starts at center with zero velocity and the same weight.
+* position_noise is the standard deviation of the per frame displacement noise in pixels;
+* velocity noise is half of it
+*/
+void ParticleFilter::init(int num_particles, Point2f center, float position_noise, uint64 seed) {
+
+    CV_Assert(num_particles > 0);
+    _rng = RNG(seed);
+    _position_noise = position_noise;
+    _velocity_noise = position_noise/2;
+    _estimate = center;
+
+    particle p;
+    p.center = center;
+    p.velocity = Point2f(0, 0);
+    p.weight = 1./num_particles;
+    _particles.assign(num_particles, p);
+    _resampled.resize(num_particles);
+}
+
+
+/* Prediction
+* Constant velocity motion plus Gaussian noise on position and velocity.
+* Centers are kept where a box of box_size fits inside the frame
+*/
+void ParticleFilter::predict(Size box_size, Size frame_size) {
+
+    float min_x = box_size.width/2.f, max_x = max(frame_size.width - box_size.width/2.f, min_x);
+    float min_y = box_size.height/2.f, max_y = max(frame_size.height - box_size.height/2.f, min_y);
+
+    for(size_t i = 0; i < _particles.size(); i++){
+        particle& p = _particles[i];
+        p.velocity.x += (float)_rng.gaussian(_velocity_noise);
+        p.velocity.y += (float)_rng.gaussian(_velocity_noise);
+        p.center.x += p.velocity.x + (float)_rng.gaussian(_position_noise);
+        p.center.y += p.velocity.y + (float)_rng.gaussian(_position_noise);
+        p.center.x = min(max(p.center.x, min_x), max_x);
+        p.center.y = min(max(p.center.y, min_y), max_y);
+    }
+}
+
+
+/* Update
+* distances[i] is the tracker distance of box(i). They are rescaled to [0, 1] over the
+* frame so the likelihood exp(-d/sigma) has the same sharpness whatever the tracker.
+* The estimate is the weighted mean center; particles are then resampled
+*/
+void ParticleFilter::update(const vector<double>& distances) {
+
+    CV_Assert(distances.size() == _particles.size());
+    int n = (int)_particles.size();
+    double lowest = *min_element(distances.begin(), distances.end());
+    double highest = *max_element(distances.begin(), distances.end());
+    double range = highest - lowest;
+
+    double total = 0;
+    for(int i = 0; i < n; i++){
+        double d = range > 0 ? (distances[i] - lowest)/range : 0;
+        _particles[i].weight = exp(-d/_likelihood_sigma);
+        total += _particles[i].weight;
+    }
+
+    _estimate = Point2f(0, 0);
+    for(int i = 0; i < n; i++){
+        _particles[i].weight /= total;
+        _estimate += _particles[i].center*(float)_particles[i].weight;
+    }
+
+    // Systematic resampling: one uniform offset, n evenly spaced pointers on the cumulative weights
+    double step = 1./n;
+    double pointer = _rng.uniform(0., step);
+    double cumulative = _particles[0].weight;
+    int j = 0;
+    for(int i = 0; i < n; i++){
+        while(pointer > cumulative && j < n - 1){
+            j++;
+            cumulative += _particles[j].weight;
+        }
+        _resampled[i] = _particles[j];
+        _resampled[i].weight = step;
+        pointer += step;
+    }
+    _particles.swap(_resampled);
+}
+
+
+/* Hold
+* For a frame the tracker skipped because the target region did not change: the target
+* was seen not to move, so centers and the estimate are kept and velocities cleared, and
+* the next prediction does not carry the motion from before the pause
+*/
+void ParticleFilter::hold() {
+
+    for(size_t i = 0; i < _particles.size(); i++){
+        _particles[i].velocity = Point2f(0, 0);
+    }
+}
+
+
+// Box of box_size centered on particle i
+Rect ParticleFilter::box(int i, Size box_size) const {
+
+    const Point2f& c = _particles[i].center;
+    return Rect(cvRound(c.x - box_size.width/2.f), cvRound(c.y - box_size.height/2.f), box_size.width, box_size.height);
+}
+
+
+// Box of box_size centered on the last estimate, kept inside the frame
+Rect ParticleFilter::estimate_box(Size box_size, Size frame_size) const {
+
+    int x = cvRound(_estimate.x - box_size.width/2.f);
+    int y = cvRound(_estimate.y - box_size.height/2.f);
+    x = min(max(x, 0), frame_size.width - box_size.width);
+    y = min(max(y, 0), frame_size.height - box_size.height);
+    return Rect(x, y, box_size.width, box_size.height);
+}
+
+
+int ParticleFilter::size() const {
+    return (int)_particles.size();
+}
@@ -0,0 +1,45 @@
+#ifndef STATICGATE_HPP_
+#define STATICGATE_HPP_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+struct gate_stats {
+    int frames;                 // frames checked by the gate
+    int skipped;                // frames that reused the previous result
+};
+
+/* Static region gate
+* Compares the search window of the current frame with the same window of the last frame
+* that was actually tracked, in 8x8 blocks. The window is unchanged when the mean absolute
+* difference of every block (over its color channels) stays below threshold; the tracker
+* can then keep its previous result. The reference is only replaced by frames that are
+* tracked, so slow drifts add up until they open the gate. A threshold of 0 or less
+* disables the gate.
+*/
+class StaticGate {
+    private:
+        // variables
+        cv::Mat _reference;
+        cv::Rect _window;
+        std::vector<int> _block_sums;
+        gate_stats _stats;
+
+        // functions
+        bool _same_blocks(const cv::Mat& region);
+
+    public:
+        // Constructor
+        StaticGate();
+
+        // functions
+        bool unchanged(const cv::Mat& frame, cv::Rect window);
+        const gate_stats& stats() const;
+
+        // variables
+        double threshold;
+};
+
+
+#endif /* STATICGATE_HPP_ */
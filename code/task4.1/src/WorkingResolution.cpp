@@ -0,0 +1,65 @@
+#include "WorkingResolution.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// target_pixels <= 0 disables the working resolution (scale 1)
+WorkingResolution::WorkingResolution(Rect initial_box, Size full_size, int target_pixels) {
+
+    _full_size = full_size;
+    _scale = 1;
+    if(target_pixels > 0 && initial_box.area() > target_pixels){
+        _scale = sqrt(target_pixels/(double)initial_box.area());
+    }
+
+    // resize rounds the scaled frame size
+    _working_size = full_size;
+    if(_scale < 1){
+        _working_size = Size(max(cvRound(full_size.width*_scale), 1), max(cvRound(full_size.height*_scale), 1));
+    }
+}
+
+
+// Frame at the working resolution, in a buffer reused across frames
+const Mat& WorkingResolution::to_working(const Mat& frame) {
+
+    if(_scale >= 1){
+        return frame;
+    }
+    resize(frame, _frame, Size(), _scale, _scale, INTER_AREA);
+    return _frame;
+}
+
+
+/* Box in working resolution coordinates
+* The corner is floored and the size rounded, so the box can reach one pixel past the
+* resized frame; it is clamped to the working frame and kept at least 1x1
+*/
+Rect WorkingResolution::to_working(Rect box) const {
+
+    if(_scale >= 1){
+        return box;
+    }
+    int x = min(max(cvFloor(box.x*_scale), 0), _working_size.width - 1);
+    int y = min(max(cvFloor(box.y*_scale), 0), _working_size.height - 1);
+    int width = min(max(cvRound(box.width*_scale), 1), _working_size.width - x);
+    int height = min(max(cvRound(box.height*_scale), 1), _working_size.height - y);
+    return Rect(x, y, width, height);
+}
+
+
+// Box mapped back to full resolution and clipped to the full frame
+Rect WorkingResolution::to_full(Rect box) const {
+
+    if(_scale >= 1){
+        return box;
+    }
+    Rect full(cvRound(box.x/_scale), cvRound(box.y/_scale), cvRound(box.width/_scale), cvRound(box.height/_scale));
+    return full & Rect(Point(0, 0), _full_size);
+}
+
+
+double WorkingResolution::scale() const {
+    return _scale;
+}
@@ -0,0 +1,79 @@
+#include "CpuFeatures.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+
+// CPUID based detection; non x86 builds only have the scalar kernels
+simd_level detected_simd_level(){
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")){
+        return SIMD_AVX512;
+    }
+    if(__builtin_cpu_supports("avx2")){
+        return SIMD_AVX2;
+    }
+    if(__builtin_cpu_supports("sse2")){
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+
+const char* simd_level_name(simd_level level){
+
+    switch(level){
+        case SIMD_SSE2: return "sse2";
+        case SIMD_AVX2: return "avx2";
+        case SIMD_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+
+/* Startup level
+* Reads TRACKER_SIMD once; unknown names are ignored and levels the CPU
+* does not support are clamped to the detected one
+*/
+static simd_level _initial_simd_level(){
+
+    simd_level detected = detected_simd_level();
+    const char* forced = getenv("TRACKER_SIMD");
+    if(forced == NULL){
+        return detected;
+    }
+
+    for(int level = SIMD_SCALAR; level <= SIMD_AVX512; level++){
+        if(strcmp(forced, simd_level_name((simd_level)level)) == 0){
+            if(level > detected){
+                cerr << "TRACKER_SIMD=" << forced << " is not supported by this CPU, using " << simd_level_name(detected) << endl;
+                return detected;
+            }
+            return (simd_level)level;
+        }
+    }
+    cerr << "Unknown TRACKER_SIMD=" << forced << ", using " << simd_level_name(detected) << endl;
+    return detected;
+}
+
+
+static simd_level& _current_simd_level(){
+    static simd_level level = _initial_simd_level();
+    return level;
+}
+
+
+simd_level active_simd_level(){
+    return _current_simd_level();
+}
+
+
+void set_simd_level(simd_level level){
+    simd_level detected = detected_simd_level();
+    _current_simd_level() = level > detected ? detected : level;
+}
@@ -0,0 +1,25 @@
+#ifndef CPUFEATURES_HPP_
+#define CPUFEATURES_HPP_
+
+// Instruction set levels of the dispatched kernels, from lowest to highest
+enum simd_level {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+// Highest level supported by this CPU (CPUID)
+simd_level detected_simd_level();
+
+// Level used by the kernels: the detected one, or the one forced with the
+// TRACKER_SIMD environment variable (scalar, sse2, avx2, avx512)
+simd_level active_simd_level();
+
+// Forces a level at runtime; levels above the detected one are clamped
+void set_simd_level(simd_level level);
+
+const char* simd_level_name(simd_level level);
+
+
+#endif /* CPUFEATURES_HPP_ */
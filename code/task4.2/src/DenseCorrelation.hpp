@@ -0,0 +1,44 @@
+#ifndef DENSECORRELATION_HPP_
+#define DENSECORRELATION_HPP_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+/* Dense template matching by FFT
+* Scores every placement of a multi-channel template inside a search window at once.
+* The sum of squared differences is expanded as
+*     SSD(u) = sum F(x+u)^2 - 2 sum F(x+u)*T(x) + sum T(x)^2
+* The cross-correlation term is one forward DFT per channel multiplied by the cached
+* template spectrum, summed over channels, and a single inverse DFT. The window energy
+* term is read from an integral image.
+*/
+class DenseMatcher {
+    private:
+        // variables
+        cv::Size _dft_size;
+        cv::Size _templ_size;
+        std::vector<cv::Mat> _templ_spectra;
+        double _templ_energy;
+
+        // buffers reused across frames
+        cv::Mat _padded;
+        cv::Mat _spectrum;
+        cv::Mat _product;
+        cv::Mat _accumulated;
+        cv::Mat _correlation;
+        cv::Mat _energy;
+        cv::Mat _energy_integral;
+
+    public:
+        // Constructor
+        DenseMatcher();
+
+        // functions
+        void set_template(const std::vector<cv::Mat>& templ, cv::Size max_window);
+        void match(const std::vector<cv::Mat>& window, cv::Mat& ssd);
+        bool empty() const;
+};
+
+
+#endif /* DENSECORRELATION_HPP_ */
@@ -0,0 +1,1010 @@
+#include "HistogramKernels.hpp"
+#include "CpuFeatures.hpp"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+// fp-contract is disabled so the floating point kernels are never fused into FMAs
+// and every level rounds exactly like the scalar reference
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+using namespace std;
+using namespace cv;
+
+// Floating point reductions accumulate element i into lane i%8 and add the lanes
+// in a fixed order, so every instruction set level gives bit identical results
+const int REDUCTION_LANES = 8;
+
+
+/* Bin lookup table
+* Maps every 8 bit value to its histogram bin following the uniform binning of calcHist
+* Values outside [lower, upper) are marked as HIST_OUT_OF_RANGE
+*/
+void build_bin_lut(int bins, float lower, float upper, uchar* lut){
+
+    CV_Assert(bins > 0 && bins < HIST_OUT_OF_RANGE);
+    double a = bins/(double)(upper - lower);
+    double b = -lower*a;
+
+    for(int v = 0; v < 256; v++){
+        int idx = cvFloor(v*a + b);
+        lut[v] = ((unsigned)idx < (unsigned)bins) ? (uchar)idx : HIST_OUT_OF_RANGE;
+    }
+}
+
+
+/* Affine form of a bin lookup table
+* Finds mul and limit such that lut[v] == (v*mul) >> 16 for v < limit and
+* lut[v] == HIST_OUT_OF_RANGE for v >= limit, which lets SIMD code quantize
+* with a 16 bit multiply instead of a table lookup. The match is verified on
+* all 256 values, so the result is always identical to the table.
+*/
+static bool _affine_from_lut(const uchar* lut, int* mul, int* limit){
+
+    int lim = 256;
+    while(lim > 0 && lut[lim-1] == HIST_OUT_OF_RANGE){
+        lim--;
+    }
+    if(lim < 2){
+        return false;
+    }
+
+    int estimate = (int)ceil(65536.0*(lut[lim-1] + 1)/lim);
+    for(int m = max(estimate - 2, 1); m <= min(estimate + 2, 65535); m++){
+        bool match = true;
+        for(int v = 0; v < lim && match; v++){
+            match = ((v*m) >> 16) == lut[v];
+        }
+        if(match){
+            *mul = m;
+            *limit = lim;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void _quantize_row_scalar(const uchar* src, uchar* dst, int n, const uchar* lut, int mul, int limit){
+    for(int x = 0; x < n; x++){
+        dst[x] = lut[src[x]];
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+SIMD_TARGET("sse2")
+static void _quantize_row_sse2(const uchar* src, uchar* dst, int n, const uchar* lut, int mul, int limit){
+
+    __m128i vmul = _mm_set1_epi16((short)mul);
+    __m128i vlimit = _mm_set1_epi8((char)min(limit, 255));
+    __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for(; x <= n - 16; x += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(v, zero), vmul);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(v, zero), vmul);
+        __m128i idx = _mm_packus_epi16(lo, hi);
+        if(limit < 256){
+            idx = _mm_or_si128(idx, _mm_cmpeq_epi8(_mm_max_epu8(v, vlimit), v));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), idx);
+    }
+    _quantize_row_scalar(src + x, dst + x, n - x, lut, mul, limit);
+}
+
+SIMD_TARGET("avx2")
+static void _quantize_row_avx2(const uchar* src, uchar* dst, int n, const uchar* lut, int mul, int limit){
+
+    __m256i vmul = _mm256_set1_epi16((short)mul);
+    __m256i vlimit = _mm256_set1_epi8((char)min(limit, 255));
+    __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for(; x <= n - 32; x += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + x));
+        // unpack and pack work per 128 bit lane, so the byte order is preserved
+        __m256i lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(v, zero), vmul);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(v, zero), vmul);
+        __m256i idx = _mm256_packus_epi16(lo, hi);
+        if(limit < 256){
+            idx = _mm256_or_si256(idx, _mm256_cmpeq_epi8(_mm256_max_epu8(v, vlimit), v));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), idx);
+    }
+    _mm256_zeroupper();
+    _quantize_row_sse2(src + x, dst + x, n - x, lut, mul, limit);
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static void _quantize_row_avx512(const uchar* src, uchar* dst, int n, const uchar* lut, int mul, int limit){
+
+    __m512i vmul = _mm512_set1_epi16((short)mul);
+    __m512i vlimit = _mm512_set1_epi8((char)min(limit, 255));
+    __m512i zero = _mm512_setzero_si512();
+    int x = 0;
+    for(; x <= n - 64; x += 64){
+        __m512i v = _mm512_loadu_si512((const void*)(src + x));
+        __m512i lo = _mm512_mulhi_epu16(_mm512_unpacklo_epi8(v, zero), vmul);
+        __m512i hi = _mm512_mulhi_epu16(_mm512_unpackhi_epi8(v, zero), vmul);
+        __m512i idx = _mm512_packus_epi16(lo, hi);
+        if(limit < 256){
+            __mmask64 out = _mm512_cmpge_epu8_mask(v, vlimit);
+            idx = _mm512_mask_blend_epi8(out, idx, _mm512_set1_epi8((char)HIST_OUT_OF_RANGE));
+        }
+        _mm512_storeu_si512((void*)(dst + x), idx);
+    }
+    _mm256_zeroupper();
+    _quantize_row_avx2(src + x, dst + x, n - x, lut, mul, limit);
+}
+#endif
+
+
+/* Quantization
+* Maps the pixels of plane inside roi to their bin index through lut
+* bin_plane keeps the size of plane, so candidate boxes index both with the same coordinates
+* SIMD levels use the affine form of lut when it exists and the table otherwise
+*/
+void quantize_plane(const Mat& plane, Rect roi, const uchar* lut, Mat& bin_plane){
+
+    bin_plane.create(plane.rows, plane.cols, CV_8U);
+
+    int mul = 0, limit = 256;
+    void (*quantize_row)(const uchar*, uchar*, int, const uchar*, int, int) = _quantize_row_scalar;
+#ifdef SIMD_KERNELS_X86
+    if(_affine_from_lut(lut, &mul, &limit)){
+        switch(active_simd_level()){
+            case SIMD_AVX512: quantize_row = _quantize_row_avx512; break;
+            case SIMD_AVX2: quantize_row = _quantize_row_avx2; break;
+            case SIMD_SSE2: quantize_row = _quantize_row_sse2; break;
+            default: break;
+        }
+    }
+#endif
+
+    for(int y = roi.y; y < roi.y + roi.height; y++){
+        quantize_row(plane.ptr<uchar>(y) + roi.x, bin_plane.ptr<uchar>(y) + roi.x, roi.width, lut, mul, limit);
+    }
+}
+
+
+// Counts 8 bin indices packed in v, byte j going to sub-histogram j%4
+static inline void _count8(uint64_t v, uint16_t (*sub)[256]){
+    sub[0][v & 0xff]++;
+    sub[1][(v >> 8) & 0xff]++;
+    sub[2][(v >> 16) & 0xff]++;
+    sub[3][(v >> 24) & 0xff]++;
+    sub[0][(v >> 32) & 0xff]++;
+    sub[1][(v >> 40) & 0xff]++;
+    sub[2][(v >> 48) & 0xff]++;
+    sub[3][v >> 56]++;
+}
+
+// Adds a run of n equal indices (n multiple of 4) keeping the one count per 4 pixels bound
+static inline void _count_run(uchar bin, int n, uint16_t (*sub)[256]){
+    for(int k = 0; k < 4; k++){
+        sub[k][bin] += n/4;
+    }
+}
+
+static void _count_row_scalar(const uchar* row, int width, uint16_t (*sub)[256]){
+
+    int x = 0;
+    for(; x <= width - 8; x += 8){
+        uint64_t v;
+        memcpy(&v, row + x, 8);
+        _count8(v, sub);
+    }
+    for(; x < width; x++){
+        sub[x & 3][row[x]]++;
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+// The SIMD row counters load a whole register, add uniform runs in one step and
+// otherwise count the register 8 indices at a time like the scalar code. The wider
+// levels clear the upper register halves before handing the tail to the narrower one,
+// whose SSE code would otherwise stall on the dirty AVX state
+SIMD_TARGET("sse2")
+static void _count_row_sse2(const uchar* row, int width, uint16_t (*sub)[256]){
+
+    int x = 0;
+    for(; x <= width - 16; x += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)row[x]))) == 0xffff){
+            _count_run(row[x], 16, sub);
+            continue;
+        }
+        _count8((uint64_t)_mm_cvtsi128_si64(v), sub);
+        _count8((uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)), sub);
+    }
+    _count_row_scalar(row + x, width - x, sub);
+}
+
+SIMD_TARGET("avx2")
+static void _count_row_avx2(const uchar* row, int width, uint16_t (*sub)[256]){
+
+    int x = 0;
+    for(; x <= width - 32; x += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + x));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)row[x]))) == -1){
+            _count_run(row[x], 32, sub);
+            continue;
+        }
+        uint64_t q[4];
+        _mm256_storeu_si256((__m256i*)q, v);
+        for(int k = 0; k < 4; k++){
+            _count8(q[k], sub);
+        }
+    }
+    _mm256_zeroupper();
+    _count_row_sse2(row + x, width - x, sub);
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static void _count_row_avx512(const uchar* row, int width, uint16_t (*sub)[256]){
+
+    int x = 0;
+    for(; x <= width - 64; x += 64){
+        __m512i v = _mm512_loadu_si512((const void*)(row + x));
+        if(_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8((char)row[x])) == ~(__mmask64)0){
+            _count_run(row[x], 64, sub);
+            continue;
+        }
+        uint64_t q[8];
+        _mm512_storeu_si512((void*)q, v);
+        for(int k = 0; k < 8; k++){
+            _count8(q[k], sub);
+        }
+    }
+    _mm256_zeroupper();
+    _count_row_avx2(row + x, width - x, sub);
+}
+#endif
+
+
+/* Histogram of a region
+* Counts bin indices with four interleaved 16 bit sub-histograms: neighbouring pixels
+* update different counters, so runs of the same bin (uniform regions) do not stall
+* on the previous increment. Sub-histograms are merged into 32 bit totals before any
+* counter can overflow and once more at the end.
+* Pixels marked HIST_OUT_OF_RANGE land in a bin that is never merged.
+*/
+void bin_histogram(const Mat& bin_plane, Rect roi, int bins, float* hist){
+
+    uint16_t sub[4][256];
+    uint32_t total[256];
+    memset(total, 0, bins*sizeof(uint32_t));
+
+    void (*count_row)(const uchar*, int, uint16_t (*)[256]) = _count_row_scalar;
+#ifdef SIMD_KERNELS_X86
+    switch(active_simd_level()){
+        case SIMD_AVX512: count_row = _count_row_avx512; break;
+        case SIMD_AVX2: count_row = _count_row_avx2; break;
+        case SIMD_SSE2: count_row = _count_row_sse2; break;
+        default: break;
+    }
+#endif
+
+    // Each sub-histogram receives at most one count per 4 pixels of a row
+    int per_row = (roi.width + 3)/4;
+    int rows_per_flush = max(65535/max(per_row, 1), 1);
+
+    for(int y0 = roi.y; y0 < roi.y + roi.height; y0 += rows_per_flush){
+
+        for(int k = 0; k < 4; k++){
+            memset(sub[k], 0, bins*sizeof(uint16_t));
+            sub[k][HIST_OUT_OF_RANGE] = 0;
+        }
+
+        int y1 = min(y0 + rows_per_flush, roi.y + roi.height);
+        for(int y = y0; y < y1; y++){
+            count_row(bin_plane.ptr<uchar>(y) + roi.x, roi.width, sub);
+        }
+
+        for(int i = 0; i < bins; i++){
+            total[i] += (uint32_t)sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
+        }
+    }
+
+    for(int i = 0; i < bins; i++){
+        hist[i] = (float)total[i];
+    }
+}
+
+
+/* Epanechnikov weights
+* Pixel centers are measured from the box center in units of the half sizes, so the profile
+* reaches 0 on the ellipse inscribed in the box and the corners get no weight at all
+*/
+void epanechnikov_weights(Size box, float* weights){
+
+    float hx = 0.5f*box.width;
+    float hy = 0.5f*box.height;
+    for(int y = 0; y < box.height; y++){
+        float v = (y + 0.5f - hy)/hy;
+        for(int x = 0; x < box.width; x++){
+            float u = (x + 0.5f - hx)/hx;
+            weights[y*box.width + x] = max(1.f - u*u - v*v, 0.f);
+        }
+    }
+}
+
+
+// Adds the weights of 4 consecutive pixels, pixel j going to sub-histogram j (sub is bin-major)
+static inline void _weigh4(const uchar* row, const float* w, float (*sub)[4]){
+    sub[row[0]][0] += w[0];
+    sub[row[1]][1] += w[1];
+    sub[row[2]][2] += w[2];
+    sub[row[3]][3] += w[3];
+}
+
+static void _weigh_row_scalar(const uchar* row, const float* w, int width, float (*sub)[4]){
+
+    int x = 0;
+    for(; x <= width - 4; x += 4){
+        _weigh4(row + x, w + x, sub);
+    }
+    for(; x < width; x++){
+        sub[row[x]][0] += w[x];
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+// The four sub-histograms of a bin are one 128 bit vector, so a uniform run adds its weights
+// 4 at a time in the order of the scalar code; mixed registers are weighed 4 pixels at a time.
+// The wider levels clear the upper register halves before handing the tail to the narrower one
+SIMD_TARGET("sse2")
+static inline void _weigh_run_sse2(uchar bin, const float* w, int n, float (*sub)[4]){
+    __m128 acc = _mm_loadu_ps(sub[bin]);
+    for(int x = 0; x < n; x += 4){
+        acc = _mm_add_ps(acc, _mm_loadu_ps(w + x));
+    }
+    _mm_storeu_ps(sub[bin], acc);
+}
+
+SIMD_TARGET("sse2")
+static void _weigh_row_sse2(const uchar* row, const float* w, int width, float (*sub)[4]){
+
+    int x = 0;
+    for(; x <= width - 16; x += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)row[x]))) == 0xffff){
+            _weigh_run_sse2(row[x], w + x, 16, sub);
+            continue;
+        }
+        for(int k = 0; k < 16; k += 4){
+            _weigh4(row + x + k, w + x + k, sub);
+        }
+    }
+    _weigh_row_scalar(row + x, w + x, width - x, sub);
+}
+
+SIMD_TARGET("avx2")
+static void _weigh_row_avx2(const uchar* row, const float* w, int width, float (*sub)[4]){
+
+    int x = 0;
+    for(; x <= width - 32; x += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + x));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)row[x]))) == -1){
+            _weigh_run_sse2(row[x], w + x, 32, sub);
+            continue;
+        }
+        for(int k = 0; k < 32; k += 4){
+            _weigh4(row + x + k, w + x + k, sub);
+        }
+    }
+    _mm256_zeroupper();
+    _weigh_row_sse2(row + x, w + x, width - x, sub);
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static void _weigh_row_avx512(const uchar* row, const float* w, int width, float (*sub)[4]){
+
+    int x = 0;
+    for(; x <= width - 64; x += 64){
+        __m512i v = _mm512_loadu_si512((const void*)(row + x));
+        if(_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8((char)row[x])) == ~(__mmask64)0){
+            _weigh_run_sse2(row[x], w + x, 64, sub);
+            continue;
+        }
+        for(int k = 0; k < 64; k += 4){
+            _weigh4(row + x + k, w + x + k, sub);
+        }
+    }
+    _mm256_zeroupper();
+    _weigh_row_avx2(row + x, w + x, width - x, sub);
+}
+#endif
+
+
+/* Weighted histogram
+* Same layout as bin_histogram: consecutive pixels add to four interleaved float
+* sub-histograms, so runs of one colour do not serialize on a single accumulator, and the
+* loop stays branch-free (pixels outside the kernel add 0, out of range pixels go to the
+* HIST_OUT_OF_RANGE slot). The sub-histograms are stored bin-major, so the SIMD levels add
+* a uniform run (one bin over a whole register) with vector adds, in the same per-lane
+* order as the scalar code: every level gives bit identical histograms.
+*/
+void weighted_bin_histogram(const Mat& bin_plane, Rect roi, int bins, const float* weights, float* hist){
+
+    float sub[256][4];
+    memset(sub, 0, bins*sizeof(sub[0]));
+    memset(sub[HIST_OUT_OF_RANGE], 0, sizeof(sub[0]));
+
+    void (*weigh_row)(const uchar*, const float*, int, float (*)[4]) = _weigh_row_scalar;
+#ifdef SIMD_KERNELS_X86
+    switch(active_simd_level()){
+        case SIMD_AVX512: weigh_row = _weigh_row_avx512; break;
+        case SIMD_AVX2: weigh_row = _weigh_row_avx2; break;
+        case SIMD_SSE2: weigh_row = _weigh_row_sse2; break;
+        default: break;
+    }
+#endif
+
+    for(int y = 0; y < roi.height; y++){
+        weigh_row(bin_plane.ptr<uchar>(roi.y + y) + roi.x, weights + y*roi.width, roi.width, sub);
+    }
+
+    for(int i = 0; i < bins; i++){
+        hist[i] = (sub[i][0] + sub[i][1]) + (sub[i][2] + sub[i][3]);
+    }
+}
+
+
+/* Integral histogram
+* Row y+1, column x+1 of integral holds the bins*1 counts of the window pixels above and
+* left of (x, y), stored contiguously per column. Built in one pass from a running row
+* histogram, so any box inside the window, of any size, costs 4*bins reads.
+*/
+void integral_histogram(const Mat& bin_plane, Rect window, int bins, Mat& integral){
+
+    int row_counts[256];
+    integral.create(window.height + 1, (window.width + 1)*bins, CV_32S);
+    memset(integral.ptr<int>(0), 0, integral.cols*sizeof(int));
+
+    for(int y = 0; y < window.height; y++){
+        const uchar* bin_row = bin_plane.ptr<uchar>(window.y + y) + window.x;
+        const int* above = integral.ptr<int>(y);
+        int* row = integral.ptr<int>(y + 1);
+
+        memset(row_counts, 0, bins*sizeof(int));
+        memset(row, 0, bins*sizeof(int));
+        for(int x = 0; x < window.width; x++){
+            if(bin_row[x] < bins){
+                row_counts[bin_row[x]]++;
+            }
+            const int* up = above + (x + 1)*bins;
+            int* dst = row + (x + 1)*bins;
+            for(int b = 0; b < bins; b++){
+                dst[b] = up[b] + row_counts[b];
+            }
+        }
+    }
+}
+
+
+// (rows+1)*(cols+1)*bins counts of 4 bytes, so it grows with the area of the search window
+size_t integral_histogram_bytes(Size window, int bins){
+
+    return (size_t)(window.width + 1)*(window.height + 1)*bins*sizeof(int);
+}
+
+
+// Histogram of box, given relative to the window of the integral histogram
+void integral_histogram_box(const Mat& integral, Rect box, int bins, float* hist){
+
+    const int* top = integral.ptr<int>(box.y);
+    const int* bottom = integral.ptr<int>(box.y + box.height);
+    int left = box.x*bins;
+    int right = (box.x + box.width)*bins;
+
+    for(int b = 0; b < bins; b++){
+        hist[b] = (float)(bottom[right + b] - bottom[left + b] - top[right + b] + top[left + b]);
+    }
+}
+
+
+// Adds sign to the count of every in-range pixel of region
+static void _add_region(const Mat& bin_plane, Rect region, int bins, float sign, float* hist){
+
+    for(int y = region.y; y < region.y + region.height; y++){
+        const uchar* bin_row = bin_plane.ptr<uchar>(y) + region.x;
+        for(int x = 0; x < region.width; x++){
+            if(bin_row[x] < bins){
+                hist[bin_row[x]] += sign;
+            }
+        }
+    }
+}
+
+
+/* Sliding histogram
+* Turns the counts of box from into those of box to (same size) by moving first along x,
+* removing the leaving column strip and adding the entering one, then along y with row
+* strips. Costs h*|dx| + w*|dy| pixels instead of w*h
+*/
+void slide_histogram(const Mat& bin_plane, Rect from, Rect to, int bins, float* hist){
+
+    CV_Assert(from.width == to.width && from.height == to.height);
+
+    int w = from.width, h = from.height;
+    int dx = to.x - from.x, dy = to.y - from.y;
+
+    if(dx != 0){
+        int strip = min(abs(dx), w);
+        int leaving = dx > 0 ? from.x : from.x + w - strip;
+        int entering = dx > 0 ? to.x + w - strip : to.x;
+        _add_region(bin_plane, Rect(leaving, from.y, strip, h), bins, -1, hist);
+        _add_region(bin_plane, Rect(entering, from.y, strip, h), bins, 1, hist);
+    }
+    if(dy != 0){
+        int strip = min(abs(dy), h);
+        int leaving = dy > 0 ? from.y : from.y + h - strip;
+        int entering = dy > 0 ? to.y + h - strip : to.y;
+        _add_region(bin_plane, Rect(to.x, leaving, w, strip), bins, -1, hist);
+        _add_region(bin_plane, Rect(to.x, entering, w, strip), bins, 1, hist);
+    }
+}
+
+
+/* Sampling stride
+* Smallest lattice stride that keeps a box of this size at or below max_samples pixels.
+* max_samples <= 0 means every pixel (stride 1)
+*/
+int sample_stride(Size box, int max_samples){
+
+    if(max_samples <= 0 || box.area() <= max_samples){
+        return 1;
+    }
+    int stride = max(cvFloor(sqrt(box.area()/(double)max_samples)), 1);
+    while(((box.width + stride - 1)/stride)*((box.height + stride - 1)/stride) > max_samples){
+        stride++;
+    }
+    return stride;
+}
+
+
+/* Subsampled histogram
+* Counts one pixel per stride x stride cell of roi, the one at the cell's centre (clamped
+* to roi for the last partial cell), so the lattice is fixed relative to the box and the
+* same box always gets the same histogram. With stride 1 it equals bin_histogram
+*/
+void sampled_bin_histogram(const Mat& bin_plane, Rect roi, int bins, int stride, float* hist){
+
+    if(stride <= 1){
+        bin_histogram(bin_plane, roi, bins, hist);
+        return;
+    }
+
+    uint32_t total[256];
+    memset(total, 0, 256*sizeof(uint32_t));
+
+    int phase = stride/2;
+    for(int y = 0; y < roi.height; y += stride){
+        const uchar* bin_row = bin_plane.ptr<uchar>(roi.y + min(y + phase, roi.height - 1)) + roi.x;
+        for(int x = 0; x < roi.width; x += stride){
+            total[bin_row[min(x + phase, roi.width - 1)]]++;
+        }
+    }
+
+    for(int i = 0; i < bins; i++){
+        hist[i] = (float)total[i];
+    }
+}
+
+
+/* Min-max normalization
+* Same result as normalize(hist, hist, lower, upper, NORM_MINMAX)
+*/
+void normalize_histogram(float* hist, int bins, float lower, float upper){
+
+    float hmin = hist[0], hmax = hist[0];
+    for(int i = 1; i < bins; i++){
+        hmin = min(hmin, hist[i]);
+        hmax = max(hmax, hist[i]);
+    }
+
+    double scale = (hmax - hmin) > DBL_EPSILON ? (upper - lower)/(double)(hmax - hmin) : 0;
+    double shift = lower - hmin*scale;
+    for(int i = 0; i < bins; i++){
+        hist[i] = (float)(hist[i]*scale + shift);
+    }
+}
+
+
+// Adds the reduction lanes in a fixed order
+static inline double _sum_lanes(const double* lanes){
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+
+/* Bhattacharyya lane sums
+* Accumulates sqrt(h1*h2), h1 and h2 in REDUCTION_LANES partial sums
+* The SIMD versions handle whole groups of 8 bins and leave the tail to the scalar loop
+*/
+static void _bhattacharyya_tail(const float* h1, const float* h2, int start, int bins, double* r, double* s1, double* s2){
+    for(int i = start; i < bins; i++){
+        r[i % REDUCTION_LANES] += sqrt((double)h1[i]*h2[i]);
+        s1[i % REDUCTION_LANES] += h1[i];
+        s2[i % REDUCTION_LANES] += h2[i];
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+SIMD_TARGET("sse2")
+static int _bhattacharyya_sse2(const float* h1, const float* h2, int bins, double* r, double* s1, double* s2){
+
+    __m128d vr[4], va[4], vb[4];
+    for(int k = 0; k < 4; k++){
+        vr[k] = va[k] = vb[k] = _mm_setzero_pd();
+    }
+    int i = 0;
+    for(; i <= bins - 8; i += 8){
+        for(int k = 0; k < 4; k += 2){
+            __m128 fa = _mm_loadu_ps(h1 + i + 2*k);
+            __m128 fb = _mm_loadu_ps(h2 + i + 2*k);
+            __m128d a[2] = { _mm_cvtps_pd(fa), _mm_cvtps_pd(_mm_movehl_ps(fa, fa)) };
+            __m128d b[2] = { _mm_cvtps_pd(fb), _mm_cvtps_pd(_mm_movehl_ps(fb, fb)) };
+            for(int j = 0; j < 2; j++){
+                vr[k+j] = _mm_add_pd(vr[k+j], _mm_sqrt_pd(_mm_mul_pd(a[j], b[j])));
+                va[k+j] = _mm_add_pd(va[k+j], a[j]);
+                vb[k+j] = _mm_add_pd(vb[k+j], b[j]);
+            }
+        }
+    }
+    for(int k = 0; k < 4; k++){
+        _mm_storeu_pd(r + 2*k, vr[k]);
+        _mm_storeu_pd(s1 + 2*k, va[k]);
+        _mm_storeu_pd(s2 + 2*k, vb[k]);
+    }
+    return i;
+}
+
+SIMD_TARGET("avx2")
+static int _bhattacharyya_avx2(const float* h1, const float* h2, int bins, double* r, double* s1, double* s2){
+
+    __m256d vr[2], va[2], vb[2];
+    for(int k = 0; k < 2; k++){
+        vr[k] = va[k] = vb[k] = _mm256_setzero_pd();
+    }
+    int i = 0;
+    for(; i <= bins - 8; i += 8){
+        for(int k = 0; k < 2; k++){
+            __m256d a = _mm256_cvtps_pd(_mm_loadu_ps(h1 + i + 4*k));
+            __m256d b = _mm256_cvtps_pd(_mm_loadu_ps(h2 + i + 4*k));
+            vr[k] = _mm256_add_pd(vr[k], _mm256_sqrt_pd(_mm256_mul_pd(a, b)));
+            va[k] = _mm256_add_pd(va[k], a);
+            vb[k] = _mm256_add_pd(vb[k], b);
+        }
+    }
+    for(int k = 0; k < 2; k++){
+        _mm256_storeu_pd(r + 4*k, vr[k]);
+        _mm256_storeu_pd(s1 + 4*k, va[k]);
+        _mm256_storeu_pd(s2 + 4*k, vb[k]);
+    }
+    return i;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static int _bhattacharyya_avx512(const float* h1, const float* h2, int bins, double* r, double* s1, double* s2){
+
+    __m512d vr = _mm512_setzero_pd(), va = _mm512_setzero_pd(), vb = _mm512_setzero_pd();
+    int i = 0;
+    for(; i <= bins - 8; i += 8){
+        __m512d a = _mm512_cvtps_pd(_mm256_loadu_ps(h1 + i));
+        __m512d b = _mm512_cvtps_pd(_mm256_loadu_ps(h2 + i));
+        vr = _mm512_add_pd(vr, _mm512_sqrt_pd(_mm512_mul_pd(a, b)));
+        va = _mm512_add_pd(va, a);
+        vb = _mm512_add_pd(vb, b);
+    }
+    _mm512_storeu_pd(r, vr);
+    _mm512_storeu_pd(s1, va);
+    _mm512_storeu_pd(s2, vb);
+    return i;
+}
+#endif
+
+
+/* Bhattacharyya distance
+* sqrt(1 - sum(sqrt(h1*h2)) / sqrt(sum(h1)*sum(h2)))
+*/
+double bhattacharyya_distance(const float* h1, const float* h2, int bins){
+
+    double r[REDUCTION_LANES] = {0}, s1[REDUCTION_LANES] = {0}, s2[REDUCTION_LANES] = {0};
+    int done = 0;
+#ifdef SIMD_KERNELS_X86
+    switch(active_simd_level()){
+        case SIMD_AVX512: done = _bhattacharyya_avx512(h1, h2, bins, r, s1, s2); break;
+        case SIMD_AVX2: done = _bhattacharyya_avx2(h1, h2, bins, r, s1, s2); break;
+        case SIMD_SSE2: done = _bhattacharyya_sse2(h1, h2, bins, r, s1, s2); break;
+        default: break;
+    }
+#endif
+    _bhattacharyya_tail(h1, h2, done, bins, r, s1, s2);
+
+    double result = _sum_lanes(r);
+    double norm = _sum_lanes(s1)*_sum_lanes(s2);
+    norm = fabs(norm) > FLT_EPSILON ? 1./sqrt(norm) : 1.;
+    return sqrt(max(1. - result*norm, 0.));
+}
+
+
+/* L2 lane sums
+* Accumulates (a-b)^2 in REDUCTION_LANES partial sums, differences taken in double
+*/
+static void _l2_tail(const float* a, const float* b, int start, int n, double* acc){
+    for(int i = start; i < n; i++){
+        double d = (double)a[i] - b[i];
+        acc[i % REDUCTION_LANES] += d*d;
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+SIMD_TARGET("sse2")
+static int _l2_sse2(const float* a, const float* b, int n, double* acc){
+
+    __m128d vacc[4];
+    for(int k = 0; k < 4; k++){
+        vacc[k] = _mm_loadu_pd(acc + 2*k);
+    }
+    int i = 0;
+    for(; i <= n - 8; i += 8){
+        for(int k = 0; k < 4; k += 2){
+            __m128 fa = _mm_loadu_ps(a + i + 2*k);
+            __m128 fb = _mm_loadu_ps(b + i + 2*k);
+            __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(fa), _mm_cvtps_pd(fb));
+            __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(fa, fa)), _mm_cvtps_pd(_mm_movehl_ps(fb, fb)));
+            vacc[k] = _mm_add_pd(vacc[k], _mm_mul_pd(d0, d0));
+            vacc[k+1] = _mm_add_pd(vacc[k+1], _mm_mul_pd(d1, d1));
+        }
+    }
+    for(int k = 0; k < 4; k++){
+        _mm_storeu_pd(acc + 2*k, vacc[k]);
+    }
+    return i;
+}
+
+SIMD_TARGET("avx2")
+static int _l2_avx2(const float* a, const float* b, int n, double* acc){
+
+    __m256d vacc[2] = { _mm256_loadu_pd(acc), _mm256_loadu_pd(acc + 4) };
+    int i = 0;
+    for(; i <= n - 8; i += 8){
+        for(int k = 0; k < 2; k++){
+            __m256d d = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4*k)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4*k)));
+            vacc[k] = _mm256_add_pd(vacc[k], _mm256_mul_pd(d, d));
+        }
+    }
+    _mm256_storeu_pd(acc, vacc[0]);
+    _mm256_storeu_pd(acc + 4, vacc[1]);
+    return i;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static int _l2_avx512(const float* a, const float* b, int n, double* acc){
+
+    __m512d vacc = _mm512_loadu_pd(acc);
+    int i = 0;
+    for(; i <= n - 8; i += 8){
+        __m512d d = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + i)), _mm512_cvtps_pd(_mm256_loadu_ps(b + i)));
+        vacc = _mm512_add_pd(vacc, _mm512_mul_pd(d, d));
+    }
+    _mm512_storeu_pd(acc, vacc);
+    return i;
+}
+#endif
+
+
+// Lane sums of the L2 kernel selected by active_simd_level(), NULL for scalar
+static int (*_l2_kernel())(const float*, const float*, int, double*){
+#ifdef SIMD_KERNELS_X86
+    switch(active_simd_level()){
+        case SIMD_AVX512: return _l2_avx512;
+        case SIMD_AVX2: return _l2_avx2;
+        case SIMD_SSE2: return _l2_sse2;
+        default: break;
+    }
+#endif
+    return NULL;
+}
+
+
+/* L2 distance
+* Same value as norm(a, b, NORM_L2) up to summation order, used for HOG descriptors
+* The SIMD kernels add to the lanes they are given, element i always goes to lane i%8
+*/
+double l2_distance(const float* a, const float* b, int n){
+
+    double acc[REDUCTION_LANES] = {0};
+    int done = 0;
+    int (*kernel)(const float*, const float*, int, double*) = _l2_kernel();
+    if(kernel){
+        done = kernel(a, b, n, acc);
+    }
+    _l2_tail(a, b, done, n, acc);
+    return sqrt(_sum_lanes(acc));
+}
+
+
+/* Bounded L2 distance
+* Accumulates exactly like l2_distance, in stages of stage_size elements rounded up to a
+* multiple of 8 so every element keeps its lane. After each stage the partial distance is
+* checked and the computation stops once it reaches bound, since the full distance can
+* only be larger. Returns the partial distance (a lower bound) and in *stages how many
+* stages were accumulated; if all of them were, the value equals l2_distance.
+*/
+double l2_distance_bounded(const float* a, const float* b, int n, int stage_size, double bound, int* stages){
+
+    double acc[REDUCTION_LANES] = {0};
+    int stride = max((stage_size + REDUCTION_LANES - 1)/REDUCTION_LANES, 1)*REDUCTION_LANES;
+    int (*kernel)(const float*, const float*, int, double*) = _l2_kernel();
+    int count = 0;
+
+    for(int start = 0; start < n; start += stride){
+        int len = min(stride, n - start);
+        int done = kernel ? kernel(a + start, b + start, len, acc) : 0;
+        _l2_tail(a, b, start + done, start + len, acc);
+        count++;
+
+        double partial = sqrt(_sum_lanes(acc));
+        if(start + len < n && partial >= bound){
+            *stages = count;
+            return partial;
+        }
+    }
+    *stages = count;
+    return sqrt(_sum_lanes(acc));
+}
+
+
+/* Descriptor quantization
+* HOG values are non-negative after L2Hys, so descriptors are stored as uint8 with one scale
+* per model. The scale maps 1.25 times the largest value of the model to 255, leaving some
+* room for candidates with stronger blocks; larger values saturate.
+*/
+float quantization_scale(const float* d, int n){
+
+    float largest = 0;
+    for(int i = 0; i < n; i++){
+        largest = max(largest, d[i]);
+    }
+    return 255.f/max(1.25f*largest, FLT_EPSILON);
+}
+
+
+void quantize_descriptor(const float* d, int n, float scale, uchar* q){
+    for(int i = 0; i < n; i++){
+        q[i] = saturate_cast<uchar>(d[i]*scale);
+    }
+}
+
+
+// Squared differences of uint8 descriptors are summed in 32 bit lanes, which cannot
+// overflow within a chunk of this many elements at any level
+const int U8_CHUNK = 32768;
+
+static int64_t _l2_u8_tail(const uchar* a, const uchar* b, int start, int n){
+    int64_t sum = 0;
+    for(int i = start; i < n; i++){
+        int d = (int)a[i] - b[i];
+        sum += d*d;
+    }
+    return sum;
+}
+
+#ifdef SIMD_KERNELS_X86
+SIMD_TARGET("sse2")
+static int _l2_u8_sse2(const uchar* a, const uchar* b, int n, int64_t* sum){
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    int i = 0;
+    for(; i <= n - 16; i += 16){
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    *sum += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return i;
+}
+
+SIMD_TARGET("avx2")
+static int _l2_u8_avx2(const uchar* a, const uchar* b, int n, int64_t* sum){
+
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for(; i <= n - 32; i += 32){
+        for(int k = 0; k < 32; k += 16){
+            __m256i d = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i + k))),
+                                         _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i + k))));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+        }
+    }
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    for(int k = 0; k < 8; k++){
+        *sum += lanes[k];
+    }
+    return i;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static int _l2_u8_avx512(const uchar* a, const uchar* b, int n, int64_t* sum){
+
+    __m512i acc = _mm512_setzero_si512();
+    int i = 0;
+    for(; i <= n - 64; i += 64){
+        for(int k = 0; k < 64; k += 32){
+            __m512i d = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(a + i + k))),
+                                         _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + i + k))));
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d, d));
+        }
+    }
+    *sum += _mm512_reduce_add_epi32(acc);
+    return i;
+}
+#endif
+
+
+/* Squared L2 of uint8 descriptors
+* Differences are widened to 16 bits and squared and pairwise added by madd. Integer sums
+* do not depend on the order, so every level returns exactly the scalar value.
+*/
+static int64_t _l2_u8_squared(const uchar* a, const uchar* b, int n){
+
+    int64_t sum = 0;
+    for(int start = 0; start < n; start += U8_CHUNK){
+        int len = min(U8_CHUNK, n - start);
+        int done = 0;
+#ifdef SIMD_KERNELS_X86
+        switch(active_simd_level()){
+            case SIMD_AVX512: done = _l2_u8_avx512(a + start, b + start, len, &sum); break;
+            case SIMD_AVX2: done = _l2_u8_avx2(a + start, b + start, len, &sum); break;
+            case SIMD_SSE2: done = _l2_u8_sse2(a + start, b + start, len, &sum); break;
+            default: break;
+        }
+#endif
+        sum += _l2_u8_tail(a, b, start + done, start + len);
+    }
+    return sum;
+}
+
+
+// L2 distance between two quantized descriptors, in quantized units
+double l2_distance_u8(const uchar* a, const uchar* b, int n){
+    return sqrt((double)_l2_u8_squared(a, b, n));
+}
+
+
+/* Bounded L2 distance of quantized descriptors
+* Same staging as l2_distance_bounded with stages of exactly stage_size elements, since the
+* integer sums do not depend on how they are split
+*/
+double l2_distance_u8_bounded(const uchar* a, const uchar* b, int n, int stage_size, double bound, int* stages){
+
+    int64_t sum = 0;
+    int count = 0;
+    stage_size = max(stage_size, 1);
+
+    for(int start = 0; start < n; start += stage_size){
+        int len = min(stage_size, n - start);
+        sum += _l2_u8_squared(a + start, b + start, len);
+        count++;
+
+        double partial = sqrt((double)sum);
+        if(start + len < n && partial >= bound){
+            *stages = count;
+            return partial;
+        }
+    }
+    *stages = count;
+    return sqrt((double)sum);
+}
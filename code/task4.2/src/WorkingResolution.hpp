@@ -0,0 +1,34 @@
+#ifndef WORKINGRESOLUTION_HPP_
+#define WORKINGRESOLUTION_HPP_
+
+#include <opencv2/opencv.hpp>
+
+
+/* Target size normalized working resolution
+* The scale is chosen once per sequence so that the initial box covers about
+* target_pixels pixels. Frames are downscaled to it before tracking and the boxes
+* returned by the tracker are mapped back to full resolution. Targets already
+* smaller than the budget are tracked at full resolution (scale 1), frames are
+* never upscaled.
+*/
+class WorkingResolution {
+    private:
+        // variables
+        double _scale;
+        cv::Size _full_size;
+        cv::Size _working_size;     // size of the frames returned by to_working
+        cv::Mat _frame;
+
+    public:
+        // Constructor
+        WorkingResolution(cv::Rect initial_box, cv::Size full_size, int target_pixels);
+
+        // functions
+        const cv::Mat& to_working(const cv::Mat& frame);
+        cv::Rect to_working(cv::Rect box) const;
+        cv::Rect to_full(cv::Rect box) const;
+        double scale() const;
+};
+
+
+#endif /* WORKINGRESOLUTION_HPP_ */
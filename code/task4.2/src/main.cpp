@@ -18,6 +18,9 @@
 #include <string> 								//For std::to_string function
 #include <opencv2/opencv.hpp>					//opencv libraries
 #include "utils.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
+#include "PoolAllocator.hpp" 					//pooled allocator for frame sized Mats
+#include "CpuFeatures.hpp" 						//instruction set used by the tracker kernels
+#include "WorkingResolution.hpp" 				//target size normalized processing resolution
 #include "ColorTracker.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
 
 //namespaces
@@ -39,6 +42,20 @@ int main(int argc, char ** argv)
 	int bins = 64;
 	int candidate_levels = 3;
 	int candidate_step = 1;
+	double scale_step = 1.0;	// > 1 also tests the box shrunk and grown by this factor (e.g. 1.05)
+	int num_particles = 0;		// > 0 replaces the candidate grid by a particle filter with this many particles
+	double frame_budget_ms = 0;		// > 0 stops the candidate search at this time per frame and keeps the best so far
+	int target_pixels = 0;		// > 0 tracks at a resolution where the initial box covers about this many pixels (e.g. 4096)
+	bool reference_run = true;	// with a reduced resolution or sampled histograms, also tracks at full resolution, every pixel, to report both performances (untimed)
+	double static_threshold = 0;	// > 0 keeps the previous box while no 8x8 block of the search window changes by this mean level (e.g. 4)
+	bool cache_blocks = false;	// reuses the candidate features of the last frame, recomputing only their changed 8x8 blocks
+	bool sliding_histograms = false;	// walks the candidate grid in a snake, updating each histogram from the previous one
+	bool kernel_weights = false;	// weights pixels by an Epanechnikov kernel centred on the box in the colour histograms
+	bool joint_histogram = false;	// one sparse joint histogram of the tracked channels instead of one histogram per channel
+	int max_samples = 0;		// > 0 builds every color histogram from at most this many pixels of the box
+	bool prune_candidates = false;	// abandons a candidate once its partial distance cannot beat the best of the frame
+	double loss_distance = 0;	// > 0 flags the target as lost when the best distance is above it and searches the whole frame
+	double loss_margin = 0.02;	// also lost when a distinct candidate is within this distance of the best
 	vector<bool> track_type;
 	track_type.push_back(false);	// blue
 	track_type.push_back(true);	// green
@@ -46,11 +63,18 @@ int main(int argc, char ** argv)
 	track_type.push_back(false); // h
 	track_type.push_back(false); // s
 	track_type.push_back(false); // gray
+	int score_mode = SCORE_HISTOGRAM;	// SCORE_HISTOGRAM, SCORE_BACKPROJECTION, SCORE_DENSE (needs candidate_step = 1) or SCORE_COLOR_RATIO
 	////////////////////////////////////////////
 
 	int NumSeq = argc-1;
     cout << "Numvideos: " << NumSeq << endl;
 
+	//Frame sized Mats (decoded frames, tracker planes, overlays, encoder buffers) reuse pooled memory.
+	//The pool is never deleted since OpenCV may still release Mats through it after main returns
+	PoolAllocator* frame_pool = new PoolAllocator();
+	Mat::setDefaultAllocator(frame_pool);
+	cout << "Kernel instruction set: " << simd_level_name(active_simd_level()) << endl;
+
 	//PLEASE CHANGE 'dataset_path' & 'output_path' ACCORDING TO YOUR PROJECT
 	//std::string dataset_path = "/home/avsa/avsa/lab4/AVSA_lab4_datasets/datasets";									//dataset location.
 	std::string output_path = "./outvideos/";									//location to save output videos
@@ -103,9 +127,38 @@ int main(int argc, char ** argv)
 		//main loop for the sequence
 		std::cout << "Displaying sequence at " << inputvideo << std::endl;
 		std::cout << "  with groundtruth at " << inputGroundtruth << std::endl;
+
+		//Tracking runs at the working resolution, boxes are mapped back to the full frame
+		WorkingResolution resolution(list_bbox_gt[0], frame_size, target_pixels);
+		std::cout << "  working resolution scale = " << resolution.scale() << std::endl;
 		
 		/////////////////////////////////////////////////////////////////
-		ColorTracker ctracker(list_bbox_gt[0],bins,candidate_levels,candidate_step,track_type);
+		Ptr<ColorTracker> ctracker = makePtr<ColorTracker>(resolution.to_working(list_bbox_gt[0]),bins,candidate_levels,candidate_step,track_type);
+		auto configure = [&](ColorTracker& tracker){
+			tracker.score_mode = score_mode;
+			tracker.scale_step = scale_step;
+			tracker.num_particles = num_particles;
+			tracker.static_threshold = static_threshold;
+			tracker.cache_blocks = cache_blocks;
+			tracker.sliding_histograms = sliding_histograms;
+			tracker.kernel_weights = kernel_weights;
+			tracker.joint_histogram = joint_histogram;
+			tracker.max_samples = max_samples;
+			tracker.prune_candidates = prune_candidates;
+			tracker.loss_distance = loss_distance;
+			tracker.loss_margin = loss_margin;
+		};
+		configure(*ctracker);
+
+		//Reference tracker on the full resolution frames with histograms of every pixel, not timed
+		bool reference = reference_run && (resolution.scale() < 1 || max_samples > 0);
+		Ptr<ColorTracker> rtracker;
+		std::vector<Rect> list_bbox_reference;
+		if(reference){
+			rtracker = makePtr<ColorTracker>(list_bbox_gt[0],bins,candidate_levels,candidate_step,track_type);
+			configure(*rtracker);
+			rtracker->max_samples = 0;
+		}
 
 		for (;;) {
 			//get frame & check if we achieved the end of the videofile (e.g. frame.data is empty)
@@ -123,7 +176,7 @@ int main(int argc, char ** argv)
 
 		    //cout<<"HIIIIIIIIIIIIIIIIIIIIIIII"<<endl;
 
-			list_bbox_est.push_back(ctracker.track(frame));//we use a fixed value only for this demo program. Remove this line when you use your code
+			list_bbox_est.push_back(resolution.to_full(ctracker->track(resolution.to_working(frame), frame_budget_ms)));//we use a fixed value only for this demo program. Remove this line when you use your code
 			//...
 			// ADD YOUR CODE HERE
 			//...
@@ -131,6 +184,9 @@ int main(int argc, char ** argv)
 
 			//Time measurement
 			procTimes.push_back(((double)getTickCount() - t)*1000. / cv::getTickFrequency());
+			if(reference){
+				list_bbox_reference.push_back(rtracker->track(frame));
+			}
 			//std::cout << " processing time=" << procTimes[procTimes.size()-1] << " ms" << std::endl;
 
 			// plot frame number & groundtruth bounding box for each frame
@@ -158,6 +214,44 @@ int main(int argc, char ** argv)
 		//print stats about processing time and tracking performance
 		std::cout << "  Average processing time = " << std::accumulate( procTimes.begin(), procTimes.end(), 0.0) / procTimes.size() << " ms/frame" << std::endl;
 		std::cout << "  Average tracking performance = " << std::accumulate( trackPerf.begin(), trackPerf.end(), 0.0) / trackPerf.size() << std::endl;
+		if(reference){
+			vector<float> referencePerf = estimateTrackingPerformance(list_bbox_gt, list_bbox_reference);
+			std::cout << "  Full resolution, every pixel, tracking performance = " << std::accumulate( referencePerf.begin(), referencePerf.end(), 0.0) / referencePerf.size() << std::endl;
+		}
+		if(max_samples > 0){
+			Rect initial_box = resolution.to_working(list_bbox_gt[0]);
+			int stride = sample_stride(initial_box.size(), max_samples);
+			int sampled = ((initial_box.width + stride - 1)/stride)*((initial_box.height + stride - 1)/stride);
+			std::cout << "  Histogram sampling stride = " << stride << " (" << sampled << " of " << initial_box.area() << " pixels of the initial box)" << std::endl;
+		}
+		pool_stats pstats = frame_pool->stats();
+		std::cout << "  Frame pool hits = " << pstats.hits << ", misses = " << pstats.misses << ", peak = " << pstats.peak_bytes/(1024.*1024.) << " MB" << std::endl;
+		if(joint_histogram){
+			std::cout << "  Joint histogram bins = " << ctracker->get_joint_model().size() << " occupied of " << ctracker->get_joint_model().dense_size() << std::endl;
+		}
+		if(static_threshold > 0){
+			const gate_stats& gstats = ctracker->get_gate_stats();
+			std::cout << "  Static frames skipped = " << gstats.skipped << " of " << gstats.frames << std::endl;
+		}
+		if(cache_blocks){
+			const cache_stats& cstats = ctracker->get_cache_stats();
+			std::cout << "  Cached candidate features = " << cstats.hits << " of " << cstats.lookups << ", changed blocks = " << cstats.dirty_blocks << " of " << cstats.blocks << std::endl;
+		}
+		if(frame_budget_ms > 0){
+			const budget_stats& bstats = ctracker->get_budget_stats();
+			std::cout << "  Candidates evaluated = " << bstats.total_evaluated << " of " << bstats.total_planned << ", budget overruns = " << bstats.overruns << " of " << bstats.frames << " frames (worst +" << bstats.worst_overrun_ms << " ms)" << std::endl;
+		}
+		if(loss_distance > 0){
+			const redetect_stats& rstats = ctracker->get_redetect_stats();
+			std::cout << "  Lost frames = " << rstats.lost_frames << ", re-detections = " << rstats.searches << " (" << rstats.recoveries << " moved the target)" << std::endl;
+		}
+		if(prune_candidates){
+			const prune_stats& prstats = ctracker->get_prune_stats();
+			std::cout << "  Candidates pruned = " << prstats.pruned << " of " << prstats.candidates << ", after channels:";
+			for(size_t k = 0; k < prstats.pruned_at.size(); k++)
+				std::cout << " " << k+1 << ":" << prstats.pruned_at[k];
+			std::cout << std::endl;
+		}
 
 		//release all resources
 		cap.release();			// close inputvideo
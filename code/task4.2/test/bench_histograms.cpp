@@ -0,0 +1,217 @@
+/* Candidate histogram benchmark
+* Times one frame of candidate histograms over a (2*levels+1)^2 grid with each method the
+* colour tracker can use, against calcHist on the candidate ROI and calcHist over a frame
+* sized mask (the original tracker). Patches are uniform (one bin) or noisy (uniform
+* random levels, every bin). The kernel methods include the per frame bin quantization
+* of the search window; calcHist bins the raw plane itself.
+* Every method is checked against calcHist on the same candidates before it is timed, except
+* the sampled histogram and the Epanechnikov weighted one (kernel weighting of mean shift
+* mode), whose counts differ from calcHist by design.
+* Run with TRACKER_SIMD=scalar|sse2|avx2|avx512 to time a given kernel level
+*/
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "SearchBudget.hpp"
+#include "CpuFeatures.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+enum method {
+    CALCHIST_MASK = 0,
+    CALCHIST_ROI,
+    BIN_HISTOGRAM,
+    WEIGHTED_HISTOGRAM,
+    INTEGRAL_HISTOGRAM,
+    SLIDING_HISTOGRAM,
+    SAMPLED_HISTOGRAM,
+    NUM_METHODS
+};
+
+// Keeps the timed results alive
+static volatile double sink = 0;
+
+static const char* method_names[NUM_METHODS] = {
+    "calcHist, frame mask",
+    "calcHist, candidate ROI",
+    "bin_histogram",
+    "weighted_bin_histogram",
+    "integral_histogram",
+    "slide_histogram (snake)",
+    "sampled_bin_histogram (256)"
+};
+
+struct bench_case {
+    Mat plane;
+    Rect box;                   // candidate at offset 0
+    Rect window;                // covers every candidate
+    vector<Point> offsets;
+    vector<Point> snake;
+    int bins;
+    uchar lut[256];
+
+    // buffers
+    Mat bin_plane;
+    Mat integral;
+    Mat mask;
+    Mat hist;
+    vector<float> counts;
+    vector<float> weights;
+};
+
+
+// calcHist of box, through a frame sized mask or on the ROI
+static void calc_hist(bench_case& c, Rect box, bool use_mask) {
+
+    int channels[] = {0};
+    int hist_size[] = {c.bins};
+    float range[] = {0, 256};
+    const float* ranges[] = {range};
+    if(use_mask){
+        c.mask.setTo(Scalar(0));
+        c.mask(box).setTo(Scalar(1));
+        calcHist(&c.plane, 1, channels, c.mask, c.hist, 1, hist_size, ranges);
+    }
+    else{
+        Mat roi = c.plane(box);
+        calcHist(&roi, 1, channels, Mat(), c.hist, 1, hist_size, ranges);
+    }
+}
+
+
+/* One frame of candidate histograms with method m
+* Returns the sum of all counts, so no work can be dropped. With check, every histogram
+* is compared with calcHist on the ROI and the largest count difference is stored
+*/
+static double run_frame(bench_case& c, int m, bool check, double* max_difference) {
+
+    double total = 0;
+    float* hist = c.counts.data();
+    int stride = sample_stride(c.box.size(), 256);
+
+    const vector<Point>& offsets = m == SLIDING_HISTOGRAM ? c.snake : c.offsets;
+    if(m >= BIN_HISTOGRAM){
+        quantize_plane(c.plane, c.window, c.lut, c.bin_plane);
+    }
+    if(m == INTEGRAL_HISTOGRAM){
+        integral_histogram(c.bin_plane, c.window, c.bins, c.integral);
+    }
+
+    Rect previous;
+    for(size_t k = 0; k < offsets.size(); k++){
+        Rect box = c.box + offsets[k];
+        switch(m){
+            case CALCHIST_MASK:
+            case CALCHIST_ROI:
+                calc_hist(c, box, m == CALCHIST_MASK);
+                memcpy(hist, c.hist.ptr<float>(), c.bins*sizeof(float));
+                break;
+            case BIN_HISTOGRAM:
+                bin_histogram(c.bin_plane, box, c.bins, hist);
+                break;
+            case WEIGHTED_HISTOGRAM:
+                weighted_bin_histogram(c.bin_plane, box, c.bins, c.weights.data(), hist);
+                break;
+            case INTEGRAL_HISTOGRAM:
+                integral_histogram_box(c.integral, box - c.window.tl(), c.bins, hist);
+                break;
+            case SLIDING_HISTOGRAM:
+                if(k == 0){
+                    bin_histogram(c.bin_plane, box, c.bins, hist);
+                }
+                else{
+                    slide_histogram(c.bin_plane, previous, box, c.bins, hist);
+                }
+                break;
+            case SAMPLED_HISTOGRAM:
+                sampled_bin_histogram(c.bin_plane, box, c.bins, stride, hist);
+                break;
+        }
+        previous = box;
+
+        for(int b = 0; b < c.bins; b++){
+            total += hist[b];
+        }
+        if(check && m != SAMPLED_HISTOGRAM && m != WEIGHTED_HISTOGRAM){
+            calc_hist(c, box, false);
+            for(int b = 0; b < c.bins; b++){
+                *max_difference = max(*max_difference, (double)fabs(hist[b] - c.hist.at<float>(b)));
+            }
+        }
+    }
+    return total;
+}
+
+
+// Candidate grid of levels around a box in the middle of plane
+static bench_case make_case(const Mat& plane, Size box_size, int levels, int bins) {
+
+    bench_case c;
+    c.plane = plane;
+    c.bins = bins;
+    c.box = Rect((plane.cols - box_size.width)/2, (plane.rows - box_size.height)/2, box_size.width, box_size.height);
+    c.window = Rect(c.box.x - levels, c.box.y - levels, c.box.width + 2*levels, c.box.height + 2*levels);
+    grid_offsets(levels, 1, GRID_RASTER, c.offsets);
+    grid_offsets(levels, 1, c.box.height <= c.box.width ? GRID_SNAKE_ROWS : GRID_SNAKE_COLUMNS, c.snake);
+    build_bin_lut(bins, 0, 256, c.lut);
+    c.bin_plane.create(plane.size(), CV_8U);
+    c.mask.create(plane.size(), CV_8U);
+    c.counts.resize(bins);
+    c.weights.resize(box_size.area());
+    epanechnikov_weights(box_size, c.weights.data());
+    return c;
+}
+
+
+static void bench(const char* patch_name, const Mat& plane, Size box_size, int levels, int bins, int rounds) {
+
+    bench_case c = make_case(plane, box_size, levels, bins);
+    printf("\n%s patch, %dx%d box, %d candidates, %d bins, %dx%d frame\n", patch_name, box_size.width, box_size.height, (int)c.offsets.size(), bins, plane.cols, plane.rows);
+    printf("  %-30s %12s %14s %10s %10s\n", "method", "ms/frame", "us/candidate", "speedup", "max diff");
+
+    double reference_ms = 0;
+    for(int m = 0; m < NUM_METHODS; m++){
+        double difference = 0;
+        run_frame(c, m, true, &difference);
+
+        int64 start = getTickCount();
+        for(int r = 0; r < rounds; r++){
+            sink += run_frame(c, m, false, NULL);
+        }
+        double ms = (getTickCount() - start)*1000./getTickFrequency()/rounds;
+        if(m == CALCHIST_ROI){
+            reference_ms = ms;
+        }
+        printf("  %-30s %12.4f %14.3f %10s %10s\n", method_names[m], ms, ms*1000/c.offsets.size(),
+               m <= CALCHIST_ROI ? "" : format("%.1fx", reference_ms/ms).c_str(),
+               m == SAMPLED_HISTOGRAM || m == WEIGHTED_HISTOGRAM ? "-" : format("%g", difference).c_str());
+    }
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    printf("Kernel instruction set: %s\n", simd_level_name(active_simd_level()));
+    printf("Speedup is against calcHist on the candidate ROI\n");
+
+    Size frame_size(640, 480);
+    Mat uniform(frame_size, CV_8U, Scalar(117));
+    Mat noisy(frame_size, CV_8U);
+    RNG rng(0x5eed);
+    rng.fill(noisy, RNG::UNIFORM, Scalar(0), Scalar(256));
+
+    Size boxes[] = {Size(40, 60), Size(120, 80)};
+    int levels[] = {3, 8};
+    for(int b = 0; b < 2; b++){
+        for(int l = 0; l < 2; l++){
+            bench("uniform", uniform, boxes[b], levels[l], 64, 50);
+            bench("noisy", noisy, boxes[b], levels[l], 64, 50);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* Steady state allocation test
+* Tracks a synthetic sequence and counts every heap allocation (replaced global operator
+* new) and every Mat buffer allocation (counting MatAllocator) made by track() after the
+* first frame. The first frame sizes the model and the frame buffers; every later frame
+* must reuse them, so both counts must be zero.
+* OpenCV runs single threaded here, since its thread pool allocates a job per parallel_for_
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <opencv2/opencv.hpp>
+#include "ColorTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// Heap allocations of the whole process while counting is on
+static long heap_allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if(counting){
+        heap_allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+
+// Standard allocator that counts the Mat buffers it hands out
+class CountingAllocator : public MatAllocator {
+    public:
+        mutable long allocations;
+
+        CountingAllocator() {
+            allocations = 0;
+        }
+
+        UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, UMatUsageFlags usageFlags) const {
+            if(counting){
+                allocations++;
+            }
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        bool allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const {
+            return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+        }
+
+        void deallocate(UMatData* u) const {
+            Mat::getStdAllocator()->deallocate(u);
+        }
+};
+
+
+// Tracks the whole sequence (with a frame budget when budget_ms > 0), counting the allocations of every frame after the first one
+static bool check_tracker(const char* name, ColorTracker& tracker, const synthetic_sequence& sequence, const CountingAllocator& allocator, double budget_ms = 0) {
+
+    long heap = 0, mats = 0;
+    int first_frame = -1;
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        long heap_before = heap_allocations, mats_before = allocator.allocations;
+        counting = f > 0;
+        tracker.track(sequence.frames[f], budget_ms);
+        counting = false;
+        if(first_frame < 0 && (heap_allocations != heap_before || allocator.allocations != mats_before)){
+            first_frame = (int)f + 1;
+        }
+        heap += heap_allocations - heap_before;
+        mats += allocator.allocations - mats_before;
+    }
+
+    bool passed = heap == 0 && mats == 0;
+    printf("%s %s: %ld heap and %ld Mat allocations after frame 1", passed ? "PASS" : "FAIL", name, heap, mats);
+    if(!passed){
+        printf(" (first at frame %d)", first_frame);
+    }
+    printf("\n");
+    return passed;
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    CountingAllocator* allocator = new CountingAllocator();
+    Mat::setDefaultAllocator(allocator);
+
+    synthetic_sequence sequence = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+    Rect box = sequence.boxes[0];
+    bool passed = true;
+
+    // Generic tracker: B, G, R and gray planes split from the frame
+    vector<bool> bgr_gray(6, true);
+    bgr_gray[3] = bgr_gray[4] = false;
+    ColorTracker generic(box, 32, 3, 1, bgr_gray);
+    passed &= check_tracker("generic BGR+gray histograms", generic, sequence, *allocator);
+
+    // H and S planes extracted from the HSV conversion
+    vector<bool> hue_saturation(6, false);
+    hue_saturation[3] = hue_saturation[4] = true;
+    ColorTracker hsv(box, 64, 3, 1, hue_saturation);
+    passed &= check_tracker("generic H+S histograms", hsv, sequence, *allocator);
+
+    // One sparse joint histogram of the B, G and R planes
+    vector<bool> bgr(6, false);
+    bgr[0] = bgr[1] = bgr[2] = true;
+    ColorTracker joint(box, 16, 3, 1, bgr);
+    joint.joint_histogram = true;
+    passed &= check_tracker("joint BGR histogram", joint, sequence, *allocator);
+
+    // Frame budget: candidates in ring order, with a deadline that is never reached
+    ColorTracker budgeted(box, 32, 3, 1, bgr_gray);
+    passed &= check_tracker("budgeted BGR+gray histograms", budgeted, sequence, *allocator, 1000);
+
+    // Block cache: histograms of the last frame corrected over the changed blocks
+    ColorTracker cached(box, 32, 3, 1, bgr_gray);
+    cached.cache_blocks = true;
+    passed &= check_tracker("cached BGR+gray histograms", cached, sequence, *allocator);
+
+    Mat::setDefaultAllocator(NULL);
+    return passed ? 0 : 1;
+}
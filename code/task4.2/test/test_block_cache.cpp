@@ -0,0 +1,77 @@
+/* Block cache test
+* Tracks synthetic sequences (without noise, so most blocks stay unchanged, and with fresh
+* noise on every frame) with the block cache on and off. Cached histograms are exact counts
+* corrected pixel by pixel, so every frame must give the same candidates with bit identical
+* scores. The noise free sequence must also be served from the cache
+*/
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ColorTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, const char* name, int frame, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %s, frame %d: %.17g, expected %.17g\n", what, name, frame, got, expected);
+        }
+    }
+}
+
+
+static void test_cache(const char* name, const synthetic_sequence& sequence, int bins, int levels, int step, const vector<bool>& type, bool expect_hits) {
+
+    ColorTracker cached(sequence.boxes[0], bins, levels, step, type);
+    ColorTracker uncached(sequence.boxes[0], bins, levels, step, type);
+    cached.cache_blocks = true;
+
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        cached.track(sequence.frames[f]);
+        uncached.track(sequence.frames[f]);
+
+        const candidates& got = cached.frame_candidates;
+        const candidates& expected = uncached.frame_candidates;
+        check(got.boxes.size() == expected.boxes.size(), "candidate count", name, (int)f, (double)got.boxes.size(), (double)expected.boxes.size());
+        for(size_t c = 0; c < min(got.boxes.size(), expected.boxes.size()); c++){
+            check(got.boxes[c] == expected.boxes[c], "candidate box", name, (int)f, got.boxes[c].x + got.boxes[c].y/1000., expected.boxes[c].x + expected.boxes[c].y/1000.);
+            check(got.scores[c] == expected.scores[c], "score", name, (int)f, got.scores[c], expected.scores[c]);
+        }
+    }
+
+    const cache_stats& stats = cached.get_cache_stats();
+    if(expect_hits){
+        check(stats.hits > 0, "cache hits", name, (int)sequence.frames.size(), (double)stats.hits, stats.lookups);
+    }
+    printf("%s: %ld of %ld histograms from the cache\n", name, stats.hits, stats.lookups);
+}
+
+
+int main() {
+
+    synthetic_sequence still = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30, 0);
+    synthetic_sequence noisy = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+
+    vector<bool> green(6, false), bgr_gray(6, true), hue_saturation(6, false);
+    green[1] = true;
+    bgr_gray[3] = bgr_gray[4] = false;
+    hue_saturation[3] = hue_saturation[4] = true;
+
+    test_cache("G, no noise", still, 64, 3, 1, green, true);
+    test_cache("B+G+R+gray, no noise", still, 32, 4, 2, bgr_gray, true);
+    test_cache("H+S, no noise", still, 16, 3, 3, hue_saturation, true);
+    test_cache("G, noise", noisy, 64, 3, 1, green, false);
+    test_cache("B+G+R+gray, noise", noisy, 32, 4, 2, bgr_gray, false);
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
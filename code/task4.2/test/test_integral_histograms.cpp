@@ -0,0 +1,92 @@
+/* Integral histogram test
+* Builds integral histograms of windows of a random bin plane (with out of range pixels),
+* placed inside the plane and against its edges, and checks integral_histogram_box of every
+* box of the window (small windows) or of random boxes including the full window (large
+* ones) against bin_histogram of the same box, bit for bit. Also checks that
+* integral_histogram_bytes matches the buffer that is actually built
+*/
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, Rect window, Rect box, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, window %dx%d at (%d, %d), box %dx%d at (%d, %d): %g, expected %g\n", what, window.width, window.height,
+                   window.x, window.y, box.width, box.height, box.x, box.y, got, expected);
+        }
+    }
+}
+
+
+// Compares the histogram of box (relative to window) from the integral histogram with bin_histogram
+static void check_box(const Mat& bin_plane, const Mat& integral, Rect window, Rect box, int bins) {
+
+    vector<float> hist(bins), reference(bins);
+    integral_histogram_box(integral, box, bins, hist.data());
+    bin_histogram(bin_plane, box + window.tl(), bins, reference.data());
+    for(int b = 0; b < bins; b++){
+        check(hist[b] == reference[b], "integral_histogram_box", window, box, hist[b], reference[b]);
+    }
+}
+
+
+int main() {
+
+    RNG rng(0x5eed);
+    Mat plane(120, 160, CV_8U), bin_plane(120, 160, CV_8U);
+    rng.fill(plane, RNG::UNIFORM, Scalar(0), Scalar(256));
+
+    int bin_counts[] = {1, 7, 16, 64};
+    Rect windows[] = {Rect(0, 0, 1, 1), Rect(5, 3, 9, 7), Rect(0, 0, 13, 11), Rect(147, 109, 13, 11),
+                      Rect(37, 21, 80, 60), Rect(0, 0, 160, 120)};
+
+    for(int b = 0; b < 4; b++){
+        int bins = bin_counts[b];
+        uchar lut[256];
+        build_bin_lut(bins, 0, 180, lut);
+        quantize_plane(plane, Rect(0, 0, plane.cols, plane.rows), lut, bin_plane);
+
+        for(int w = 0; w < 6; w++){
+            Rect window = windows[w];
+            Mat integral;
+            integral_histogram(bin_plane, window, bins, integral);
+            check(integral.total()*integral.elemSize() == integral_histogram_bytes(window.size(), bins), "integral_histogram_bytes",
+                  window, Rect(), (double)integral_histogram_bytes(window.size(), bins), (double)(integral.total()*integral.elemSize()));
+
+            if(window.area() <= 13*11){
+                for(int y = 0; y < window.height; y++){
+                    for(int x = 0; x < window.width; x++){
+                        for(int h = 1; y + h <= window.height; h++){
+                            for(int v = 1; x + v <= window.width; v++){
+                                check_box(bin_plane, integral, window, Rect(x, y, v, h), bins);
+                            }
+                        }
+                    }
+                }
+            }
+            else{
+                check_box(bin_plane, integral, window, Rect(0, 0, window.width, window.height), bins);
+                for(int k = 0; k < 500; k++){
+                    int x = rng.uniform(0, window.width), y = rng.uniform(0, window.height);
+                    Rect box(x, y, rng.uniform(1, window.width - x + 1), rng.uniform(1, window.height - y + 1));
+                    check_box(bin_plane, integral, window, box, bins);
+                }
+            }
+        }
+    }
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
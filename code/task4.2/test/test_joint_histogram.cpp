@@ -0,0 +1,167 @@
+/* Joint histogram test
+* Builds a JointModel from random bin planes (with out of range pixels) and compares its
+* sparse distance to candidate boxes with the Bhattacharyya distance between dense joint
+* histograms of the same boxes (bins^planes counts, every bin visited), for two and three
+* planes, with and without Epanechnikov weights, for candidates overlapping the model box,
+* disjoint from it and equal to it. The model must also hold exactly the occupied dense bins
+*/
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "JointHistogram.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, int planes, int bins, Rect box, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %d planes of %d bins, box %dx%d at (%d, %d): %.17g, expected %.17g\n", what, planes, bins,
+                   box.width, box.height, box.x, box.y, got, expected);
+        }
+    }
+}
+
+
+// Dense joint histogram of box over the used planes, plane k weighing bins^k in the joint bin
+static void dense_histogram(const vector<Mat>& bin_planes, const vector<bool>& use_plane, int bins, Rect box, const float* weights, vector<double>& hist) {
+
+    int dense = 1;
+    for(size_t k = 0; k < use_plane.size(); k++){
+        dense *= use_plane[k] ? bins : 1;
+    }
+    hist.assign(dense, 0.0);
+
+    for(int y = 0; y < box.height; y++){
+        for(int x = 0; x < box.width; x++){
+            int key = 0, weight = 1;
+            bool valid = true;
+            for(size_t k = 0; k < use_plane.size(); k++){
+                if(use_plane[k]){
+                    int b = bin_planes[k].at<uchar>(box.y + y, box.x + x);
+                    valid &= b < bins;
+                    key += b*weight;
+                    weight *= bins;
+                }
+            }
+            if(valid){
+                hist[key] += weights ? weights[y*box.width + x] : 1.0;
+            }
+        }
+    }
+}
+
+
+// compareHist(HISTCMP_BHATTACHARYYA) on raw counts
+static double dense_distance(const vector<double>& h1, const vector<double>& h2) {
+
+    double coefficient = 0, s1 = 0, s2 = 0;
+    for(size_t i = 0; i < h1.size(); i++){
+        coefficient += sqrt(h1[i]*h2[i]);
+        s1 += h1[i];
+        s2 += h2[i];
+    }
+    if(s1 <= 0 || s2 <= 0){
+        return 1;
+    }
+    return sqrt(max(1 - coefficient/sqrt(s1*s2), 0.0));
+}
+
+
+static void test_model(const vector<Mat>& bin_planes, const vector<bool>& use_plane, int bins, bool weighted, RNG& rng) {
+
+    int planes = 0;
+    for(size_t k = 0; k < use_plane.size(); k++){
+        planes += use_plane[k] ? 1 : 0;
+    }
+
+    Size size(30, 40);
+    Rect model_box(50, 40, size.width, size.height);
+    vector<float> weights(size.area());
+    epanechnikov_weights(size, weights.data());
+    const float* w = weighted ? weights.data() : NULL;
+
+    JointModel model;
+    model.configure(bins, use_plane);
+    model.build(bin_planes, model_box, w);
+
+    vector<double> dense_model;
+    dense_histogram(bin_planes, use_plane, bins, model_box, w, dense_model);
+    int occupied = 0;
+    for(size_t i = 0; i < dense_model.size(); i++){
+        occupied += dense_model[i] > 0 ? 1 : 0;
+    }
+    check(model.size() == occupied, "occupied bins", planes, bins, model_box, model.size(), occupied);
+    check(model.dense_size() == dense_model.size(), "dense size", planes, bins, model_box, model.dense_size(), (double)dense_model.size());
+
+    Rect window(0, 0, bin_planes[0].cols, bin_planes[0].rows);
+    Mat indices;
+    model.index_plane(bin_planes, window, indices);
+    vector<float> hist(model.size() + 2);
+
+    vector<Rect> candidates;
+    candidates.push_back(model_box);
+    candidates.push_back(model_box + Point(3, -2));
+    candidates.push_back(model_box + Point(-15, 20));
+    candidates.push_back(Rect(window.width - size.width, window.height - size.height, size.width, size.height));
+    for(int k = 0; k < 20; k++){
+        candidates.push_back(Rect(rng.uniform(0, window.width - size.width + 1), rng.uniform(0, window.height - size.height + 1), size.width, size.height));
+    }
+
+    for(size_t c = 0; c < candidates.size(); c++){
+        vector<double> dense_candidate;
+        dense_histogram(bin_planes, use_plane, bins, candidates[c], w, dense_candidate);
+        double expected = dense_distance(dense_candidate, dense_model);
+
+        model.histogram(indices, candidates[c], w, hist.data());
+        double got = model.distance(hist.data());
+        // Compared squared: the square root amplifies float rounding of the counts near distance 0
+        check(fabs(got*got - expected*expected) <= 1e-6, weighted ? "weighted distance" : "distance", planes, bins, candidates[c], got, expected);
+    }
+}
+
+
+int main() {
+
+    RNG rng(0x5eed);
+    vector<Mat> bin_planes(6);
+    int bin_counts[] = {4, 16};
+
+    for(int b = 0; b < 2; b++){
+        int bins = bin_counts[b];
+
+        // Smooth planes so neighbouring pixels often share a joint bin, 1 in 16 pixels out of range
+        for(int k = 0; k < 6; k++){
+            Mat plane(120, 160, CV_8U), noise(120, 160, CV_8U);
+            rng.fill(plane, RNG::UNIFORM, Scalar(0), Scalar(256));
+            GaussianBlur(plane, plane, Size(0, 0), 2);
+            rng.fill(noise, RNG::UNIFORM, Scalar(0), Scalar(16));
+            bin_planes[k].create(plane.size(), CV_8U);
+            for(int y = 0; y < plane.rows; y++){
+                for(int x = 0; x < plane.cols; x++){
+                    bin_planes[k].at<uchar>(y, x) = noise.at<uchar>(y, x) == 0 ? HIST_OUT_OF_RANGE : (uchar)(plane.at<uchar>(y, x)*bins/256);
+                }
+            }
+        }
+
+        vector<bool> hue_saturation(6, false), bgr(6, false);
+        hue_saturation[3] = hue_saturation[4] = true;
+        bgr[0] = bgr[1] = bgr[2] = true;
+        for(int weighted = 0; weighted < 2; weighted++){
+            test_model(bin_planes, hue_saturation, bins, weighted == 1, rng);
+            test_model(bin_planes, bgr, bins, weighted == 1, rng);
+        }
+    }
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+/* Sliding histogram test
+* Slides slide_histogram along both snake orders of a candidate grid on a random bin plane
+* (with out of range pixels) and checks every histogram against bin_histogram of the same
+* box, bit for bit. The grids are placed so that their outer candidates touch the plane
+* edges, and the steps include ones larger than the box, where the leaving and entering
+* strips are the whole box
+*/
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "SearchBudget.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, Size box, int step, Point offset, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %dx%d box, step %d, offset (%d, %d): %g, expected %g\n", what, box.width, box.height, step, offset.x, offset.y, got, expected);
+        }
+    }
+}
+
+
+/* One snake over a grid of levels and step around box
+* The histogram is built once with bin_histogram and then only slid
+*/
+static void slide_grid(const Mat& bin_plane, Rect box, int levels, int step, int order, int bins) {
+
+    vector<Point> offsets;
+    grid_offsets(levels, step, order, offsets);
+
+    vector<float> hist(bins), reference(bins);
+    Rect previous;
+    for(size_t k = 0; k < offsets.size(); k++){
+        Rect candidate = box + offsets[k];
+        if(k == 0){
+            bin_histogram(bin_plane, candidate, bins, hist.data());
+        }
+        else{
+            Point move = candidate.tl() - previous.tl();
+            check(abs(move.x) + abs(move.y) == step, "snake step", box.size(), step, offsets[k], abs(move.x) + abs(move.y), step);
+            slide_histogram(bin_plane, previous, candidate, bins, hist.data());
+        }
+        previous = candidate;
+
+        bin_histogram(bin_plane, candidate, bins, reference.data());
+        for(int b = 0; b < bins; b++){
+            check(hist[b] == reference[b], order == GRID_SNAKE_ROWS ? "rows snake" : "columns snake", box.size(), step, offsets[k], hist[b], reference[b]);
+        }
+    }
+}
+
+
+int main() {
+
+    int bins = 16;
+    uchar lut[256];
+    build_bin_lut(bins, 0, 180, lut);
+
+    RNG rng(0x5eed);
+    Size boxes[] = {Size(1, 1), Size(2, 5), Size(7, 3), Size(40, 60), Size(61, 17)};
+    int steps[] = {1, 2, 3, 8};
+    int levels = 4;
+
+    for(int b = 0; b < 5; b++){
+        for(int s = 0; s < 4; s++){
+            Size box = boxes[b];
+            int step = steps[s];
+
+            // The outer candidates of the grid touch the four edges of the plane
+            Mat plane(box.height + 2*levels*step, box.width + 2*levels*step, CV_8U), bin_plane;
+            rng.fill(plane, RNG::UNIFORM, Scalar(0), Scalar(256));
+            bin_plane.create(plane.size(), CV_8U);
+            quantize_plane(plane, Rect(Point(0, 0), plane.size()), lut, bin_plane);
+
+            Rect center(levels*step, levels*step, box.width, box.height);
+            slide_grid(bin_plane, center, levels, step, GRID_SNAKE_ROWS, bins);
+            slide_grid(bin_plane, center, levels, step, GRID_SNAKE_COLUMNS, bins);
+        }
+    }
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#ifndef HOGKERNELS_HPP_
+#define HOGKERNELS_HPP_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+const int HOG_RATIO_STEPS = 1024;   // steps of min(|dx|,|dy|)/max(|dx|,|dy|) in the gradient tables
+const int HOG_GAMMA_SCALE = 2048;   // fixed point scale of the gamma corrected pixel values
+const int HOG_LINEAR_SCALE = 128;   // fixed point scale of the pixel values without gamma correction
+
+// Contribution of one pixel of a block to the cells around it
+struct block_pixel {
+    int cell_offset[4];         // first bin of the cell in the block histogram
+    float weight[4];            // Gaussian block weight times the bilinear cell weight
+};
+
+
+/* LUT HOG descriptor
+* Same descriptor as cv::HOGDescriptor::compute (L2Hys blocks, column-major block and cell
+* order, Gaussian block weighting, bilinear interpolation in orientation and space) with
+* its geometry, bins and gamma taken from the descriptor it is configured with.
+* The gradient stage works on int16 central differences of the gamma table values: the
+* orientation and the magnitude are read from tables indexed by the quantized ratio between
+* the smaller and the larger component, generated at compile time, instead of atan2 and sqrt
+* per pixel. The lower orientation bin, the upper one and the magnitude split between them
+* are written into buffers owned by the descriptor and reused by every window.
+* With several windows, every normalized block is kept by its origin in the region, so
+* windows whose blocks coincide (locations a whole number of block strides apart) reuse
+* them instead of recomputing them; the descriptors are the same either way.
+* The tables are off by less than 0.03 degrees and 0.04% of the magnitude, in the range of
+* the fastAtan2 approximation OpenCV uses itself; on gray windows the descriptors agree with
+* an atan2/sqrt reference to about 0.2% of their L2 norm.
+*/
+class LutHog {
+    private:
+        // geometry
+        cv::Size _win_size;
+        cv::Size _block_size;
+        cv::Size _block_stride;
+        cv::Size _blocks;
+        int _nbins;
+        int _block_hist_size;
+        float _angle_scale;
+        float _threshold;
+        bool _gamma;
+        std::vector<block_pixel> _block_pixels;
+
+        // buffers reused across windows
+        cv::Mat _bins;          // CV_8UC2 lower and upper orientation bin of each pixel
+        cv::Mat _weights;       // CV_32FC2 magnitude given to each of them
+        std::vector<int> _xmap;
+        std::vector<float> _block;
+
+        // blocks shared between windows, kept by origin
+        bool _share_blocks;
+        cv::Mat _block_slots;   // CV_32S block of _block_store computed at each origin, -1 if none yet
+        std::vector<float> _block_store;
+        int _stored_blocks;
+
+        // functions
+        cv::Rect _prepare(const cv::Mat& image, const std::vector<cv::Point>& locations);
+        void _gradients(const cv::Mat& image, cv::Rect region);
+        void _block_histogram(cv::Point origin, float* hist);
+        void _normalize(float* hist);
+        const float* _normalized_block(cv::Point origin);
+
+    public:
+        // Constructor
+        LutHog();
+
+        // functions
+        void configure(const cv::HOGDescriptor& hog);
+        size_t descriptor_size() const;
+        void compute(const cv::Mat& image, std::vector<float>& descriptors,
+                     const std::vector<cv::Point>& locations = std::vector<cv::Point>());
+        void compute(const cv::Mat& image, std::vector<uchar>& descriptors, float scale,
+                     const std::vector<cv::Point>& locations = std::vector<cv::Point>());
+        void compute(const cv::Mat& image, const cv::Mat& projection, std::vector<float>& projected,
+                     const std::vector<cv::Point>& locations = std::vector<cv::Point>());
+};
+
+// Window, block, stride and cell sizes for the aspect ratio of box and about pixels pixels
+void hog_geometry(cv::Size box, int pixels, cv::HOGDescriptor& hog);
+
+
+#endif /* HOGKERNELS_HPP_ */
@@ -0,0 +1,161 @@
+#include "PoolAllocator.hpp"
+
+using namespace std;
+using namespace cv;
+
+// Four size classes per power of two, so a pooled buffer wastes at most 25%
+const int SUBCLASSES = 4;
+
+
+/* Constructor
+* Defines the smallest buffer that is pooled and how many released bytes are kept
+*/
+PoolAllocator::PoolAllocator(size_t min_pooled_bytes, size_t max_cached_bytes) {
+
+    _min_pooled_bytes = min_pooled_bytes;
+    _max_cached_bytes = max_cached_bytes;
+    _free_lists.resize(64*SUBCLASSES);
+    _stats.hits = 0;
+    _stats.misses = 0;
+    _stats.bytes_in_use = 0;
+    _stats.bytes_cached = 0;
+    _stats.peak_bytes = 0;
+}
+
+
+PoolAllocator::~PoolAllocator() {
+    release_cached();
+}
+
+
+/* Size class
+* Rounds bytes up to base + k*base/4 where base is the largest power of two below bytes
+* Returns the free list index and the rounded size
+*/
+int PoolAllocator::_size_class(size_t bytes, size_t* class_bytes) {
+
+    int exponent = 0;
+    while( (bytes >> (exponent+1)) != 0 ){
+        exponent++;
+    }
+    size_t base = (size_t)1 << exponent;
+    size_t quarter = max(base/SUBCLASSES, (size_t)1);
+    size_t sub = (bytes - base + quarter - 1)/quarter;
+    if( sub == SUBCLASSES ){
+        exponent++;
+        base *= 2;
+        sub = 0;
+    }
+
+    *class_bytes = base + sub*quarter;
+    return exponent*SUBCLASSES + (int)sub;
+}
+
+
+/* Allocate
+* Same step computation as the standard OpenCV allocator
+* Large buffers are taken from the free list of their size class if possible
+*/
+UMatData* PoolAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, UMatUsageFlags usageFlags) const {
+
+    size_t total = CV_ELEM_SIZE(type);
+    for( int i = dims-1; i >= 0; i-- ){
+        if( step ){
+            if( data0 && step[i] != CV_AUTOSTEP ){
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else{
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    if( data0 || total < _min_pooled_bytes ){
+        return Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    }
+
+    size_t class_bytes;
+    int idx = _size_class(total, &class_bytes);
+    uchar* data = NULL;
+    {
+        lock_guard<mutex> guard(_lock);
+        if( !_free_lists[idx].empty() ){
+            data = _free_lists[idx].back();
+            _free_lists[idx].pop_back();
+            _stats.bytes_cached -= class_bytes;
+            _stats.hits++;
+        }
+        else{
+            _stats.misses++;
+        }
+        _stats.bytes_in_use += class_bytes;
+        _stats.peak_bytes = max(_stats.peak_bytes, _stats.bytes_in_use + _stats.bytes_cached);
+    }
+    if( data == NULL ){
+        data = (uchar*)fastMalloc(class_bytes);
+    }
+
+    UMatData* u = new UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    return u;
+}
+
+
+bool PoolAllocator::allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const {
+    return u != NULL;
+}
+
+
+/* Deallocate
+* Returns the buffer to its free list, or frees it if the cache is full
+*/
+void PoolAllocator::deallocate(UMatData* u) const {
+
+    if( !u ){
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    size_t class_bytes;
+    int idx = _size_class(u->size, &class_bytes);
+    bool cached = false;
+    {
+        lock_guard<mutex> guard(_lock);
+        _stats.bytes_in_use -= class_bytes;
+        if( _stats.bytes_cached + class_bytes <= _max_cached_bytes ){
+            _free_lists[idx].push_back(u->origdata);
+            _stats.bytes_cached += class_bytes;
+            cached = true;
+        }
+    }
+    if( !cached ){
+        fastFree(u->origdata);
+    }
+    u->origdata = 0;
+    delete u;
+}
+
+
+// Returns a snapshot of the pool counters
+pool_stats PoolAllocator::stats() const {
+    lock_guard<mutex> guard(_lock);
+    return _stats;
+}
+
+
+// Frees every cached buffer; buffers still owned by Mats are not affected
+void PoolAllocator::release_cached() {
+
+    lock_guard<mutex> guard(_lock);
+    for(size_t i = 0; i < _free_lists.size(); i++){
+        for(size_t j = 0; j < _free_lists[i].size(); j++){
+            fastFree(_free_lists[i][j]);
+        }
+        _free_lists[i].clear();
+    }
+    _stats.bytes_cached = 0;
+}
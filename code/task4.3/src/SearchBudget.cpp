@@ -0,0 +1,97 @@
+#include "SearchBudget.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+SearchBudget::SearchBudget() {
+
+    _active = false;
+    _budget_ms = 0;
+    _start = 0;
+    _deadline = 0;
+    _stats.frames = 0;
+    _stats.evaluated = 0;
+    _stats.planned = 0;
+    _stats.total_evaluated = 0;
+    _stats.total_planned = 0;
+    _stats.overruns = 0;
+    _stats.worst_overrun_ms = 0;
+}
+
+
+void SearchBudget::start(double budget_ms) {
+
+    _active = budget_ms > 0;
+    _budget_ms = budget_ms;
+    _start = getTickCount();
+    _deadline = _start + (int64)(budget_ms*1e-3*getTickFrequency());
+}
+
+
+bool SearchBudget::active() const {
+    return _active;
+}
+
+
+// The first candidate is always evaluated so there is a box to return
+bool SearchBudget::expired(size_t evaluated) const {
+    return _active && evaluated > 0 && getTickCount() >= _deadline;
+}
+
+
+void SearchBudget::finish(int evaluated, int planned) {
+
+    if(!_active){
+        return;
+    }
+    double elapsed_ms = (getTickCount() - _start)*1e3/getTickFrequency();
+
+    _stats.frames++;
+    _stats.evaluated = evaluated;
+    _stats.planned = planned;
+    _stats.total_evaluated += evaluated;
+    _stats.total_planned += planned;
+    if(elapsed_ms > _budget_ms){
+        _stats.overruns++;
+        _stats.worst_overrun_ms = max(_stats.worst_overrun_ms, elapsed_ms - _budget_ms);
+    }
+}
+
+
+const budget_stats& SearchBudget::stats() const {
+    return _stats;
+}
+
+
+// Orders offsets by ring, then in raster order (x, then y) inside each ring. The order is
+// total, so an in-place sort gives the same sequence as a stable one without its buffer
+static bool _closer_ring(const Point& a, const Point& b) {
+    int ring_a = max(abs(a.x), abs(a.y));
+    int ring_b = max(abs(b.x), abs(b.y));
+    if(ring_a != ring_b){
+        return ring_a < ring_b;
+    }
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+
+void grid_offsets(int levels, int step, int order, vector<Point>& offsets) {
+
+    offsets.clear();
+    int span = levels*step;
+    for(int i = -span; i <= span; i += step){
+        for(int j = -span; j <= span; j += step){
+            // Odd lines of the snake orders are walked backwards
+            int k = ((i + span)/step) % 2 ? -j : j;
+            switch(order){
+                case GRID_SNAKE_ROWS: offsets.push_back(Point(k, i)); break;
+                case GRID_SNAKE_COLUMNS: offsets.push_back(Point(i, k)); break;
+                default: offsets.push_back(Point(i, j)); break;
+            }
+        }
+    }
+    if(order == GRID_RINGS){
+        sort(offsets.begin(), offsets.end(), _closer_ring);
+    }
+}
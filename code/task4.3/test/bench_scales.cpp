@@ -0,0 +1,71 @@
+/* Multi-scale search benchmark
+* Tracks the same synthetic sequences with the fixed-scale search (scale_step = 1) and with
+* the 3-scale search (scale_step = 1.05) and reports the time per frame of both and their
+* ratio, which should stay well under 3x since the three scales of a location are scored
+* in one HOG pass over a shared image pyramid, with OpenCV's HOG and with the LUT kernel.
+* The first frame (model initialization) is not timed
+*/
+#include <stdio.h>
+#include <numeric>
+#include <opencv2/opencv.hpp>
+#include "GradientTracker.hpp"
+#include "utils.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+struct run_result {
+    double ms_per_frame;
+    double mean_iou;
+};
+
+
+// Tracks the whole sequence with the main program's default bins
+static run_result run(const synthetic_sequence& sequence, int levels, int step, bool lut_hog, double scale_step) {
+
+    GradientTracker tracker(sequence.boxes[0], 16, levels, step);
+    tracker.lut_hog = lut_hog;
+    tracker.scale_step = scale_step;
+
+    vector<Rect> estimates;
+    double ms = 0;
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        int64 start = getTickCount();
+        estimates.push_back(tracker.track(sequence.frames[f]));
+        if(f > 0){
+            ms += (getTickCount() - start)*1000./getTickFrequency();
+        }
+    }
+
+    vector<float> iou = estimateTrackingPerformance(sequence.boxes, estimates);
+    run_result result;
+    result.ms_per_frame = ms/max((int)sequence.frames.size() - 1, 1);
+    result.mean_iou = accumulate(iou.begin(), iou.end(), 0.0)/iou.size();
+    return result;
+}
+
+
+static void bench(Size target_size, int levels, int step, int num_frames) {
+
+    synthetic_sequence sequence = make_synthetic_sequence(Size(320, 240), target_size, num_frames);
+    printf("\n%dx%d target, %d levels, step %d, %d frames\n", target_size.width, target_size.height, levels, step, num_frames);
+    printf("  %-6s %-12s %10s %10s %10s\n", "HOG", "scales", "ms/frame", "ratio", "mean IoU");
+
+    for(int lut = 0; lut < 2; lut++){
+        run_result fixed = run(sequence, levels, step, lut == 1, 1);
+        run_result scaled = run(sequence, levels, step, lut == 1, 1.05);
+        printf("  %-6s %-12s %10.3f %10s %10.3f\n", lut ? "LUT" : "OpenCV", "1", fixed.ms_per_frame, "", fixed.mean_iou);
+        printf("  %-6s %-12s %10.3f %9.2fx %10.3f\n", lut ? "LUT" : "OpenCV", "3 (x1.05)", scaled.ms_per_frame, scaled.ms_per_frame/fixed.ms_per_frame, scaled.mean_iou);
+    }
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    bench(Size(40, 60), 6, 4, 60);
+    bench(Size(80, 60), 6, 4, 60);
+    return 0;
+}
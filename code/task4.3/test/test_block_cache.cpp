@@ -0,0 +1,79 @@
+/* Block cache test
+* Tracks synthetic sequences (without noise, so most blocks stay unchanged, and with fresh
+* noise on every frame) with the block cache on and off. A cached distance is only reused
+* for a box whose pixels did not change, so every frame must give the same candidates with
+* bit identical scores. With pruning the score of an abandoned candidate is only a bound,
+* which a cached exact distance replaces, so only the tracked boxes must be the same. The
+* noise free sequence must also be served from the cache
+*/
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "GradientTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, const char* name, int frame, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %s, frame %d: %.17g, expected %.17g\n", what, name, frame, got, expected);
+        }
+    }
+}
+
+
+static void test_cache(const char* name, const synthetic_sequence& sequence, bool lut_hog, bool prune, bool expect_hits) {
+
+    GradientTracker cached(sequence.boxes[0], 16, 6, 4);
+    GradientTracker uncached(sequence.boxes[0], 16, 6, 4);
+    cached.lut_hog = uncached.lut_hog = lut_hog;
+    cached.prune_candidates = uncached.prune_candidates = prune;
+    cached.cache_blocks = true;
+
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        Rect box = cached.track(sequence.frames[f]);
+        Rect expected_box = uncached.track(sequence.frames[f]);
+        check(box == expected_box, "tracked box", name, (int)f, box.x + box.y/1000., expected_box.x + expected_box.y/1000.);
+        if(prune){
+            continue;
+        }
+
+        const candidates& got = cached.frame_candidates;
+        const candidates& expected = uncached.frame_candidates;
+        check(got.boxes.size() == expected.boxes.size(), "candidate count", name, (int)f, (double)got.boxes.size(), (double)expected.boxes.size());
+        for(size_t c = 0; c < min(got.boxes.size(), expected.boxes.size()); c++){
+            check(got.boxes[c] == expected.boxes[c], "candidate box", name, (int)f, got.boxes[c].x + got.boxes[c].y/1000., expected.boxes[c].x + expected.boxes[c].y/1000.);
+            check(got.scores[c] == expected.scores[c], "score", name, (int)f, got.scores[c], expected.scores[c]);
+        }
+    }
+
+    const cache_stats& stats = cached.get_cache_stats();
+    if(expect_hits){
+        check(stats.hits > 0, "cache hits", name, (int)sequence.frames.size(), (double)stats.hits, stats.lookups);
+    }
+    printf("%s: %ld of %ld distances from the cache\n", name, stats.hits, stats.lookups);
+}
+
+
+int main() {
+
+    synthetic_sequence still = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30, 0);
+    synthetic_sequence noisy = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+
+    test_cache("lookup table HOG, no noise", still, true, false, true);
+    test_cache("pruned lookup table HOG, no noise", still, true, true, true);
+    test_cache("OpenCV HOG, no noise", still, false, false, true);
+    test_cache("lookup table HOG, noise", noisy, true, false, false);
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
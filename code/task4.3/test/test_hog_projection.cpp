@@ -0,0 +1,102 @@
+/* Projected HOG test
+* LutHog::compute with a projection folds every normalized block into the components instead
+* of writing the descriptor out. Its result must equal gemm of the full descriptors with the
+* projection, up to float summation order: every component within PROJECTION_TOLERANCE of
+* the norm of the projection row times the norm of the descriptor. Checked for 16, 23 and
+* 24 bins, 32 and 128 random unit components, with no location (window at the origin), one
+* location and several sharing blocks
+*/
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HogKernels.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// Largest difference allowed per component, relative to |projection row|*|descriptor|
+const double PROJECTION_TOLERANCE = 1e-4;
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, int nbins, int components, int window, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %d bins, %d components, window %d: %g, expected %g\n", what, nbins, components, window, got, expected);
+        }
+    }
+}
+
+
+static void test_projection(const Mat& image, int nbins, int components, const vector<Point>& locations, RNG& rng) {
+
+    HOGDescriptor hog;
+    hog.nbins = nbins;
+    LutHog lut_hog;
+    lut_hog.configure(hog);
+    int n = (int)lut_hog.descriptor_size();
+
+    // Random unit rows, like the principal axes of a fitted projection
+    Mat projection(components, n, CV_32F);
+    rng.fill(projection, RNG::UNIFORM, Scalar(-1), Scalar(1));
+    for(int r = 0; r < components; r++){
+        Mat row = projection.row(r);
+        normalize(row, row);
+    }
+
+    vector<float> full, projected;
+    lut_hog.compute(image, full, locations);
+    lut_hog.compute(image, projection, projected, locations);
+
+    int windows = (int)max(locations.size(), (size_t)1);
+    check((int)projected.size() == windows*components, "projected size", nbins, components, -1, (double)projected.size(), windows*components);
+    if((int)projected.size() != windows*components){
+        return;
+    }
+
+    Mat reference;
+    gemm(Mat(windows, n, CV_32F, full.data()), projection, 1, noArray(), 0, reference, GEMM_2_T);
+
+    for(int w = 0; w < windows; w++){
+        double scale = norm(Mat(1, n, CV_32F, &full[(size_t)w*n]));
+        for(int r = 0; r < components; r++){
+            double got = projected[(size_t)w*components + r];
+            double expected = reference.at<float>(w, r);
+            check(fabs(got - expected) <= PROJECTION_TOLERANCE*max(scale, 1.), "projection vs gemm", nbins, components, w, got, expected);
+        }
+    }
+}
+
+
+int main() {
+
+    RNG rng(0x5eed);
+    Mat image(200, 160, CV_8U);
+    rng.fill(image, RNG::UNIFORM, Scalar(0), Scalar(256));
+    GaussianBlur(image, image, Size(0, 0), 1.5);
+
+    vector<Point> none, one(1, Point(21, 13)), several;
+    several.push_back(Point(0, 0));
+    several.push_back(Point(8, 16));
+    several.push_back(Point(40, 24));
+    several.push_back(Point(5, 3));
+
+    int nbins[] = {16, 23, 24};
+    int components[] = {32, 128};
+    for(int b = 0; b < 3; b++){
+        for(int c = 0; c < 2; c++){
+            test_projection(image, nbins[b], components[c], none, rng);
+            test_projection(image, nbins[b], components[c], one, rng);
+            test_projection(image, nbins[b], components[c], several, rng);
+        }
+    }
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
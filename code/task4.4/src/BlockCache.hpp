@@ -0,0 +1,218 @@
+#ifndef BLOCKCACHE_HPP_
+#define BLOCKCACHE_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+
+struct cache_stats {
+    long lookups;               // candidate features requested through the cache
+    long hits;                  // served from the previous frame (updated or reused)
+    long blocks;                // 8x8 blocks compared over the search windows
+    long dirty_blocks;          // blocks that changed or were not covered by the previous window
+};
+
+/* Dirty blocks of a search window
+* The window is split along the 8x8 grid of the frame. reset() marks the blocks that are not
+* fully inside the region known from the previous frame as dirty; compare() then marks the
+* known blocks where a plane differs from its previous version. A candidate inside the window
+* only needs to recompute the dirty parts of its feature
+*/
+class DirtyBlocks {
+    private:
+        // variables
+        cv::Rect _window;
+        int _x0, _y0, _cols, _rows;
+        std::vector<uchar> _dirty;
+
+    public:
+        // Constructor
+        DirtyBlocks();
+
+        // functions
+        void reset(cv::Rect window, cv::Rect known);
+        void reserve(cv::Size frame_size);
+        void compare(const cv::Mat& current, const cv::Mat& previous, cv::Point previous_origin);
+        bool clean(cv::Rect box) const;
+        bool regions(cv::Rect box, std::vector<cv::Rect>& dirty) const;
+        int blocks() const;
+        int dirty() const;
+};
+
+/* Two generation cache keyed by candidate
+* Entries are created for the current frame; the ones of the previous frame can be taken over
+* once (find() reports them as stale so the caller updates them). next_frame() drops every
+* entry that was not used during the last frame, and erase() drops a key from both frames.
+* Keys live in a flat open addressing table (multiplicative hashing, linear probing, as in
+* JointModel), tagged with the last frame that used them, so next_frame() only moves the
+* frame on. Values are kept in a pool and the values of dropped entries are handed to new
+* keys, storage included, so once the pool has grown to the working set the cache allocates
+* nothing; insert() may return a value that still holds the data of an older entry.
+* When over half of the slots have been used, the keys of the current and previous frames
+* are moved into a spare table (larger only if they fill a quarter of it), the two tables
+* are swapped and the values of the other keys go back to the pool. reserve() sizes both
+* tables and the pool up front. Pointers returned by find() and insert() are valid until the
+* next insert()
+*/
+template<typename T>
+class FrameCache {
+    private:
+        // variables
+        std::vector<uint64_t> _keys;
+        std::vector<int> _frames;           // frame of the last use of each slot, 0 when erased, -1 when never used
+        std::vector<int> _entries;          // value of each slot
+        std::vector<uint64_t> _spare_keys;
+        std::vector<int> _spare_frames;
+        std::vector<int> _spare_entries;
+        std::vector<T> _values;
+        std::vector<int> _free;             // values not held by any slot
+        int _frame;
+        int _used;                          // slots used since the last rebuild
+        int _shift;
+
+        // Slot holding key, or the unused slot where it would go
+        int _slot(uint64_t key) const {
+            int mask = (int)_keys.size() - 1;
+            int s = (int)((key*0x9E3779B97F4A7C15ULL) >> _shift);
+            while(_frames[s] >= 0 && _keys[s] != key){
+                s = (s + 1) & mask;
+            }
+            return s;
+        }
+
+        // Keeps the keys of the current and previous frames, in a table of at least capacity slots
+        void _rebuild(int capacity){
+            int live = 0;
+            for(size_t s = 0; s < _frames.size(); s++){
+                live += _frames[s] >= _frame - 1 ? 1 : 0;
+            }
+            while(capacity < 4*live){
+                capacity *= 2;
+            }
+            _spare_keys.resize(capacity);
+            _spare_entries.resize(capacity);
+            _spare_frames.assign(capacity, -1);
+
+            std::swap(_keys, _spare_keys);
+            std::swap(_frames, _spare_frames);
+            std::swap(_entries, _spare_entries);
+            _shift = 64;
+            while((1 << (64 - _shift)) < capacity){
+                _shift--;
+            }
+            _used = 0;
+            for(size_t s = 0; s < _spare_frames.size(); s++){
+                if(_spare_frames[s] >= _frame - 1){
+                    int t = _slot(_spare_keys[s]);
+                    _keys[t] = _spare_keys[s];
+                    _frames[t] = _spare_frames[s];
+                    _entries[t] = _spare_entries[s];
+                    _used++;
+                }
+                else if(_spare_frames[s] >= 0){
+                    _free.push_back(_spare_entries[s]);
+                }
+            }
+        }
+
+    public:
+        // Constructor
+        FrameCache(){
+            _frame = 2;
+            _used = 0;
+            _shift = 64;
+        }
+
+        // Entry of key for this frame, taken over from the previous frame if needed, or NULL
+        T* find(uint64_t key, bool& stale){
+            if(_keys.empty()){
+                return NULL;
+            }
+            int s = _slot(key);
+            if(_frames[s] < _frame - 1){
+                return NULL;
+            }
+            stale = _frames[s] != _frame;
+            _frames[s] = _frame;
+            return &_values[_entries[s]];
+        }
+
+        // Room for frames of up to keys entries without allocating, new values copied from value
+        void reserve(int keys, const T& value){
+            int capacity = 64;
+            while(capacity < 8*keys){
+                capacity *= 2;
+            }
+            if(capacity > (int)_keys.size()){
+                _rebuild(capacity);
+            }
+            _spare_keys.reserve(_keys.size());
+            _spare_frames.reserve(_keys.size());
+            _spare_entries.reserve(_keys.size());
+            _values.reserve(_keys.size()/2);
+            _free.reserve(_keys.size()/2);
+            while(_values.size() < _keys.size()/2){
+                _free.push_back((int)_values.size());
+                _values.push_back(value);
+            }
+        }
+
+        T& insert(uint64_t key){
+            if(_keys.empty() || 2*(_used + 1) > (int)_keys.size()){
+                _rebuild(std::max((int)_keys.size(), 64));
+            }
+            int s = _slot(key);
+            if(_frames[s] < 0){
+                if(_free.empty()){
+                    _values.push_back(T());
+                    _free.reserve(_values.capacity());
+                    _entries[s] = (int)_values.size() - 1;
+                }
+                else{
+                    _entries[s] = _free.back();
+                    _free.pop_back();
+                }
+                _keys[s] = key;
+                _used++;
+            }
+            _frames[s] = _frame;
+            return _values[_entries[s]];
+        }
+
+        void erase(uint64_t key){
+            if(!_keys.empty()){
+                int s = _slot(key);
+                if(_frames[s] >= 0){
+                    _frames[s] = 0;
+                }
+            }
+        }
+
+        void next_frame(){
+            _frame++;
+        }
+
+        void clear(){
+            for(size_t s = 0; s < _frames.size(); s++){
+                if(_frames[s] >= 0){
+                    _free.push_back(_entries[s]);
+                }
+            }
+            _frames.assign(_frames.size(), -1);
+            _used = 0;
+        }
+};
+
+// Cache key of a box (coordinates below 65536 and sizes below 16384) and a tag such as a channel
+inline uint64_t box_key(cv::Rect box, int tag = 0){
+    return ((((uint64_t)box.x << 16 | (uint64_t)box.y) << 14 | (uint64_t)box.width) << 14 | (uint64_t)box.height) << 4 | (uint64_t)tag;
+}
+
+// Moves the pixels of region whose bin changed from previous_bins to current_bins in a count histogram
+void update_histogram(float* hist, int bins, const cv::Mat& previous_bins, const cv::Mat& current_bins, cv::Rect region);
+
+
+#endif /* BLOCKCACHE_HPP_ */
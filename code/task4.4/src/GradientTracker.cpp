@@ -4,6 +4,8 @@
 #include <iostream>
 #include <unistd.h>
 
+// Components per pruning stage of the PCA reduced descriptors
+const int PCA_STAGE_SIZE = 16;
 
 
 /* Constructor
@@ -17,21 +19,142 @@ GradientTracker::GradientTracker(Rect gt, int bins, int in_cand_levels,int in_ca
     candidate_step = in_cand_step;
 
     _hog_descriptor.nbins = bins;
+    _lut_hog.configure(_hog_descriptor);
+    _lut_deviation = 0;
     _model.box = gt;
     _model_initialized = false;
+    score_mode = SCORE_HOG;
+    scale_step = 1;
+    num_particles = 0;
+    particle_noise = 4;
+    static_threshold = 0;
+    prune_candidates = false;
+    cache_blocks = false;
+    lut_hog = false;
+    hog_pixels = 0;
+    quantize_hog = false;
+    check_quantization = false;
+    pca_components = 0;
+    _quantization_scale = 1;
+    _quantize_stats.distances = 0;
+    _quantize_stats.error_sum = 0;
+    _quantize_stats.max_error = 0;
+    _quantize_stats.frames = 0;
+    _quantize_stats.argmin_agree = 0;
+    _best_score = DBL_MAX;
+    _prune_stats.candidates = 0;
+    _prune_stats.pruned = 0;
+    _cache_window = Rect(0, 0, 0, 0);
+    _cache_stats.lookups = 0;
+    _cache_stats.hits = 0;
+    _cache_stats.blocks = 0;
+    _cache_stats.dirty_blocks = 0;
+    _exact_distance = true;
 
+    // Buffers are sized once here and reused on every frame
+    _temp_descriptors.reserve(_hog_descriptor.getDescriptorSize());
+    frame_candidates.boxes.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    frame_candidates.scores.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    _exact_scores.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    _offsets.reserve((2*candidate_levels+1)*(2*candidate_levels+1));
+    _scales.reserve(3);
 }
 
 
 /* Track
 * Searches for the candidate closest to the target and return its bounding box
+* In particle mode the box is centered on the weighted mean of the particles instead
 */
 Rect GradientTracker::track(Mat frame) {
+    return track(frame, 0);
+}
+
+
+/* Track within a time budget
+* With budget_ms > 0 the candidates are evaluated from the predicted position outwards
+* in rings and the search stops at the deadline, returning the best candidate so far.
+* In multi-scale search the deadline is checked between scales; particle mode always
+* evaluates every particle.
+* Frames whose search window is unchanged since the last tracked frame (static_threshold > 0)
+* keep the previous box and are not counted by the budget; particles keep their centers
+* with zero velocity
+*/
+Rect GradientTracker::track(Mat frame, double budget_ms) {
     
+    bool first_frame = !_model_initialized;
+
+    // An unchanged window gives the same candidates and scores as the last tracked frame
+    _gate.threshold = static_threshold;
+    if(_gate.unchanged(frame, _search_window(frame.size()))){
+        if(num_particles > 0 && !first_frame){
+            _particle_filter.hold();
+        }
+        return _model.box;
+    }
+
+    _budget.start(budget_ms);
     _generate_candiates(frame);
-    int idx = min_element(frame_candidates.scores.begin(),frame_candidates.scores.end()) - frame_candidates.scores.begin();
-    _model.box = frame_candidates.boxes[idx];
-    return frame_candidates.boxes[idx];
+
+    if(num_particles > 0 && !first_frame){
+        _particle_filter.update(frame_candidates.scores);
+        _model.box = _particle_filter.estimate_box(_model.box.size(), frame.size());
+    }
+    else{
+        int idx = min_element(frame_candidates.scores.begin(),frame_candidates.scores.end()) - frame_candidates.scores.begin();
+        _model.box = frame_candidates.boxes[idx];
+        if(_quantized() && check_quantization){
+            _record_argmin(idx);
+        }
+    }
+
+    int planned = (int)frame_candidates.boxes.size();
+    if(!first_frame && num_particles == 0){
+        planned = (int)(_offsets.size()*_candidate_scales().size());
+    }
+    _budget.finish((int)frame_candidates.boxes.size(), planned);
+    return _model.box;
+}
+
+
+// Candidates evaluated and deadline overruns of the frames tracked with a budget
+const budget_stats& GradientTracker::get_budget_stats() const {
+    return _budget.stats();
+}
+
+
+// Relative L2 difference between the LUT and the OpenCV descriptors of the model (lut_hog only)
+float GradientTracker::get_lut_deviation() const {
+    return _lut_deviation;
+}
+
+
+// Relative error of the quantized distances checked against the float ones (check_quantization only)
+const quantize_stats& GradientTracker::get_quantize_stats() const {
+    return _quantize_stats;
+}
+
+
+// Size every candidate is resized to before its HOG is computed
+Size GradientTracker::get_hog_window() const {
+    return _hog_descriptor.winSize;
+}
+
+
+// Frames checked by the static region gate and frames that reused the previous box
+const gate_stats& GradientTracker::get_gate_stats() const {
+    return _gate.stats();
+}
+
+
+// Candidate distances reused from the previous frame and changed blocks of the search windows
+const cache_stats& GradientTracker::get_cache_stats() const {
+    return _cache_stats;
+}
+
+
+// Candidates abandoned by branch and bound, per HOG block at which they were abandoned
+const prune_stats& GradientTracker::get_prune_stats() const {
+    return _prune_stats;
 }
 
 
@@ -45,35 +168,83 @@ void GradientTracker::_generate_candiates(Mat frame){
 
     frame_candidates.boxes.clear();
     frame_candidates.scores.clear();
+    _exact_scores.clear();
+    _best_score = DBL_MAX;
     
-    cvtColor(frame, frame, CV_BGR2GRAY);
+    cvtColor(frame, _gray, CV_BGR2GRAY);
+    frame = _gray;
 
     if(!_model_initialized) {
         _init_model(frame);
         _model_initialized = true;
+        if(_block_cache()){
+            _reserve_cache(frame);
+        }
+        if(num_particles > 0){
+            _particle_filter.init(num_particles, Point2f(_model.box.x + _model.box.width/2.f, _model.box.y + _model.box.height/2.f), particle_noise);
+        }
+    }
+
+    else if(num_particles > 0) {
+        _particle_search(frame);
     }
 
     else {
 
-        int initialValue = -candidate_levels*candidate_step;
-        int finalValue = candidate_levels*candidate_step;
+        if(_block_cache()){
+            _cache_frame(frame, _search_window(frame.size()));
+        }
+
+        if(_dense_search()){
+            Rect window = _search_window(frame.size());
+            _orientation_features(frame, window);
+            _dense_matcher.match(_dense_features, _dense_scores);
+            _window_origin = window.tl();
+        }
+        else if(score_mode == SCORE_PERIMETER){
+            Rect window = _search_window(frame.size());
+            Sobel(frame(window), _dx, CV_32F, 1, 0, 3);
+            Sobel(frame(window), _dy, CV_32F, 0, 1, 3);
+            _window_origin = window.tl();
+            _init_perimeter(_model.box.size());
+        }
+
+        const vector<double>& scales = _candidate_scales();
+        grid_offsets(candidate_levels, candidate_step, _budget.active() ? GRID_RINGS : GRID_RASTER, _offsets);
+
+        for (size_t s = 0; s < scales.size() && !_budget.expired(frame_candidates.boxes.size()); s++){
+            Rect base_box = _scaled_box(scales[s]);
+            size_t first = frame_candidates.boxes.size();
 
-        for (int ix = initialValue; ix <= finalValue; ix = ix + candidate_step){
-            for (int iy = initialValue; iy <= finalValue; iy = iy + candidate_step){
+            for (size_t k = 0; k < _offsets.size(); k++){
 
-                int x = _model.box.x + ix;
-                int y = _model.box.y + iy;
+                // Scales are scored in one HOG pass, so only single scale search stops mid-grid
+                if(scales.size() == 1 && _budget.expired(frame_candidates.boxes.size())){
+                    break;
+                }
+
+                int x = base_box.x + _offsets[k].x;
+                int y = base_box.y + _offsets[k].y;
 
-                if( (x>=0) && (y>=0) && ( (x+_model.box.width) <= frame.cols ) && ( (y+_model.box.height)<=frame.rows ) ){
+                if( (x>=0) && (y>=0) && ( (x+base_box.width) <= frame.cols ) && ( (y+base_box.height)<=frame.rows ) ){
 
-                    Rect candidate_box = Rect(_model.box);
+                    Rect candidate_box = Rect(base_box);
                     candidate_box.x = x;
                     candidate_box.y = y;
                     frame_candidates.boxes.push_back(candidate_box);
-                    frame_candidates.scores.push_back(_get_distance(frame,candidate_box));
-    
+                    if(scales.size() == 1){
+                        frame_candidates.scores.push_back(_score(frame,candidate_box));
+                    }
                 }
             }
+
+            if(scales.size() > 1){
+                _get_scale_distances(frame, first);
+            }
+        }
+
+        if(score_mode == SCORE_PERIMETER){
+            _normalize_perimeter_scores();
         }
     }
 }
@@ -81,15 +252,45 @@ void GradientTracker::_generate_candiates(Mat frame){
 
 /* Initialize model
 * Obtains the HOG of region defined by ground truth  
+* With hog_pixels > 0 the HOG window follows the aspect ratio of the box instead of the 64x128 person window
 * Returns "distances" for code consistency
 */
 void GradientTracker::_init_model(Mat frame){
+
+    if(hog_pixels > 0){
+        hog_geometry(_model.box.size(), hog_pixels, _hog_descriptor);
+        _lut_hog.configure(_hog_descriptor);
+        _temp_descriptors.reserve(_hog_descriptor.getDescriptorSize());
+    }
  
-    Mat croped_frame;
-    frame(_model.box).copyTo(croped_frame);
-    resize(croped_frame,croped_frame,Size(64,128));
+    resize(frame(_model.box),_resized,_hog_descriptor.winSize);
+
+    _compute_hog(_resized, _model.descriptors, vector<Point>());
+
+    // The scale of the quantized descriptors is fixed by the model
+    if(_quantized()){
+        int n = (int)_model.descriptors.size();
+        _quantization_scale = quantization_scale(_model.descriptors.data(), n);
+        _model_quantized.resize(n);
+        quantize_descriptor(_model.descriptors.data(), n, _quantization_scale, _model_quantized.data());
+    }
 
-    _hog_descriptor.compute(croped_frame, _model.descriptors);
+    // How far the LUT descriptor of the model is from OpenCV's, relative to its norm
+    if(lut_hog){
+        _hog_descriptor.compute(_resized, _temp_descriptors);
+        double reference = norm(Mat(_temp_descriptors));
+        _lut_deviation = (float)(norm(Mat(_model.descriptors), Mat(_temp_descriptors))/max(reference, 1e-6));
+    }
+
+    if(pca_components > 0){
+        _fit_projection(frame);
+    }
+
+    if(_dense_search()){
+        int margin = candidate_levels*candidate_step;
+        _orientation_features(frame, _model.box);
+        _dense_matcher.set_template(_dense_features, _model.box.size() + Size(2*margin, 2*margin));
+    }
     
     frame_candidates.boxes.push_back(_model.box);
     frame_candidates.scores.push_back(0);
@@ -100,15 +301,565 @@ void GradientTracker::_init_model(Mat frame){
 /* HOG tracking
 * Obtains the HOG of one candidate according to grayscale 
 * Computes the L2 distance between target and candidate histogram
+* The candidate is resized straight from the frame into a buffer owned by the tracker
 */
 float GradientTracker::_get_distance(Mat frame,Rect candidate_box){
+
+    // The descriptor only depends on the pixels of the box, so a box without changed blocks keeps its distance
+    uint64_t key = box_key(candidate_box);
+    if(_block_cache()){
+        bool stale = false;
+        float* cached = _distance_cache.find(key, stale);
+        _cache_stats.lookups++;
+        if(cached && (!stale || _dirty_blocks.clean(candidate_box))){
+            _cache_stats.hits++;
+            if(_pruning()){
+                _best_score = min(_best_score, (double)*cached);
+            }
+            return *cached;
+        }
+    }
     
-    Mat croped_frame;
-    vector<float> temp_descriptors;
-    frame(candidate_box).copyTo(croped_frame);
-    resize(croped_frame,croped_frame,Size(64,128));
+    resize(frame(candidate_box),_resized,_hog_descriptor.winSize);
+
+    float distance;
+    if(_quantized()){
+        _compute_quantized_hog(_resized, vector<Point>());
+        distance = _quantized_distance(_temp_quantized.data());
+        if(check_quantization){
+            _compute_hog(_resized, _temp_descriptors, vector<Point>());
+            _record_quantization(distance, l2_distance(_temp_descriptors.data(), _model.descriptors.data(), (int)_model.descriptors.size()));
+        }
+    }
+    else{
+        _compute_hog(_resized, _temp_descriptors, vector<Point>());
+        distance = _descriptor_distance(_temp_descriptors.data());
+    }
+
+    // Pruned distances are only bounds for this frame and are not kept
+    if(_block_cache()){
+        if(_exact_distance){
+            _distance_cache.insert(key) = distance;
+        }
+        else{
+            _distance_cache.erase(key);
+        }
+    }
+    return distance;
+}
+
+
+/* HOG descriptors
+* Descriptors of the windows at locations (the whole image with none), from OpenCV or
+* from the LUT gradient kernel with the same geometry and bins
+*/
+void GradientTracker::_compute_hog(const Mat& image, vector<float>& descriptors, const vector<Point>& locations){
+
+    // Reduced descriptors: the LUT kernel projects block by block, OpenCV's descriptors are projected afterwards
+    if(!_projection.empty()){
+        if(lut_hog){
+            _lut_hog.compute(image, _projection, descriptors, locations);
+        }
+        else{
+            _hog_descriptor.compute(image, _full_descriptors, Size(), Size(), locations);
+            int windows = max((int)locations.size(), 1);
+            descriptors.resize(windows*_projection.rows);
+            Mat projected(windows, _projection.rows, CV_32F, descriptors.data());
+            gemm(Mat(windows, _projection.cols, CV_32F, _full_descriptors.data()), _projection, 1, noArray(), 0, projected, GEMM_2_T);
+        }
+        return;
+    }
+
+    if(lut_hog){
+        _lut_hog.compute(image, descriptors, locations);
+    }
+    else{
+        _hog_descriptor.compute(image, descriptors, Size(), Size(), locations);
+    }
+}
+
+
+/* PCA projection
+* Fits pca_components principal axes to the HOG descriptors of the model box shifted on a
+* 9x9 grid of up to an eighth of its size, at its size and scaled by 0.95 and 1.05, so the
+* reduced space keeps the directions in which the target varies around its position.
+* From then on every descriptor, the model's included, is computed projected.
+*/
+void GradientTracker::_fit_projection(Mat frame){
+
+    Rect bounds(0, 0, frame.cols, frame.rows);
+    Size step(max(_model.box.width/32, 1), max(_model.box.height/32, 1));
+    Point center(_model.box.x + _model.box.width/2, _model.box.y + _model.box.height/2);
+    double scales[3] = {1, 0.95, 1.05};
+
+    vector<Rect> boxes;
+    for(int s = 0; s < 3; s++){
+        Size size(cvRound(_model.box.width*scales[s]), cvRound(_model.box.height*scales[s]));
+        for(int dy = -4; dy <= 4; dy++){
+            for(int dx = -4; dx <= 4; dx++){
+                Rect box(center.x - size.width/2 + dx*step.width, center.y - size.height/2 + dy*step.height, size.width, size.height);
+                if(box.area() > 0 && (box & bounds) == box){
+                    boxes.push_back(box);
+                }
+            }
+        }
+    }
+    // A single sample has no variance to keep
+    if(boxes.size() < 2){
+        return;
+    }
+
+    int n = (int)_model.descriptors.size();
+    _pca_samples.create((int)boxes.size(), n, CV_32F);
+    for(size_t k = 0; k < boxes.size(); k++){
+        resize(frame(boxes[k]), _resized, _hog_descriptor.winSize);
+        _compute_hog(_resized, _temp_descriptors, vector<Point>());
+        std::copy(_temp_descriptors.begin(), _temp_descriptors.end(), _pca_samples.ptr<float>((int)k));
+    }
 
-    _hog_descriptor.compute(croped_frame, temp_descriptors);
-    return norm(temp_descriptors, _model.descriptors,NORM_L2);
+    PCA pca(_pca_samples, noArray(), PCA::DATA_AS_ROW, min(pca_components, _pca_samples.rows));
+    _projection = pca.eigenvectors;
 
-}
\ No newline at end of file
+    resize(frame(_model.box), _resized, _hog_descriptor.winSize);
+    _compute_hog(_resized, _model.descriptors, vector<Point>());
+}
+
+
+// Quantized descriptors are only used for the full HOG, the reduced one stays float
+bool GradientTracker::_quantized(){
+    return quantize_hog && pca_components <= 0;
+}
+
+
+/* Quantized HOG descriptors
+* Descriptors of the windows at locations as uint8 with the model scale, into _temp_quantized.
+* The LUT kernel quantizes each block as it is normalized
+*/
+void GradientTracker::_compute_quantized_hog(const Mat& image, const vector<Point>& locations){
+
+    if(lut_hog){
+        _lut_hog.compute(image, _temp_quantized, _quantization_scale, locations);
+    }
+    else{
+        _hog_descriptor.compute(image, _temp_descriptors, Size(), Size(), locations);
+        _temp_quantized.resize(_temp_descriptors.size());
+        quantize_descriptor(_temp_descriptors.data(), (int)_temp_descriptors.size(), _quantization_scale, _temp_quantized.data());
+    }
+}
+
+
+/* Descriptor distance
+* L2 distance to the model descriptor. With pruning it is accumulated block by block (by
+* PCA_STAGE_SIZE components for PCA reduced descriptors, strongest components first) and
+* abandoned once it reaches the best distance of the frame; the abandoned candidate keeps
+* the partial distance, a lower bound that is still not below the best
+*/
+float GradientTracker::_descriptor_distance(const float* descriptor){
+
+    int n = (int)_model.descriptors.size();
+    _exact_distance = true;
+    if(!_pruning()){
+        return l2_distance(descriptor, _model.descriptors.data(), n);
+    }
+
+    int block_size = _projection.empty() ? _hog_block_size() : PCA_STAGE_SIZE;
+    int stride = (block_size + 7)/8*8;      // stages are rounded to whole reduction lanes
+    int total_stages = (n + stride - 1)/stride;
+
+    int stages;
+    double distance = l2_distance_bounded(descriptor, _model.descriptors.data(), n, block_size, _best_score, &stages);
+
+    _record_pruning(stages, total_stages);
+    _exact_distance = stages == total_stages;
+    _best_score = min(_best_score, distance);
+    return (float)distance;
+}
+
+
+/* Quantized descriptor distance
+* _descriptor_distance on the uint8 descriptors, converted back to descriptor units.
+* Stages are whole HOG blocks, integer sums do not need lane alignment
+*/
+float GradientTracker::_quantized_distance(const uchar* descriptor){
+
+    int n = (int)_model_quantized.size();
+    _exact_distance = true;
+    if(!_pruning()){
+        return (float)(l2_distance_u8(descriptor, _model_quantized.data(), n)/_quantization_scale);
+    }
+
+    int block_size = _hog_block_size();
+    int total_stages = (n + block_size - 1)/block_size;
+
+    int stages;
+    double distance = l2_distance_u8_bounded(descriptor, _model_quantized.data(), n, block_size, _best_score*_quantization_scale, &stages)/_quantization_scale;
+
+    _record_pruning(stages, total_stages);
+    _exact_distance = stages == total_stages;
+    _best_score = min(_best_score, distance);
+    return (float)distance;
+}
+
+
+/* Quantization check
+* Keeps the float distance of the candidate for _record_argmin and the relative error of its
+* quantized distance. A pruned quantized distance is only a bound, so its error is not recorded
+*/
+void GradientTracker::_record_quantization(float quantized, double exact){
+
+    _exact_scores.push_back(exact);
+    if(!_exact_distance){
+        return;
+    }
+    double error = fabs(quantized - exact)/max(exact, 1e-6);
+    _quantize_stats.distances++;
+    _quantize_stats.error_sum += error;
+    _quantize_stats.max_error = max(_quantize_stats.max_error, error);
+}
+
+
+/* Argmin agreement
+* Counts the frame when the candidate chosen by the quantized distances also has the smallest
+* float distance (ties included). Frames with candidates served from the block cache have no
+* float distance for them and are not counted
+*/
+void GradientTracker::_record_argmin(int chosen){
+
+    if(_exact_scores.empty() || _exact_scores.size() != frame_candidates.scores.size()){
+        return;
+    }
+    double best = *min_element(_exact_scores.begin(), _exact_scores.end());
+    _quantize_stats.frames++;
+    if(_exact_scores[chosen] == best){
+        _quantize_stats.argmin_agree++;
+    }
+}
+
+
+// Values in one normalized HOG block
+int GradientTracker::_hog_block_size(){
+
+    Size cells(_hog_descriptor.blockSize.width/_hog_descriptor.cellSize.width, _hog_descriptor.blockSize.height/_hog_descriptor.cellSize.height);
+    return cells.area()*_hog_descriptor.nbins;
+}
+
+
+// Branch and bound only for HOG on the candidate grid, where only the argmin matters
+bool GradientTracker::_pruning(){
+    return prune_candidates && score_mode == SCORE_HOG && num_particles == 0;
+}
+
+
+/* Block cache
+* Only for single scale HOG on the candidate grid, where a candidate is resized straight from
+* its own pixels
+*/
+bool GradientTracker::_block_cache(){
+    return cache_blocks && score_mode == SCORE_HOG && num_particles == 0 && scale_step <= 1;
+}
+
+
+// Cache buffers, sized on the first frame: a frame sized reference, the dirty blocks of any window and a distance per grid candidate
+void GradientTracker::_reserve_cache(Mat frame){
+
+    _cache_reference.create(frame.size(), frame.type());
+    _dirty_blocks.reserve(frame.size());
+    _distance_cache.reserve((2*candidate_levels+1)*(2*candidate_levels+1), 0.f);
+}
+
+
+/* Cached frame
+* Marks the 8x8 blocks of the window whose gray levels changed since the last tracked frame,
+* then keeps the window as the reference of the next one, in place in a frame sized buffer.
+* Blocks outside the previous window are unknown and count as changed
+*/
+void GradientTracker::_cache_frame(Mat frame, Rect window){
+
+    _distance_cache.next_frame();
+    _dirty_blocks.reset(window, _cache_window);
+    _cache_reference.create(frame.size(), frame.type());
+    _dirty_blocks.compare(frame, _cache_reference, Point(0, 0));
+    frame(window).copyTo(_cache_reference(window));
+    _cache_window = window;
+    _cache_stats.blocks += _dirty_blocks.blocks();
+    _cache_stats.dirty_blocks += _dirty_blocks.dirty();
+}
+
+
+// Counts a scored candidate and, if it was abandoned, the block at which it happened
+void GradientTracker::_record_pruning(int stages, int total_stages) {
+
+    _prune_stats.candidates++;
+    if(stages < total_stages){
+        _prune_stats.pruned++;
+        if((int)_prune_stats.pruned_at.size() < total_stages){
+            _prune_stats.pruned_at.resize(total_stages, 0);
+        }
+        _prune_stats.pruned_at[stages-1]++;
+    }
+}
+
+
+// Distance between one candidate and the model according to score_mode
+float GradientTracker::_score(Mat frame, Rect candidate_box){
+
+    if(_dense_search()){
+        return _dense_scores.at<float>(candidate_box.y - _window_origin.y, candidate_box.x - _window_origin.x);
+    }
+    if(score_mode == SCORE_PERIMETER){
+        return _get_perimeter_score(candidate_box);
+    }
+    return _get_distance(frame, candidate_box);
+}
+
+
+// Dense scoring needs every offset of the window to be a candidate, otherwise HOG per candidate is used
+bool GradientTracker::_dense_search(){
+    return score_mode == SCORE_DENSE && candidate_step == 1 && num_particles == 0;
+}
+
+
+/* Particle search
+* One candidate per particle, at the current box size, scored with HOG or, for
+* SCORE_PERIMETER, with gradients computed over the region spanned by the particles
+*/
+void GradientTracker::_particle_search(Mat frame){
+
+    _particle_filter.predict(_model.box.size(), frame.size());
+
+    Rect window = _particle_filter.box(0, _model.box.size());
+    for(int i = 0; i < _particle_filter.size(); i++){
+        Rect candidate_box = _particle_filter.box(i, _model.box.size());
+        frame_candidates.boxes.push_back(candidate_box);
+        window |= candidate_box;
+    }
+
+    if(score_mode == SCORE_PERIMETER){
+        Sobel(frame(window), _dx, CV_32F, 1, 0, 3);
+        Sobel(frame(window), _dy, CV_32F, 0, 1, 3);
+        _window_origin = window.tl();
+        _init_perimeter(_model.box.size());
+    }
+
+    for(size_t i = 0; i < frame_candidates.boxes.size(); i++){
+        frame_candidates.scores.push_back(_score(frame, frame_candidates.boxes[i]));
+    }
+
+    if(score_mode == SCORE_PERIMETER){
+        _normalize_perimeter_scores();
+    }
+}
+
+
+/* Candidate scales
+* With scale_step > 1 the box is also tested shrunk and grown by scale_step; the current
+* size comes first so it wins ties. Only HOG descriptors, computed on the fixed
+* _hog_descriptor.winSize window whatever the box size, are compared across scales
+*/
+const vector<double>& GradientTracker::_candidate_scales(){
+
+    _scales.assign(1, 1.);
+    if(scale_step > 1 && score_mode == SCORE_HOG){
+        _scales.push_back(1./scale_step);
+        _scales.push_back(scale_step);
+    }
+    return _scales;
+}
+
+
+// Model box resized by scale around its center, never below 8x8 pixels
+Rect GradientTracker::_scaled_box(double scale){
+
+    int width = max(cvRound(_model.box.width*scale), min(_model.box.width, 8));
+    int height = max(cvRound(_model.box.height*scale), min(_model.box.height, 8));
+    return Rect(_model.box.x + (_model.box.width - width)/2, _model.box.y + (_model.box.height - height)/2, width, height);
+}
+
+
+/* HOG pyramid level
+* Candidates from first on have the same size, so instead of resizing each one the region
+* they cover is resized once to the HOG scale of that size and a single HOG pass computes
+* every candidate descriptor at its location, computing the gradients of the region once.
+* The LUT kernel also computes each block once for candidates whose blocks coincide;
+* OpenCV's HOG recomputes the blocks of every location. Locations are rounded to the
+* resized grid
+*/
+void GradientTracker::_get_scale_distances(Mat frame, size_t first){
+
+    vector<Rect>& boxes = frame_candidates.boxes;
+    if(first == boxes.size()){
+        return;
+    }
+
+    Rect region = boxes[first];
+    for(size_t k = first + 1; k < boxes.size(); k++){
+        region |= boxes[k];
+    }
+
+    Size window = _hog_descriptor.winSize;
+    double fx = (double)window.width/boxes[first].width;
+    double fy = (double)window.height/boxes[first].height;
+    Size level_size(max(cvRound(region.width*fx), window.width), max(cvRound(region.height*fy), window.height));
+    resize(frame(region), _pyramid_level, level_size);
+
+    _locations.clear();
+    for(size_t k = first; k < boxes.size(); k++){
+        int x = min(cvRound((boxes[k].x - region.x)*fx), level_size.width - window.width);
+        int y = min(cvRound((boxes[k].y - region.y)*fy), level_size.height - window.height);
+        _locations.push_back(Point(x, y));
+    }
+
+    int descriptor_size = (int)_model.descriptors.size();
+    if(_quantized()){
+        _compute_quantized_hog(_pyramid_level, _locations);
+        if(check_quantization){
+            _compute_hog(_pyramid_level, _temp_descriptors, _locations);
+        }
+        for(size_t k = 0; k < _locations.size(); k++){
+            float distance = _quantized_distance(_temp_quantized.data() + k*descriptor_size);
+            if(check_quantization){
+                _record_quantization(distance, l2_distance(_temp_descriptors.data() + k*descriptor_size, _model.descriptors.data(), descriptor_size));
+            }
+            frame_candidates.scores.push_back(distance);
+        }
+        return;
+    }
+
+    _compute_hog(_pyramid_level, _temp_descriptors, _locations);
+
+    for(size_t k = 0; k < _locations.size(); k++){
+        const float* descriptor = _temp_descriptors.data() + k*descriptor_size;
+        frame_candidates.scores.push_back(_descriptor_distance(descriptor));
+    }
+}
+
+
+// Region covered by all candidates of the current frame
+Rect GradientTracker::_search_window(Size frame_size){
+
+    int margin = candidate_levels*candidate_step;
+    Rect window(_model.box.x - margin, _model.box.y - margin, _model.box.width + 2*margin, _model.box.height + 2*margin);
+    return window & Rect(0, 0, frame_size.width, frame_size.height);
+}
+
+
+/* Orientation cell features
+* One plane per HOG bin holding the gradient magnitude of the pixels whose unsigned
+* orientation falls in that bin, averaged over a HOG cell. The cell is the HOG cell
+* mapped back from the _hog_descriptor.winSize window to the box size, so these planes are
+* a dense, unnormalized version of the HOG cell histograms at every pixel of region.
+* Gradients use [-1 0 1] as HOG does and read pixels outside region when available
+*/
+void GradientTracker::_orientation_features(Mat frame, Rect region){
+
+    int nbins = _hog_descriptor.nbins;
+    Sobel(frame(region), _dx, CV_32F, 1, 0, 1);
+    Sobel(frame(region), _dy, CV_32F, 0, 1, 1);
+    cartToPolar(_dx, _dy, _magnitude, _orientation, true);
+
+    _dense_features.resize(nbins);
+    for(int b = 0; b < nbins; b++){
+        _dense_features[b].create(region.size(), CV_32F);
+        _dense_features[b] = Scalar(0);
+    }
+
+    float bin_scale = nbins/180.f;
+    for(int y = 0; y < region.height; y++){
+        const float* magnitude = _magnitude.ptr<float>(y);
+        const float* orientation = _orientation.ptr<float>(y);
+        for(int x = 0; x < region.width; x++){
+            float angle = orientation[x] >= 180.f ? orientation[x] - 180.f : orientation[x];
+            int b = min((int)(angle*bin_scale), nbins - 1);
+            _dense_features[b].ptr<float>(y)[x] = magnitude[x];
+        }
+    }
+
+    Size window = _hog_descriptor.winSize;
+    Size cell(max(_model.box.width*_hog_descriptor.cellSize.width/window.width, 1),
+              max(_model.box.height*_hog_descriptor.cellSize.height/window.height, 1));
+    for(int b = 0; b < nbins; b++){
+        blur(_dense_features[b], _dense_features[b], cell);
+    }
+}
+
+
+/* Ellipse perimeter
+* Rasterizes the ellipse inscribed in a box of box_size once, storing each pixel offset
+* from the box corner with the unit normal of the ellipse there. Rebuilt only when the
+* box size changes
+*/
+void GradientTracker::_init_perimeter(Size box_size){
+
+    if(box_size == _perimeter_size){
+        return;
+    }
+    _perimeter_size = box_size;
+    _perimeter.clear();
+
+    float a = max((box_size.width - 1)/2.f, 0.5f);
+    float b = max((box_size.height - 1)/2.f, 0.5f);
+    Mat visited = Mat::zeros(box_size, CV_8U);
+
+    // Enough angular samples to reach every pixel of the perimeter
+    int samples = 8*(box_size.width + box_size.height);
+    for(int i = 0; i < samples; i++){
+        double theta = 2*CV_PI*i/samples;
+        double ex = a*cos(theta);
+        double ey = b*sin(theta);
+        int x = min(max(cvRound(a + ex), 0), box_size.width - 1);
+        int y = min(max(cvRound(b + ey), 0), box_size.height - 1);
+        if(visited.at<uchar>(y, x)){
+            continue;
+        }
+        visited.at<uchar>(y, x) = 1;
+
+        double nx = ex/(a*a);
+        double ny = ey/(b*b);
+        double length = sqrt(nx*nx + ny*ny);
+        perimeter_point p;
+        p.offset = Point(x, y);
+        p.normal = Point2f((float)(nx/length), (float)(ny/length));
+        _perimeter.push_back(p);
+    }
+}
+
+
+/* Gradient module (Birchfield 1998, eq. 3)
+* Mean of |n(i) . g(i)| over the perimeter pixels of the candidate ellipse, where g is the
+* unnormalized intensity gradient of the search window computed once per frame.
+* Higher is better; converted to a distance by _normalize_perimeter_scores
+*/
+float GradientTracker::_get_perimeter_score(Rect candidate_box){
+
+    int x0 = candidate_box.x - _window_origin.x;
+    int y0 = candidate_box.y - _window_origin.y;
+    double sum = 0;
+
+    for(size_t i = 0; i < _perimeter.size(); i++){
+        const perimeter_point& p = _perimeter[i];
+        float gx = _dx.ptr<float>(y0 + p.offset.y)[x0 + p.offset.x];
+        float gy = _dy.ptr<float>(y0 + p.offset.y)[x0 + p.offset.x];
+        sum += fabs(p.normal.x*gx + p.normal.y*gy);
+    }
+    return (float)(sum/_perimeter.size());
+}
+
+
+/* Perimeter score normalization
+* As in the paper, scores are turned into a percentage of the range over the candidates
+* of the frame; stored as 1 - percentage so that lower is better as for the other modes
+*/
+void GradientTracker::_normalize_perimeter_scores(){
+
+    vector<double>& scores = frame_candidates.scores;
+    if(scores.empty()){
+        return;
+    }
+    double lowest = *min_element(scores.begin(), scores.end());
+    double highest = *max_element(scores.begin(), scores.end());
+    double range = highest - lowest;
+
+    for(size_t i = 0; i < scores.size(); i++){
+        scores[i] = range > 0 ? 1. - (scores[i] - lowest)/range : 0.;
+    }
+}
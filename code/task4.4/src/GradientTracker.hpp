@@ -3,6 +3,13 @@
 #include <sstream>
 
 #include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "DenseCorrelation.hpp"
+#include "ParticleFilter.hpp"
+#include "SearchBudget.hpp"
+#include "StaticGate.hpp"
+#include "BlockCache.hpp"
+#include "HogKernels.hpp"
 
 using namespace std;
 using namespace cv;
@@ -17,6 +24,25 @@ struct candidates {
     vector<double> scores;
 };
 
+struct prune_stats {
+    long candidates;            // candidates scored with pruning enabled
+    long pruned;                // candidates abandoned before their last block
+    vector<long> pruned_at;     // pruned_at[k]: abandoned after k+1 HOG blocks
+};
+
+// How candidates are compared with the model
+enum gradient_score_mode {
+    SCORE_HOG = 0,      // L2 distance between HOG descriptors of the resized candidates
+    SCORE_DENSE = 1,    // orientation cell features matched against the model's by FFT, every offset at once
+    SCORE_PERIMETER = 2 // Birchfield gradient module: gradient along the normal of the inscribed ellipse
+};
+
+// Pixel of the ellipse inscribed in a box, relative to the box corner, and its unit normal
+struct perimeter_point {
+    Point offset;
+    Point2f normal;
+};
+
 
 class GradientTracker{
     private:
@@ -25,11 +51,96 @@ class GradientTracker{
         bool _model_initialized;
         model _model;
         HOGDescriptor _hog_descriptor;
+        LutHog _lut_hog;
+        float _lut_deviation;
+
+        // buffers reused across frames
+        Mat _gray;
+        Mat _resized;
+        vector<float> _temp_descriptors;
+        vector<Point> _offsets;
+
+        // deadline
+        SearchBudget _budget;
+
+        // static region gating
+        StaticGate _gate;
+
+        // block cache of candidate distances
+        Mat _cache_reference;
+        Rect _cache_window;
+        DirtyBlocks _dirty_blocks;
+        FrameCache<float> _distance_cache;
+        cache_stats _cache_stats;
+        bool _exact_distance;
+
+        // quantized descriptors
+        vector<uchar> _model_quantized;
+        vector<uchar> _temp_quantized;
+        float _quantization_scale;
+        quantize_stats _quantize_stats;
+        vector<double> _exact_scores;   // float distance of every candidate of the frame (check_quantization only)
+
+        // PCA reduced descriptors
+        Mat _projection;
+        Mat _pca_samples;
+        vector<float> _full_descriptors;
+
+        // branch and bound
+        double _best_score;
+        prune_stats _prune_stats;
+
+        // multi-scale search
+        vector<double> _scales;
+        Mat _pyramid_level;
+        vector<Point> _locations;
+
+        // dense scoring
+        DenseMatcher _dense_matcher;
+        vector<Mat> _dense_features;
+        Mat _dense_scores;
+        Point _window_origin;
+        Mat _dx;
+        Mat _dy;
+        Mat _magnitude;
+        Mat _orientation;
+
+        // particle filter search
+        ParticleFilter _particle_filter;
+
+        // perimeter scoring
+        vector<perimeter_point> _perimeter;
+        Size _perimeter_size;
 
         // functions
         void _init_model(Mat frame);
         float _get_distance(Mat frame, Rect box);
         void _generate_candiates(Mat frame);
+        float _score(Mat frame, Rect box);
+        void _compute_hog(const Mat& image, vector<float>& descriptors, const vector<Point>& locations);
+        void _compute_quantized_hog(const Mat& image, const vector<Point>& locations);
+        void _fit_projection(Mat frame);
+        bool _quantized();
+        float _descriptor_distance(const float* descriptor);
+        float _quantized_distance(const uchar* descriptor);
+        void _record_quantization(float quantized, double exact);
+        void _record_argmin(int chosen);
+        int _hog_block_size();
+        bool _pruning();
+        void _record_pruning(int stages, int total_stages);
+        bool _block_cache();
+        void _reserve_cache(Mat frame);
+        void _cache_frame(Mat frame, Rect window);
+        bool _dense_search();
+        void _particle_search(Mat frame);
+        void _orientation_features(Mat frame, Rect region);
+        Rect _search_window(Size frame_size);
+        const vector<double>& _candidate_scales();
+        Rect _scaled_box(double scale);
+        void _get_scale_distances(Mat frame, size_t first);
+        void _init_perimeter(Size box_size);
+        float _get_perimeter_score(Rect candidate_box);
+        void _normalize_perimeter_scores();
 
     public:
         // Constructor
@@ -37,10 +148,30 @@ class GradientTracker{
 
         // functions
         Rect track(Mat frame);
+        Rect track(Mat frame, double budget_ms);
+        const budget_stats& get_budget_stats() const;
+        const gate_stats& get_gate_stats() const;
+        const cache_stats& get_cache_stats() const;
+        const prune_stats& get_prune_stats() const;
+        float get_lut_deviation() const;
+        Size get_hog_window() const;
+        const quantize_stats& get_quantize_stats() const;
         
         // variables
         int candidate_levels;
         int candidate_step;
+        double scale_step;
+        int num_particles;
+        float particle_noise;
+        double static_threshold;
+        bool prune_candidates;
+        bool cache_blocks;
+        bool lut_hog;
+        int hog_pixels;
+        bool quantize_hog;
+        bool check_quantization;
+        int pca_components;
+        int score_mode;
         candidates frame_candidates;
 };
 
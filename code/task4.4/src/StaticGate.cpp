@@ -0,0 +1,76 @@
+#include "StaticGate.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+StaticGate::StaticGate() {
+
+    threshold = 0;
+    _window = Rect(0, 0, 0, 0);
+    _stats.frames = 0;
+    _stats.skipped = 0;
+}
+
+
+/* Gate check
+* True if window has not changed since the last tracked frame. Otherwise the window
+* becomes the new reference and the frame must be tracked
+*/
+bool StaticGate::unchanged(const Mat& frame, Rect window) {
+
+    if(threshold <= 0){
+        return false;
+    }
+    _stats.frames++;
+
+    Mat region = frame(window);
+    if(window == _window && !_reference.empty() && _same_blocks(region)){
+        _stats.skipped++;
+        return true;
+    }
+    region.copyTo(_reference);
+    _window = window;
+    return false;
+}
+
+
+// Block SAD against the reference, stopping at the first block over the threshold
+bool StaticGate::_same_blocks(const Mat& region) {
+
+    const int block = 8;
+    int channels = region.channels();
+    int blocks_x = (region.cols + block - 1)/block;
+    _block_sums.assign(blocks_x, 0);
+
+    for(int y = 0; y < region.rows; y++){
+        const uchar* current = region.ptr<uchar>(y);
+        const uchar* reference = _reference.ptr<uchar>(y);
+        for(int b = 0; b < blocks_x; b++){
+            int end = min((b + 1)*block, region.cols)*channels;
+            int sum = 0;
+            for(int x = b*block*channels; x < end; x++){
+                sum += abs(current[x] - reference[x]);
+            }
+            _block_sums[b] += sum;
+        }
+
+        // A block row is complete every 8 rows and at the bottom of the window
+        if((y + 1) % block == 0 || y + 1 == region.rows){
+            int height = y % block + 1;
+            for(int b = 0; b < blocks_x; b++){
+                int width = min(block, region.cols - b*block);
+                if(_block_sums[b] >= threshold*width*height*channels){
+                    return false;
+                }
+                _block_sums[b] = 0;
+            }
+        }
+    }
+    return true;
+}
+
+
+const gate_stats& StaticGate::stats() const {
+    return _stats;
+}
@@ -20,6 +20,9 @@
 #include <opencv2/opencv.hpp>					//opencv libraries
 
 #include "utils.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
+#include "PoolAllocator.hpp" 					//pooled allocator for frame sized Mats
+#include "CpuFeatures.hpp" 						//instruction set used by the tracker kernels
+#include "WorkingResolution.hpp" 				//target size normalized processing resolution
 #include "GradientTracker.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
 
 //namespaces
@@ -41,10 +44,30 @@ int main(int argc, char ** argv)
 	int bins = 16;
 	int candidate_levels = 6;
 	int candidate_step = 4;
+	double scale_step = 1.0;	// > 1 also tests the box shrunk and grown by this factor (e.g. 1.05)
+	int num_particles = 0;		// > 0 replaces the candidate grid by a particle filter with this many particles
+	double frame_budget_ms = 0;		// > 0 stops the candidate search at this time per frame and keeps the best so far
+	int target_pixels = 0;		// > 0 tracks at a resolution where the initial box covers about this many pixels (e.g. 4096)
+	bool reference_run = true;	// with a reduced resolution, also tracks at full resolution to report both performances (untimed)
+	double static_threshold = 0;	// > 0 keeps the previous box while no 8x8 block of the search window changes by this mean level (e.g. 4)
+	bool cache_blocks = false;	// reuses the candidate features of the last frame, recomputing only their changed 8x8 blocks
+	bool lut_hog = false;		// computes HOG gradients through orientation/magnitude lookup tables instead of OpenCV
+	bool quantize_hog = false;	// compares uint8 HOG descriptors with integer kernels instead of float ones
+	bool check_quantization = false;	// also computes the float distances to measure the quantization error (slower)
+	int pca_components = 0;		// > 0 compares candidates in this many PCA dimensions fit around the model at init (e.g. 128)
+	int hog_pixels = 0;			// > 0 shapes the HOG window like the initial box with about this many pixels (e.g. 8192) instead of 64x128
+	bool prune_candidates = false;	// abandons a candidate once its partial distance cannot beat the best of the frame
+	int score_mode = SCORE_HOG;	// SCORE_HOG, SCORE_DENSE (needs candidate_step = 1) or SCORE_PERIMETER
 	////////////////////////////////////////////
 
 	int NumSeq = argc-1;
 
+	//Frame sized Mats (decoded frames, tracker planes, overlays, encoder buffers) reuse pooled memory.
+	//The pool is never deleted since OpenCV may still release Mats through it after main returns
+	PoolAllocator* frame_pool = new PoolAllocator();
+	Mat::setDefaultAllocator(frame_pool);
+	cout << "Kernel instruction set: " << simd_level_name(active_simd_level()) << endl;
+
 	//PLEASE CHANGE 'dataset_path' & 'output_path' ACCORDING TO YOUR PROJECT
 	//std::string dataset_path = "./datasets";									//dataset location.
 	std::string output_path = "./outvideos/";									//location to save output videos
@@ -96,7 +119,34 @@ int main(int argc, char ** argv)
 		std::cout << "Displaying sequence at " << inputvideo << std::endl;
 		std::cout << "  with groundtruth at " << inputGroundtruth << std::endl;
 
-		GradientTracker gtracker(list_bbox_gt[0],bins, candidate_levels, candidate_step);
+		//Tracking runs at the working resolution, boxes are mapped back to the full frame
+		WorkingResolution resolution(list_bbox_gt[0], frame_size, target_pixels);
+		std::cout << "  working resolution scale = " << resolution.scale() << std::endl;
+
+		GradientTracker gtracker(resolution.to_working(list_bbox_gt[0]),bins, candidate_levels, candidate_step);
+		auto configure = [&](GradientTracker& tracker){
+			tracker.score_mode = score_mode;
+			tracker.scale_step = scale_step;
+			tracker.num_particles = num_particles;
+			tracker.static_threshold = static_threshold;
+			tracker.cache_blocks = cache_blocks;
+			tracker.lut_hog = lut_hog;
+			tracker.hog_pixels = hog_pixels;
+			tracker.quantize_hog = quantize_hog;
+			tracker.check_quantization = check_quantization;
+			tracker.pca_components = pca_components;
+			tracker.prune_candidates = prune_candidates;
+		};
+		configure(gtracker);
+
+		//Reference tracker on the full resolution frames, not timed
+		bool reference = reference_run && (resolution.scale() < 1);
+		Ptr<GradientTracker> rtracker;
+		std::vector<Rect> list_bbox_reference;
+		if(reference){
+			rtracker = makePtr<GradientTracker>(list_bbox_gt[0],bins, candidate_levels, candidate_step);
+			configure(*rtracker);
+		}
 
 		for (;;) {
 			//get frame & check if we achieved the end of the videofile (e.g. frame.data is empty)
@@ -111,7 +161,7 @@ int main(int argc, char ** argv)
 			////////////////////////////////////////////////////////////////////////////////////////////
 			//DO TRACKING
 			//Change the following line with your own code
-			list_bbox_est.push_back(gtracker.track(frame));//we use a fixed value only for this demo program. Remove this line when you use your code
+			list_bbox_est.push_back(resolution.to_full(gtracker.track(resolution.to_working(frame), frame_budget_ms)));//we use a fixed value only for this demo program. Remove this line when you use your code
 			//...
 			// ADD YOUR CODE HERE
 			//...
@@ -119,6 +169,9 @@ int main(int argc, char ** argv)
 
 			//Time measurement
 			procTimes.push_back(((double)getTickCount() - t)*1000. / cv::getTickFrequency());
+			if(reference){
+				list_bbox_reference.push_back(rtracker->track(frame));
+			}
 			//std::cout << " processing time=" << procTimes[procTimes.size()-1] << " ms" << std::endl;
 
 			// plot frame number & groundtruth bounding box for each frame
@@ -145,6 +198,43 @@ int main(int argc, char ** argv)
 		//print stats about processing time and tracking performance
 		std::cout << "  Average processing time = " << std::accumulate( procTimes.begin(), procTimes.end(), 0.0) / procTimes.size() << " ms/frame" << std::endl;
 		std::cout << "  Average tracking performance = " << std::accumulate( trackPerf.begin(), trackPerf.end(), 0.0) / trackPerf.size() << std::endl;
+		if(reference){
+			vector<float> referencePerf = estimateTrackingPerformance(list_bbox_gt, list_bbox_reference);
+			std::cout << "  Full resolution tracking performance = " << std::accumulate( referencePerf.begin(), referencePerf.end(), 0.0) / referencePerf.size() << std::endl;
+		}
+		pool_stats pstats = frame_pool->stats();
+		std::cout << "  Frame pool hits = " << pstats.hits << ", misses = " << pstats.misses << ", peak = " << pstats.peak_bytes/(1024.*1024.) << " MB" << std::endl;
+		if(static_threshold > 0){
+			const gate_stats& gstats = gtracker.get_gate_stats();
+			std::cout << "  Static frames skipped = " << gstats.skipped << " of " << gstats.frames << std::endl;
+		}
+		if(hog_pixels > 0){
+			Size hog_window = gtracker.get_hog_window();
+			std::cout << "  HOG window = " << hog_window.width << "x" << hog_window.height << std::endl;
+		}
+		if(quantize_hog && check_quantization){
+			const quantize_stats& qstats = gtracker.get_quantize_stats();
+			std::cout << "  Quantized HOG distance error = " << (qstats.distances > 0 ? qstats.error_sum/qstats.distances : 0.) << " mean, " << qstats.max_error << " max over " << qstats.distances << " candidates" << std::endl;
+			std::cout << "  Quantized best candidate is also best by the float distances in " << qstats.argmin_agree << " of " << qstats.frames << " frames" << std::endl;
+		}
+		if(lut_hog){
+			std::cout << "  LUT HOG deviation from OpenCV on the model = " << gtracker.get_lut_deviation() << std::endl;
+		}
+		if(cache_blocks){
+			const cache_stats& cstats = gtracker.get_cache_stats();
+			std::cout << "  Cached candidate features = " << cstats.hits << " of " << cstats.lookups << ", changed blocks = " << cstats.dirty_blocks << " of " << cstats.blocks << std::endl;
+		}
+		if(frame_budget_ms > 0){
+			const budget_stats& bstats = gtracker.get_budget_stats();
+			std::cout << "  Candidates evaluated = " << bstats.total_evaluated << " of " << bstats.total_planned << ", budget overruns = " << bstats.overruns << " of " << bstats.frames << " frames (worst +" << bstats.worst_overrun_ms << " ms)" << std::endl;
+		}
+		if(prune_candidates){
+			const prune_stats& prstats = gtracker.get_prune_stats();
+			std::cout << "  Candidates pruned = " << prstats.pruned << " of " << prstats.candidates << ", after HOG blocks:";
+			for(size_t k = 0; k < prstats.pruned_at.size(); k++)
+				std::cout << " " << k+1 << ":" << prstats.pruned_at[k];
+			std::cout << std::endl;
+		}
 
 		//release all resources
 		cap.release();			// close inputvideo
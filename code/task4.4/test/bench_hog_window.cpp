@@ -0,0 +1,84 @@
+/* HOG window benchmark
+* Tracks synthetic sequences whose target is square, wide or tall with the fixed 64x128
+* person window (hog_pixels = 0) and with the window shaped like the initial box at the
+* same pixel count (hog_pixels = 64*128), with OpenCV's HOG and with the LUT kernel.
+* Reports the time per frame, the HOG window, the descriptor length and the mean IoU
+* against the ground truth of the sequence. The first frame (model initialization) is
+* not timed
+*/
+#include <stdio.h>
+#include <numeric>
+#include <opencv2/opencv.hpp>
+#include "GradientTracker.hpp"
+#include "utils.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+struct run_result {
+    double ms_per_frame;
+    double mean_iou;
+    Size window;
+    int descriptor_size;
+};
+
+
+// Tracks the whole sequence with the main program's default search
+static run_result run(const synthetic_sequence& sequence, int hog_pixels, bool lut_hog) {
+
+    GradientTracker tracker(sequence.boxes[0], 16, 6, 4);
+    tracker.hog_pixels = hog_pixels;
+    tracker.lut_hog = lut_hog;
+
+    vector<Rect> estimates;
+    double ms = 0;
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        int64 start = getTickCount();
+        estimates.push_back(tracker.track(sequence.frames[f]));
+        if(f > 0){
+            ms += (getTickCount() - start)*1000./getTickFrequency();
+        }
+    }
+
+    vector<float> iou = estimateTrackingPerformance(sequence.boxes, estimates);
+    run_result result;
+    result.ms_per_frame = ms/max((int)sequence.frames.size() - 1, 1);
+    result.mean_iou = accumulate(iou.begin(), iou.end(), 0.0)/iou.size();
+    result.window = tracker.get_hog_window();
+    HOGDescriptor hog;
+    if(hog_pixels > 0){
+        hog_geometry(sequence.boxes[0].size(), hog_pixels, hog);
+    }
+    result.descriptor_size = (int)hog.getDescriptorSize();
+    return result;
+}
+
+
+static void bench(const char* name, Size target_size, int num_frames) {
+
+    synthetic_sequence sequence = make_synthetic_sequence(Size(320, 240), target_size, num_frames);
+    printf("\n%s target %dx%d, %d frames\n", name, target_size.width, target_size.height, num_frames);
+    printf("  %-22s %-6s %10s %10s %12s %10s\n", "window", "HOG", "ms/frame", "size", "descriptor", "mean IoU");
+
+    int pixels[] = {0, 64*128};
+    for(int p = 0; p < 2; p++){
+        for(int lut = 0; lut < 2; lut++){
+            run_result r = run(sequence, pixels[p], lut == 1);
+            printf("  %-22s %-6s %10.3f %10s %12d %10.3f\n", pixels[p] > 0 ? "shaped like the box" : "fixed 64x128",
+                   lut ? "LUT" : "OpenCV", r.ms_per_frame, format("%dx%d", r.window.width, r.window.height).c_str(),
+                   r.descriptor_size, r.mean_iou);
+        }
+    }
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    bench("square", Size(60, 60), 120);
+    bench("wide", Size(120, 40), 120);
+    bench("tall", Size(40, 90), 120);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* Steady state allocation test
+* Tracks a synthetic sequence and counts every heap allocation (replaced global operator
+* new) and every Mat buffer allocation (counting MatAllocator) made by track() after the
+* first frame. The first frame sizes the model and the frame buffers; every later frame
+* must reuse them, so the Mat count must be zero with the lookup table HOG.
+* The heap count is only reported: cv::resize of every candidate to the HOG window takes
+* its interpolation tables from the heap, and OpenCV's HOGDescriptor::compute also builds
+* its block cache on every call.
+* OpenCV runs single threaded here, since its thread pool allocates a job per parallel_for_
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <opencv2/opencv.hpp>
+#include "GradientTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// Heap allocations of the whole process while counting is on
+static long heap_allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if(counting){
+        heap_allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+
+// Standard allocator that counts the Mat buffers it hands out
+class CountingAllocator : public MatAllocator {
+    public:
+        mutable long allocations;
+
+        CountingAllocator() {
+            allocations = 0;
+        }
+
+        UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, UMatUsageFlags usageFlags) const {
+            if(counting){
+                allocations++;
+            }
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        bool allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const {
+            return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+        }
+
+        void deallocate(UMatData* u) const {
+            Mat::getStdAllocator()->deallocate(u);
+        }
+};
+
+
+// Tracks the whole sequence (with a frame budget when budget_ms > 0), counting the allocations of every frame after the first one
+static bool check_tracker(const char* name, GradientTracker& tracker, const synthetic_sequence& sequence, const CountingAllocator& allocator, bool check_mats, double budget_ms = 0) {
+
+    long heap = 0, mats = 0;
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        long heap_before = heap_allocations, mats_before = allocator.allocations;
+        counting = f > 0;
+        tracker.track(sequence.frames[f], budget_ms);
+        counting = false;
+        heap += heap_allocations - heap_before;
+        mats += allocator.allocations - mats_before;
+    }
+
+    bool passed = !check_mats || mats == 0;
+    printf("%s %s: %ld heap and %ld Mat allocations after frame 1 (%.1f heap per frame)\n", passed ? "PASS" : "FAIL", name, heap, mats, heap/(double)(sequence.frames.size() - 1));
+    return passed;
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    CountingAllocator* allocator = new CountingAllocator();
+    Mat::setDefaultAllocator(allocator);
+
+    synthetic_sequence sequence = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+    Rect box = sequence.boxes[0];
+    bool passed = true;
+
+    // Lookup table HOG: gradients and blocks in tracker buffers
+    GradientTracker lut(box, 16, 6, 4);
+    lut.lut_hog = true;
+    passed &= check_tracker("lookup table HOG", lut, sequence, *allocator, true);
+
+    // Quantized descriptors on the lookup table HOG
+    GradientTracker quantized(box, 16, 6, 4);
+    quantized.lut_hog = true;
+    quantized.quantize_hog = true;
+    passed &= check_tracker("quantized lookup table HOG", quantized, sequence, *allocator, true);
+
+    // Frame budget: candidates in ring order, with a deadline that is never reached
+    GradientTracker budgeted(box, 16, 6, 4);
+    budgeted.lut_hog = true;
+    passed &= check_tracker("budgeted lookup table HOG", budgeted, sequence, *allocator, true, 1000);
+
+    // Block cache: distances of unchanged boxes kept from the last frame
+    GradientTracker cached(box, 16, 6, 4);
+    cached.lut_hog = true;
+    cached.cache_blocks = true;
+    passed &= check_tracker("cached lookup table HOG", cached, sequence, *allocator, true);
+
+    // OpenCV HOG, reported only
+    GradientTracker opencv(box, 16, 6, 4);
+    check_tracker("OpenCV HOG (not checked)", opencv, sequence, *allocator, false);
+
+    Mat::setDefaultAllocator(NULL);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/* LUT HOG test
+* Compares LutHog with cv::HOGDescriptor::compute on gray images (a smooth pattern with
+* noise, and uniform noise) for the bin counts of our configurations (16, 23 and 24), with
+* the 64x128 window and with a window shaped by hog_geometry. Windows are computed one at
+* a time (no block sharing) and together, at locations a whole number of block strides
+* apart and in between (blocks shared where they coincide). Every window must be within
+* HOG_TOLERANCE of the OpenCV descriptor, measured as the L2 norm of the difference over
+* the L2 norm of the OpenCV descriptor. HogKernels.hpp quotes about 0.2% for gray windows;
+* the bound leaves room for OpenCV's own arctangent approximation. Shared and unshared
+* windows must also be identical to each other
+*/
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HogKernels.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// Largest relative L2 difference allowed between a LUT and an OpenCV descriptor
+const double HOG_TOLERANCE = 0.005;
+
+static int checks = 0;
+static int failures = 0;
+static double worst_error = 0;
+
+static void check(bool passed, const char* what, int nbins, Size window, Point location, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %d bins, %dx%d window at (%d, %d): %g, expected %g\n", what, nbins, window.width, window.height,
+                   location.x, location.y, got, expected);
+        }
+    }
+}
+
+
+// L2 norm of a - b over the L2 norm of b
+static double relative_error(const float* a, const float* b, size_t n) {
+
+    double difference = 0, reference = 0;
+    for(size_t k = 0; k < n; k++){
+        difference += (a[k] - b[k])*(a[k] - b[k]);
+        reference += b[k]*b[k];
+    }
+    return sqrt(difference/max(reference, 1e-12));
+}
+
+
+static void test_descriptor(const Mat& image, const HOGDescriptor& hog) {
+
+    LutHog lut_hog;
+    lut_hog.configure(hog);
+    size_t n = lut_hog.descriptor_size();
+    check(n == hog.getDescriptorSize(), "descriptor size", hog.nbins, hog.winSize, Point(), (double)n, (double)hog.getDescriptorSize());
+    if(n != hog.getDescriptorSize()){
+        return;
+    }
+
+    // Whole strides apart, one stride apart, in between and against the bottom right corner
+    Size stride = hog.blockStride;
+    vector<Point> locations;
+    locations.push_back(Point(0, 0));
+    locations.push_back(Point(stride.width, 0));
+    locations.push_back(Point(2*stride.width, 3*stride.height));
+    locations.push_back(Point(5, 3));
+    locations.push_back(Point(image.cols - hog.winSize.width, image.rows - hog.winSize.height));
+
+    vector<float> reference, shared, single;
+    hog.compute(image, reference, Size(), Size(), locations);
+    lut_hog.compute(image, shared, locations);
+
+    for(size_t w = 0; w < locations.size(); w++){
+        lut_hog.compute(image, single, vector<Point>(1, locations[w]));
+
+        double error = relative_error(single.data(), &reference[w*n], n);
+        worst_error = max(worst_error, error);
+        check(error <= HOG_TOLERANCE, "unshared blocks vs HOGDescriptor", hog.nbins, hog.winSize, locations[w], error, HOG_TOLERANCE);
+
+        error = relative_error(&shared[w*n], &reference[w*n], n);
+        worst_error = max(worst_error, error);
+        check(error <= HOG_TOLERANCE, "shared blocks vs HOGDescriptor", hog.nbins, hog.winSize, locations[w], error, HOG_TOLERANCE);
+
+        double difference = 0;
+        for(size_t k = 0; k < n; k++){
+            difference = max(difference, (double)fabs(shared[w*n + k] - single[k]));
+        }
+        check(difference == 0, "shared vs unshared blocks", hog.nbins, hog.winSize, locations[w], difference, 0);
+    }
+}
+
+
+int main() {
+
+    RNG rng(0x5eed);
+    Mat smooth(200, 160, CV_8U), noise(200, 160, CV_8U), grain(200, 160, CV_8U);
+    for(int y = 0; y < smooth.rows; y++){
+        for(int x = 0; x < smooth.cols; x++){
+            smooth.at<uchar>(y, x) = saturate_cast<uchar>(128 + 60*sin(x*0.13) + 40*cos(y*0.07 + x*0.02));
+        }
+    }
+    rng.fill(grain, RNG::UNIFORM, Scalar(0), Scalar(9));
+    add(smooth, grain, smooth);
+    rng.fill(noise, RNG::UNIFORM, Scalar(0), Scalar(256));
+
+    int nbins[] = {16, 23, 24};
+    for(int b = 0; b < 3; b++){
+        for(int shaped = 0; shaped < 2; shaped++){
+            HOGDescriptor hog;
+            hog.nbins = nbins[b];
+            if(shaped){
+                hog_geometry(Size(90, 60), 64*128, hog);
+            }
+            test_descriptor(smooth, hog);
+            test_descriptor(noise, hog);
+        }
+    }
+
+    printf("Largest relative difference with HOGDescriptor: %.3f%% (tolerance %.3f%%)\n", 100*worst_error, 100*HOG_TOLERANCE);
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#ifndef HISTOGRAMKERNELS_HPP_
+#define HISTOGRAMKERNELS_HPP_
+
+#include <opencv2/opencv.hpp>
+
+// Value of the bin lookup table for pixels outside the histogram range
+const uchar HIST_OUT_OF_RANGE = 255;
+
+// Uniform bin lookup table for 8 bit pixels, same binning as calcHist
+void build_bin_lut(int bins, float lower, float upper, uchar* lut);
+
+// Writes the bin index of every pixel of plane inside roi into the same roi of bin_plane
+void quantize_plane(const cv::Mat& plane, cv::Rect roi, const uchar* lut, cv::Mat& bin_plane);
+
+// Histogram of a bin index plane restricted to roi, written as float counts
+void bin_histogram(const cv::Mat& bin_plane, cv::Rect roi, int bins, float* hist);
+
+// Integral histogram of a bin index plane over window, (rows+1) x (cols+1)*bins CV_32S
+void integral_histogram(const cv::Mat& bin_plane, cv::Rect window, int bins, cv::Mat& integral);
+
+// Bytes of the integral histogram of a window
+size_t integral_histogram_bytes(cv::Size window, int bins);
+
+// Largest total size of the integral histograms a tracker builds per frame, over all channels
+const size_t INTEGRAL_HISTOGRAM_BUDGET = 16 << 20;
+
+// Histogram of box (relative to the integral histogram window) written as float counts
+void integral_histogram_box(const cv::Mat& integral, cv::Rect box, int bins, float* hist);
+
+// Counts of box to obtained from those of box from (same size) by removing and adding strips
+void slide_histogram(const cv::Mat& bin_plane, cv::Rect from, cv::Rect to, int bins, float* hist);
+
+// Lattice stride that keeps a box at or below max_samples pixels (1 if max_samples <= 0)
+int sample_stride(cv::Size box, int max_samples);
+
+// Histogram of one pixel per stride x stride cell of roi, written as float counts
+void sampled_bin_histogram(const cv::Mat& bin_plane, cv::Rect roi, int bins, int stride, float* hist);
+
+// Epanechnikov profile max(0, 1 - r^2) of every pixel of a box, r = 1 on the inscribed ellipse, row-major
+void epanechnikov_weights(cv::Size box, float* weights);
+
+// Histogram of a bin index plane restricted to roi, each pixel adding its weight (row-major over roi)
+void weighted_bin_histogram(const cv::Mat& bin_plane, cv::Rect roi, int bins, const float* weights, float* hist);
+
+// In-place NORM_MINMAX normalization to [lower, upper]
+void normalize_histogram(float* hist, int bins, float lower, float upper);
+
+// Bhattacharyya distance, same definition as compareHist(HISTCMP_BHATTACHARYYA)
+double bhattacharyya_distance(const float* h1, const float* h2, int bins);
+
+// L2 distance between two descriptors
+double l2_distance(const float* a, const float* b, int n);
+
+// L2 distance evaluated in stages, abandoned once it reaches bound (see HistogramKernels.cpp)
+double l2_distance_bounded(const float* a, const float* b, int n, int stage_size, double bound, int* stages);
+
+// Accuracy of quantized descriptor distances against the float ones
+struct quantize_stats {
+    long distances;             // quantized distances checked against the float path
+    double error_sum;           // sum of their relative errors
+    double max_error;           // largest relative error
+    long frames;                // frames whose every candidate has both distances
+    long argmin_agree;          // of those, frames where the quantized best candidate is also best by the float distances
+};
+
+// Per-model scale for quantize_descriptor (see HistogramKernels.cpp)
+float quantization_scale(const float* d, int n);
+
+// Rounds d*scale to uint8, saturating
+void quantize_descriptor(const float* d, int n, float scale, uchar* q);
+
+// L2 distance between two quantized descriptors, in quantized units
+double l2_distance_u8(const uchar* a, const uchar* b, int n);
+
+// Quantized version of l2_distance_bounded
+double l2_distance_u8_bounded(const uchar* a, const uchar* b, int n, int stage_size, double bound, int* stages);
+
+// quantize_plane, (weighted_)bin_histogram, bhattacharyya_distance and l2_distance(_u8)(_bounded) run the
+// SSE2/AVX2/AVX-512 implementation selected by active_simd_level() (CpuFeatures.hpp).
+// Every level returns exactly the same values as the scalar implementation.
+
+
+#endif /* HISTOGRAMKERNELS_HPP_ */
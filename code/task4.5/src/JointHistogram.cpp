@@ -0,0 +1,233 @@
+#include "JointHistogram.hpp"
+
+#include <math.h>
+
+using namespace std;
+using namespace cv;
+
+
+JointModel::JointModel() {
+
+    _bins = 0;
+    _total = 0;
+    _shift = 64;
+}
+
+
+// Bins per plane and the planes (indices into the bin plane vector) making up the joint bin
+void JointModel::configure(int bins, const vector<bool>& use_plane) {
+
+    CV_Assert(bins > 0 && bins <= 256);
+    _bins = bins;
+    _planes.clear();
+    for(size_t i = 0; i < use_plane.size(); i++){
+        if(use_plane[i]){
+            _planes.push_back((int)i);
+        }
+    }
+    CV_Assert(!_planes.empty());
+    _rows.resize(_planes.size());
+    _counts.clear();
+    _slots.clear();
+    _keys.clear();
+    _total = 0;
+}
+
+
+/* Model histogram
+* Counts the joint bins of box, each pixel adding one or its weight (row-major over box)
+* when weights is not NULL. Pixels with zero weight do not occupy a bin
+*/
+void JointModel::build(const vector<Mat>& bin_planes, Rect box, const float* weights) {
+
+    _counts.clear();
+    _total = 0;
+    _rehash(64);
+
+    for(int y = box.y; y < box.y + box.height; y++){
+        for(size_t k = 0; k < _planes.size(); k++){
+            _rows[k] = bin_planes[_planes[k]].ptr<uchar>(y);
+        }
+        const float* w = weights ? weights + (size_t)(y - box.y)*box.width : NULL;
+
+        for(int x = box.x; x < box.x + box.width; x++){
+            float value = w ? w[x - box.x] : 1.f;
+            bool valid;
+            uint64_t key = _key(_rows.data(), x, valid);
+            if(!valid || value <= 0){
+                continue;
+            }
+            int s = _slot(key);
+            if(_slots[s] < 0){
+                _slots[s] = (int)_counts.size();
+                _keys[s] = key;
+                _counts.push_back(0);
+            }
+            _counts[_slots[s]] += value;
+            _total += value;
+
+            // Keep the table at most half full
+            if(2*_counts.size() > _slots.size()){
+                _rehash(2*(int)_slots.size());
+            }
+        }
+    }
+}
+
+
+/* Index plane
+* Model index of the joint bin of every pixel of window, absent() when the model does not
+* have the bin and out_of_range() when a plane is out of range. indices has the size of the
+* bin planes and is only written inside window. Neighbouring pixels often share their bin,
+* so the last lookup is reused
+*/
+void JointModel::index_plane(const vector<Mat>& bin_planes, Rect window, Mat& indices) const {
+
+    indices.create(bin_planes[_planes[0]].size(), CV_32S);
+
+    for(int y = window.y; y < window.y + window.height; y++){
+        for(size_t k = 0; k < _planes.size(); k++){
+            _rows[k] = bin_planes[_planes[k]].ptr<uchar>(y);
+        }
+        int* out = indices.ptr<int>(y);
+        uint64_t last_key = 0;
+        int last_index = -1;
+
+        for(int x = window.x; x < window.x + window.width; x++){
+            bool valid;
+            uint64_t key = _key(_rows.data(), x, valid);
+            if(!valid){
+                out[x] = out_of_range();
+                continue;
+            }
+            if(last_index < 0 || key != last_key){
+                int s = _slot(key);
+                last_key = key;
+                last_index = _slots[s] >= 0 ? _slots[s] : absent();
+            }
+            out[x] = last_index;
+        }
+    }
+}
+
+
+/* Candidate histogram
+* size() + 2 counts of the indices of box: the model bins, absent() and out_of_range(),
+* each pixel adding one or its weight (row-major over box) when weights is not NULL
+*/
+void JointModel::histogram(const Mat& indices, Rect box, const float* weights, float* hist) const {
+
+    fill(hist, hist + size() + 2, 0.f);
+    for(int y = box.y; y < box.y + box.height; y++){
+        const int* row = indices.ptr<int>(y) + box.x;
+        if(weights){
+            const float* w = weights + (size_t)(y - box.y)*box.width;
+            for(int x = 0; x < box.width; x++){
+                hist[row[x]] += w[x];
+            }
+        }
+        else{
+            for(int x = 0; x < box.width; x++){
+                hist[row[x]] += 1.f;
+            }
+        }
+    }
+}
+
+
+/* Bhattacharyya distance
+* Same measure as compareHist(HISTCMP_BHATTACHARYYA) between the raw counts of the model and
+* a candidate histogram from histogram(). Only the model bins are visited: the candidate
+* total also takes the pixels that fell in bins the model does not have
+*/
+double JointModel::distance(const float* hist) const {
+
+    int n = size();
+    double coefficient = 0;
+    double total = hist[n];
+    for(int i = 0; i < n; i++){
+        coefficient += sqrt((double)hist[i]*_counts[i]);
+        total += hist[i];
+    }
+    if(total <= 0 || _total <= 0){
+        return 1;
+    }
+    return sqrt(max(1 - coefficient/sqrt(total*_total), 0.0));
+}
+
+
+// Occupied bins of the model
+int JointModel::size() const {
+    return (int)_counts.size();
+}
+
+
+// Index of the pixels whose joint bin is not in the model
+int JointModel::absent() const {
+    return size();
+}
+
+
+// Index of the pixels with a plane out of range
+int JointModel::out_of_range() const {
+    return size() + 1;
+}
+
+
+// Bins of the equivalent dense joint histogram
+double JointModel::dense_size() const {
+    return pow((double)_bins, (double)_planes.size());
+}
+
+
+// Joint key of pixel x of the given plane rows; invalid if any plane is out of range
+uint64_t JointModel::_key(const uchar* const* rows, int x, bool& valid) const {
+
+    uint64_t key = 0;
+    for(int k = (int)_planes.size() - 1; k >= 0; k--){
+        int b = rows[k][x];
+        if(b >= _bins){
+            valid = false;
+            return 0;
+        }
+        key = key*_bins + b;
+    }
+    valid = true;
+    return key;
+}
+
+
+// Slot holding key, or the empty slot where it would go (multiplicative hashing, linear probing)
+int JointModel::_slot(uint64_t key) const {
+
+    int mask = (int)_slots.size() - 1;
+    int s = (int)((key*0x9E3779B97F4A7C15ULL) >> _shift);
+    while(_slots[s] >= 0 && _keys[s] != key){
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+
+// Table of capacity slots (a power of two) holding the current model bins
+void JointModel::_rehash(int capacity) {
+
+    vector<uint64_t> keys;
+    vector<int> slots;
+    keys.swap(_keys);
+    slots.swap(_slots);
+
+    _keys.assign(capacity, 0);
+    _slots.assign(capacity, -1);
+    _shift = 64;
+    while((1 << (64 - _shift)) < capacity){
+        _shift--;
+    }
+    for(size_t s = 0; s < slots.size(); s++){
+        if(slots[s] >= 0){
+            int t = _slot(keys[s]);
+            _slots[t] = slots[s];
+            _keys[t] = keys[s];
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef PARTICLEFILTER_HPP_
+#define PARTICLEFILTER_HPP_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+// Hypothesis of the box center and its velocity in pixels per frame
+struct particle {
+    cv::Point2f center;
+    cv::Point2f velocity;
+    double weight;
+};
+
+/* Particle filter search
+* A fixed number of particles is propagated with a constant velocity model plus Gaussian
+* noise, weighted with the tracker distance of the box at each particle and resampled
+* (systematic resampling) every frame. The tracker evaluates exactly one candidate per
+* particle. The random generator is seeded, so runs are reproducible.
+*/
+class ParticleFilter {
+    private:
+        // variables
+        std::vector<particle> _particles;
+        std::vector<particle> _resampled;
+        cv::RNG _rng;
+        float _position_noise;
+        float _velocity_noise;
+        double _likelihood_sigma;
+        cv::Point2f _estimate;
+
+    public:
+        // Constructor
+        ParticleFilter();
+
+        // functions
+        void init(int num_particles, cv::Point2f center, float position_noise, uint64 seed = 0x5eed);
+        void predict(cv::Size box_size, cv::Size frame_size);
+        void update(const std::vector<double>& distances);
+        void hold();
+        cv::Rect box(int i, cv::Size box_size) const;
+        cv::Rect estimate_box(cv::Size box_size, cv::Size frame_size) const;
+        int size() const;
+};
+
+
+#endif /* PARTICLEFILTER_HPP_ */
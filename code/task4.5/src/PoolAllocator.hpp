@@ -0,0 +1,50 @@
+#ifndef POOLALLOCATOR_HPP_
+#define POOLALLOCATOR_HPP_
+
+#include <vector>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+
+struct pool_stats {
+    size_t hits;            // requests served from a cached buffer
+    size_t misses;          // requests that needed a new buffer
+    size_t bytes_in_use;    // bytes currently handed out to Mats
+    size_t bytes_cached;    // bytes kept in the free lists
+    size_t peak_bytes;      // peak of in use + cached bytes
+};
+
+/* Size-class pool for Mat buffers
+* Buffers of at least min_pooled_bytes are rounded up to a size class and kept
+* in a free list when released, so frame sized Mats reuse the same memory
+* across decode, tracking and encode. Smaller Mats go to the standard allocator.
+*/
+class PoolAllocator : public cv::MatAllocator {
+    private:
+        // variables
+        size_t _min_pooled_bytes;
+        size_t _max_cached_bytes;
+        mutable std::mutex _lock;
+        mutable std::vector< std::vector<uchar*> > _free_lists;
+        mutable pool_stats _stats;
+
+        // functions
+        static int _size_class(size_t bytes, size_t* class_bytes);
+
+    public:
+        // Constructor
+        PoolAllocator(size_t min_pooled_bytes = 64*1024, size_t max_cached_bytes = 256*1024*1024);
+        ~PoolAllocator();
+
+        // cv::MatAllocator interface
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+        bool allocate(cv::UMatData* u, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+        void deallocate(cv::UMatData* u) const;
+
+        // functions
+        pool_stats stats() const;
+        void release_cached();
+};
+
+
+#endif /* POOLALLOCATOR_HPP_ */
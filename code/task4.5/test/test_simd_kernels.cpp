@@ -0,0 +1,239 @@
+/* Dispatched kernel test
+* Forces every instruction set level this CPU supports with set_simd_level and checks the
+* dispatched kernels (HistogramKernels.hpp) on random inputs of awkward sizes: widths and
+* lengths that are not a multiple of any vector width, one pixel rows and unaligned ROIs.
+* Every level must give exactly the values of the scalar level, and the scalar level must
+* match OpenCV: calcHist for the bin planes and histograms, compareHist for the
+* Bhattacharyya distance and norm for the L2 distances. Weighted histograms have no OpenCV
+* counterpart and are checked against a double precision sum
+*/
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "CpuFeatures.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* kernel, simd_level level, int size, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s [%s] size %d: %.17g, expected %.17g\n", kernel, simd_level_name(level), size, got, expected);
+        }
+    }
+}
+
+
+// Sizes around every vector width (4, 8, 16, 32 and 64 lanes)
+static const int sizes[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 127, 128, 129, 255, 256, 257};
+static const int num_sizes = sizeof(sizes)/sizeof(sizes[0]);
+
+
+/* Bin planes and histograms
+* An unaligned ROI of a random plane is quantized with a lookup table that also has out of
+* range levels (hue style range 0-180). The bin plane and its histogram are compared with
+* the scalar level, and the histogram with calcHist of the ROI with the same bins and range
+*/
+static void test_histograms(const vector<simd_level>& levels, RNG& rng) {
+
+    int bin_counts[] = {7, 16, 64};
+    for(int b = 0; b < 3; b++){
+        int bins = bin_counts[b];
+        uchar lut[256];
+        build_bin_lut(bins, 0, 180, lut);
+
+        for(int s = 0; s < num_sizes; s++){
+            int width = sizes[s];
+            int height = 1 + s % 5;
+            Mat plane(height + 3, width + 5, CV_8U);
+            rng.fill(plane, RNG::UNIFORM, Scalar(0), Scalar(256));
+            Rect roi(3, 1, width, height);
+
+            // Reference: scalar kernels and calcHist
+            set_simd_level(SIMD_SCALAR);
+            Mat scalar_plane(plane.size(), CV_8U, Scalar(0));
+            vector<float> scalar_hist(bins);
+            quantize_plane(plane, roi, lut, scalar_plane);
+            bin_histogram(scalar_plane, roi, bins, scalar_hist.data());
+
+            Mat roi_plane = plane(roi), reference;
+            int channels[] = {0};
+            int hist_size[] = {bins};
+            float range[] = {0, 180};
+            const float* ranges[] = {range};
+            calcHist(&roi_plane, 1, channels, Mat(), reference, 1, hist_size, ranges);
+            for(int i = 0; i < bins; i++){
+                check(scalar_hist[i] == reference.at<float>(i), "bin_histogram vs calcHist", SIMD_SCALAR, width, scalar_hist[i], reference.at<float>(i));
+            }
+
+            for(size_t l = 0; l < levels.size(); l++){
+                set_simd_level(levels[l]);
+                Mat bin_plane(plane.size(), CV_8U, Scalar(0));
+                vector<float> hist(bins);
+                quantize_plane(plane, roi, lut, bin_plane);
+                bin_histogram(bin_plane, roi, bins, hist.data());
+                check(norm(bin_plane, scalar_plane, NORM_INF) == 0, "quantize_plane", levels[l], width, norm(bin_plane, scalar_plane, NORM_INF), 0);
+                for(int i = 0; i < bins; i++){
+                    check(hist[i] == scalar_hist[i], "bin_histogram", levels[l], width, hist[i], scalar_hist[i]);
+                }
+            }
+        }
+    }
+}
+
+
+/* Weighted histograms
+* Random planes and planes made of long runs of one bin (the uniform register path of the
+* SIMD levels), with random weights and unit weights. Every level must give the scalar
+* histogram, the scalar histogram must be within float rounding of a double precision sum,
+* and with unit weights it must equal bin_histogram
+*/
+static void test_weighted_histograms(const vector<simd_level>& levels, RNG& rng) {
+
+    int bins = 16;
+    uchar lut[256];
+    build_bin_lut(bins, 0, 180, lut);
+
+    for(int s = 0; s < num_sizes; s++){
+        int width = sizes[s];
+        int height = 1 + s % 5;
+        for(int pattern = 0; pattern < 2; pattern++){
+            Mat plane(height + 3, width + 5, CV_8U);
+            rng.fill(plane, RNG::UNIFORM, Scalar(0), Scalar(256));
+            if(pattern == 1){
+                for(int y = 0; y < plane.rows; y++){
+                    uchar* row = plane.ptr<uchar>(y);
+                    for(int x = 0; x < plane.cols; x++){
+                        row[x] = (uchar)(37*(y + x/70) % 200);
+                    }
+                }
+            }
+            Rect roi(3, 1, width, height);
+            Mat bin_plane(plane.size(), CV_8U, Scalar(0));
+            quantize_plane(plane, roi, lut, bin_plane);
+
+            Mat weights(height, width, CV_32F), ones(height, width, CV_32F, Scalar(1));
+            rng.fill(weights, RNG::UNIFORM, Scalar(0), Scalar(1));
+
+            set_simd_level(SIMD_SCALAR);
+            vector<float> scalar_hist(bins), unit_hist(bins), counts(bins);
+            weighted_bin_histogram(bin_plane, roi, bins, weights.ptr<float>(), scalar_hist.data());
+            weighted_bin_histogram(bin_plane, roi, bins, ones.ptr<float>(), unit_hist.data());
+            bin_histogram(bin_plane, roi, bins, counts.data());
+
+            vector<double> reference(bins, 0.0);
+            for(int y = 0; y < height; y++){
+                for(int x = 0; x < width; x++){
+                    uchar bin = bin_plane.at<uchar>(roi.y + y, roi.x + x);
+                    if(bin < bins){
+                        reference[bin] += weights.at<float>(y, x);
+                    }
+                }
+            }
+            for(int i = 0; i < bins; i++){
+                check(fabs(scalar_hist[i] - reference[i]) <= 1e-5*max(reference[i], 1.), "weighted_bin_histogram vs double sum", SIMD_SCALAR, width, scalar_hist[i], reference[i]);
+                check(unit_hist[i] == counts[i], "weighted_bin_histogram vs bin_histogram", SIMD_SCALAR, width, unit_hist[i], counts[i]);
+            }
+
+            for(size_t l = 0; l < levels.size(); l++){
+                set_simd_level(levels[l]);
+                vector<float> hist(bins);
+                weighted_bin_histogram(bin_plane, roi, bins, weights.ptr<float>(), hist.data());
+                for(int i = 0; i < bins; i++){
+                    check(hist[i] == scalar_hist[i], "weighted_bin_histogram", levels[l], width, hist[i], scalar_hist[i]);
+                }
+            }
+        }
+    }
+}
+
+
+/* Distances
+* Random histograms and descriptors of every length, plus identical and disjoint histograms
+* where the Bhattacharyya distance is 0 and 1. Bounded distances are checked with a bound
+* that stops them halfway, for the value and the number of stages
+*/
+static void test_distances(const vector<simd_level>& levels, RNG& rng) {
+
+    for(int s = 0; s < num_sizes; s++){
+        int n = sizes[s];
+        for(int pattern = 0; pattern < 3; pattern++){
+            Mat h1(n, 1, CV_32F), h2(n, 1, CV_32F);
+            rng.fill(h1, RNG::UNIFORM, Scalar(0), Scalar(100));
+            rng.fill(h2, RNG::UNIFORM, Scalar(0), Scalar(100));
+            if(pattern == 1){
+                h1.copyTo(h2);
+            }
+            if(pattern == 2 && n > 1){
+                h1.rowRange(0, n/2).setTo(Scalar(0));
+                h2.rowRange(n/2, n).setTo(Scalar(0));
+            }
+            Mat q1(n, 1, CV_8U), q2(n, 1, CV_8U);
+            rng.fill(q1, RNG::UNIFORM, Scalar(0), Scalar(256));
+            rng.fill(q2, RNG::UNIFORM, Scalar(0), Scalar(256));
+            const float* a = h1.ptr<float>();
+            const float* b = h2.ptr<float>();
+            const uchar* qa = q1.ptr<uchar>();
+            const uchar* qb = q2.ptr<uchar>();
+
+            set_simd_level(SIMD_SCALAR);
+            double bhattacharyya = bhattacharyya_distance(a, b, n);
+            double l2 = l2_distance(a, b, n);
+            double l2_u8 = l2_distance_u8(qa, qb, n);
+            int stage_size = max(n/4, 1), stages, stages_u8;
+            double bounded = l2_distance_bounded(a, b, n, stage_size, l2/2, &stages);
+            double bounded_u8 = l2_distance_u8_bounded(qa, qb, n, stage_size, l2_u8/2, &stages_u8);
+
+            double reference = compareHist(h1, h2, HISTCMP_BHATTACHARYYA);
+            check(fabs(bhattacharyya - reference) <= 1e-6, "bhattacharyya_distance vs compareHist", SIMD_SCALAR, n, bhattacharyya, reference);
+            reference = norm(h1, h2, NORM_L2);
+            check(fabs(l2 - reference) <= 1e-5*max(reference, 1.), "l2_distance vs norm", SIMD_SCALAR, n, l2, reference);
+            reference = norm(q1, q2, NORM_L2);
+            check(fabs(l2_u8 - reference) <= 1e-9*max(reference, 1.), "l2_distance_u8 vs norm", SIMD_SCALAR, n, l2_u8, reference);
+
+            for(size_t l = 0; l < levels.size(); l++){
+                set_simd_level(levels[l]);
+                int level_stages, level_stages_u8;
+                double value = bhattacharyya_distance(a, b, n);
+                check(value == bhattacharyya, "bhattacharyya_distance", levels[l], n, value, bhattacharyya);
+                value = l2_distance(a, b, n);
+                check(value == l2, "l2_distance", levels[l], n, value, l2);
+                value = l2_distance_u8(qa, qb, n);
+                check(value == l2_u8, "l2_distance_u8", levels[l], n, value, l2_u8);
+                value = l2_distance_bounded(a, b, n, stage_size, l2/2, &level_stages);
+                check(value == bounded && level_stages == stages, "l2_distance_bounded", levels[l], n, value, bounded);
+                value = l2_distance_u8_bounded(qa, qb, n, stage_size, l2_u8/2, &level_stages_u8);
+                check(value == bounded_u8 && level_stages_u8 == stages_u8, "l2_distance_u8_bounded", levels[l], n, value, bounded_u8);
+            }
+        }
+    }
+}
+
+
+int main() {
+
+    simd_level initial = active_simd_level();
+    vector<simd_level> levels;
+    for(int level = SIMD_SCALAR; level <= detected_simd_level(); level++){
+        levels.push_back((simd_level)level);
+    }
+    printf("Testing levels up to %s\n", simd_level_name(detected_simd_level()));
+
+    RNG rng(0x5eed);
+    test_histograms(levels, rng);
+    test_weighted_histograms(levels, rng);
+    test_distances(levels, rng);
+    set_simd_level(initial);
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -11,6 +11,32 @@ FusionTracker::FusionTracker(Rect gt, int in_levels, int in_step, int cbins, vec
     _model.box = gt;                                                            
     candidate_levels = in_levels;                                                              
     candidate_step = in_step;
+    scale_step = 1;
+    num_particles = 0;
+    particle_noise = 4;
+    static_threshold = 0;
+    max_samples = 0;
+    cache_blocks = false;
+    lut_hog = false;
+    kernel_weights = false;
+    joint_histogram = false;
+    hog_pixels = 0;
+    quantize_hog = false;
+    check_quantization = false;
+    pca_components = 0;
+    _quantization_scale = 1;
+    _quantize_stats.distances = 0;
+    _quantize_stats.error_sum = 0;
+    _quantize_stats.max_error = 0;
+    _quantize_stats.frames = 0;
+    _quantize_stats.argmin_agree = 0;
+    _lut_deviation = 0;
+    _cache_window = Rect(0, 0, 0, 0);
+    _cache_stats.lookups = 0;
+    _cache_stats.hits = 0;
+    _cache_stats.blocks = 0;
+    _cache_stats.dirty_blocks = 0;
+    _use_integral_histograms = false;
     _model_initialized = false;
     
     if(cbins>0){
@@ -24,12 +50,47 @@ FusionTracker::FusionTracker(Rect gt, int in_levels, int in_step, int cbins, vec
 
     if(gbins>0){
         _hog_descriptor.nbins = gbins;
+        _lut_hog.configure(_hog_descriptor);
         _gradtrack = true;
 
     }
     else{
         _gradtrack = false;
     }
+
+    // Buffers are sized once here and reused on every frame
+    int max_candidates = (2*candidate_levels+1)*(2*candidate_levels+1);
+    frame_candidates.boxes.reserve(max_candidates);
+    frame_candidates.color_scores.reserve(max_candidates);
+    frame_candidates.gradient_scores.reserve(max_candidates);
+    _fusion_scores.reserve(max_candidates);
+    _exact_scores.reserve(max_candidates);
+    _offsets.reserve(max_candidates);
+    _scales.reserve(3);
+
+    if(_colortrack){
+        _color_spaces.resize(6);
+        _bin_planes.resize(6);
+        _previous_bin_planes.resize(6);
+        _integral_histograms.resize(6);
+        _model.histograms.resize(6);
+        _hist_candidate.create(color_bins, 1, CV_32F);
+        _scores.reserve(6);
+        _bgr_planes.resize(3);
+        _hsv_planes.resize(3);
+        for(int i = 0;i < 6; i++){
+            if(i==3){
+                build_bin_lut(color_bins, 0, 180, _bin_luts[i]);
+            }
+            else{
+                build_bin_lut(color_bins, 0, 256, _bin_luts[i]);
+            }
+        }
+    }
+
+    if(_gradtrack){
+        _temp_descriptors.reserve(_hog_descriptor.getDescriptorSize());
+    }
 }
 
 
@@ -37,26 +98,108 @@ FusionTracker::FusionTracker(Rect gt, int in_levels, int in_step, int cbins, vec
 /* Track
 * Normalices distances between target and candidates for both color and gradient trackers if activated 
 * Searches for the candidate closest to the target and return its bounding box
+* In particle mode the fused distances weight the particles and the box is centered on their weighted mean
 */
 Rect FusionTracker::track(Mat frame) {
+    return track(frame, 0);
+}
+
+
+/* Track within a time budget
+* With budget_ms > 0 the candidates are evaluated from the predicted position outwards
+* in rings and the search stops at the deadline, returning the best candidate so far.
+* In multi-scale search with HOG the deadline is checked between scales; particle mode
+* always evaluates every particle.
+* Frames whose search window is unchanged since the last tracked frame (static_threshold > 0)
+* keep the previous box and are not counted by the budget; particles keep their centers
+* with zero velocity
+*/
+Rect FusionTracker::track(Mat frame, double budget_ms) {
     
+    bool first_frame = !_model_initialized;
+
+    // An unchanged window gives the same candidates and scores as the last tracked frame
+    _gate.threshold = static_threshold;
+    if(_gate.unchanged(frame, _search_window(frame.size()))){
+        if(num_particles > 0 && !first_frame){
+            _particle_filter.hold();
+        }
+        return _model.box;
+    }
+
+    _budget.start(budget_ms);
     _generate_candidates(frame);
-    vector<double> fusion_scores;
 
     if(_colortrack){normalize(frame_candidates.color_scores, frame_candidates.color_scores, 0, 1, NORM_MINMAX, -1, Mat() );}
     if(_gradtrack == false){normalize(frame_candidates.gradient_scores, frame_candidates.gradient_scores, 0, 1, NORM_MINMAX, -1, Mat() );}
     
     if(_colortrack&&_gradtrack){
-        add(frame_candidates.color_scores, frame_candidates.gradient_scores, fusion_scores);
+        add(frame_candidates.color_scores, frame_candidates.gradient_scores, _fusion_scores);
     }
     else{
-        if(_colortrack){fusion_scores = frame_candidates.color_scores;}
-        if(_gradtrack){fusion_scores = frame_candidates.gradient_scores;}
+        if(_colortrack){_fusion_scores = frame_candidates.color_scores;}
+        if(_gradtrack){_fusion_scores = frame_candidates.gradient_scores;}
+    }
+
+    if(num_particles > 0 && !first_frame){
+        _particle_filter.update(_fusion_scores);
+        _model.box = _particle_filter.estimate_box(_model.box.size(), frame.size());
     }
+    else{
+        int idx = min_element(_fusion_scores.begin(),_fusion_scores.end()) - _fusion_scores.begin();
+        _model.box = frame_candidates.boxes[idx];
+        if(_quantized() && check_quantization){
+            _record_argmin(idx);
+        }
+    }
+
+    int planned = (int)frame_candidates.boxes.size();
+    if(!first_frame && num_particles == 0){
+        planned = (int)(_offsets.size()*_candidate_scales().size());
+    }
+    _budget.finish((int)frame_candidates.boxes.size(), planned);
+    return _model.box;
+}
+
+
+// Candidates evaluated and deadline overruns of the frames tracked with a budget
+const budget_stats& FusionTracker::get_budget_stats() const {
+    return _budget.stats();
+}
+
+
+// Frames checked by the static region gate and frames that reused the previous box
+const gate_stats& FusionTracker::get_gate_stats() const {
+    return _gate.stats();
+}
 
-    int idx = min_element(fusion_scores.begin(),fusion_scores.end()) - fusion_scores.begin();
-    _model.box = frame_candidates.boxes[idx];
-    return frame_candidates.boxes[idx];
+
+// Candidate features served from the previous frame and changed blocks of the search windows
+const cache_stats& FusionTracker::get_cache_stats() const {
+    return _cache_stats;
+}
+
+
+// Relative error of the quantized distances checked against the float ones (check_quantization only)
+const quantize_stats& FusionTracker::get_quantize_stats() const {
+    return _quantize_stats;
+}
+
+
+const JointModel& FusionTracker::get_joint_model() const {
+    return _joint_model;
+}
+
+
+// Size every candidate is resized to before its HOG is computed
+Size FusionTracker::get_hog_window() const {
+    return _hog_descriptor.winSize;
+}
+
+
+// Relative L2 difference between the LUT and the OpenCV descriptors of the model (lut_hog only)
+float FusionTracker::get_lut_deviation() const {
+    return _lut_deviation;
 }
 
 
@@ -68,80 +211,382 @@ Rect FusionTracker::track(Mat frame) {
 */
 void FusionTracker::_generate_candidates(Mat frame) {
 
-    Mat mask = Mat::zeros(frame.rows, frame.cols, CV_8U);
-
     frame_candidates.boxes.clear();
     frame_candidates.color_scores.clear();
     frame_candidates.gradient_scores.clear();
+    _exact_scores.clear();
 
     if(_colortrack){
-        _color_spaces.clear();
         _get_color_space(frame);
     }
 
-    if(_gradtrack){cvtColor(frame, frame, CV_BGR2GRAY);}
-    int numCandidates = 0; 
+    if(_gradtrack){
+        cvtColor(frame, _gray, CV_BGR2GRAY);
+        frame = _gray;
+    }
     
     if(!_model_initialized){
         _model_initialized = true;
-        _init_model(frame,mask);
+        if(_colortrack){_quantize_color_spaces(_model.box);}
+        _init_model(frame);
+        if(_block_cache()){
+            _reserve_cache(frame);
+        }
+        if(num_particles > 0){
+            _particle_filter.init(num_particles, Point2f(_model.box.x + _model.box.width/2.f, _model.box.y + _model.box.height/2.f), particle_noise);
+        }
+    }
+
+    else if(num_particles > 0){
+        _particle_search(frame);
     }
 
     else{
+        Rect window = _search_window(frame.size());
+        const vector<double>& scales = _candidate_scales();
+        if(_block_cache()){
+            _cache_frame(frame, window);
+        }
+        else if(_colortrack){
+            _quantize_color_spaces(window);
+        }
+
+        // Candidates of every scale share the integral histograms of the window, unless they
+        // would take more than INTEGRAL_HISTOGRAM_BUDGET; the candidates are then counted one by one
+        _window_origin = window.tl();
+        _use_integral_histograms = _colortrack && scales.size() > 1 && !kernel_weights && !joint_histogram
+                                  && _integral_histograms_bytes(window.size()) <= INTEGRAL_HISTOGRAM_BUDGET;
+        if(_use_integral_histograms){
+            for(int i = 0;i < 6; i++){
+                if(_track_type[i]){
+                    integral_histogram(_bin_planes[i], window, color_bins, _integral_histograms[i]);
+                }
+            }
+        }
+        else{
+            for(int i = 0;i < 6; i++){
+                _integral_histograms[i].release();
+            }
+        }
         
-        int initialValue = -candidate_levels*candidate_step;
-        int finalValue = candidate_levels*candidate_step;
-        for (int ix = initialValue; ix <= finalValue; ix = ix + candidate_step){
-            for (int iy = initialValue; iy <= finalValue; iy = iy + candidate_step){
-                int x = _model.box.x + ix;
-                int y = _model.box.y + iy;
-
-                if( (x>=0) && (y>=0) && ( (x+_model.box.width) <= frame.cols ) && ( (y+_model.box.height)<=frame.rows ) ){
-                    Rect candidate_box = Rect(x,y,_model.box.width,_model.box.height);                   
+        grid_offsets(candidate_levels, candidate_step, _budget.active() ? GRID_RINGS : GRID_RASTER, _offsets);
+        for (size_t s = 0; s < scales.size() && !_budget.expired(frame_candidates.boxes.size()); s++){
+            Rect base_box = _scaled_box(scales[s]);
+            size_t first = frame_candidates.boxes.size();
+
+            for (size_t k = 0; k < _offsets.size(); k++){
+
+                // HOG scores all candidates of a scale in one pass, then only the scale loop stops
+                if(!(_gradtrack && scales.size() > 1) && _budget.expired(frame_candidates.boxes.size())){
+                    break;
+                }
+
+                int x = base_box.x + _offsets[k].x;
+                int y = base_box.y + _offsets[k].y;
+
+                if( (x>=0) && (y>=0) && ( (x+base_box.width) <= frame.cols ) && ( (y+base_box.height)<=frame.rows ) ){
+                    Rect candidate_box = Rect(x,y,base_box.width,base_box.height);                   
                     frame_candidates.boxes.push_back(candidate_box);
-                    if(_colortrack){frame_candidates.color_scores.push_back(_get_color_distance(mask, candidate_box));}
-                    if(_gradtrack){frame_candidates.gradient_scores.push_back(_get_gradient_distance(frame,candidate_box));}
+                    if(_colortrack){frame_candidates.color_scores.push_back(_get_color_distance(candidate_box));}
+                    if(_gradtrack && scales.size() == 1){frame_candidates.gradient_scores.push_back(_get_gradient_distance(frame,candidate_box));}
                 }
             }
+
+            if(_gradtrack && scales.size() > 1){
+                _get_gradient_scale_distances(frame, first);
+            }
         }
     }  
 }
 
 
+/* Particle search
+* One candidate per particle, at the current box size. Colors are quantized only over
+* the region spanned by the particles
+*/
+void FusionTracker::_particle_search(Mat frame) {
+
+    _particle_filter.predict(_model.box.size(), frame.size());
+
+    Rect window = _particle_filter.box(0, _model.box.size());
+    for(int i = 0; i < _particle_filter.size(); i++){
+        Rect candidate_box = _particle_filter.box(i, _model.box.size());
+        frame_candidates.boxes.push_back(candidate_box);
+        window |= candidate_box;
+    }
+
+    if(_colortrack){_quantize_color_spaces(window);}
+    _use_integral_histograms = false;
+
+    for(size_t i = 0; i < frame_candidates.boxes.size(); i++){
+        Rect candidate_box = frame_candidates.boxes[i];
+        if(_colortrack){frame_candidates.color_scores.push_back(_get_color_distance(candidate_box));}
+        if(_gradtrack){frame_candidates.gradient_scores.push_back(_get_gradient_distance(frame,candidate_box));}
+    }
+}
+
+
+/* Block cache
+* Only for single scale search on the candidate grid. Color histograms are cached as exact
+* counts (every pixel counted) and HOG distances as values of unchanged boxes
+*/
+bool FusionTracker::_block_cache() {
+    return cache_blocks && num_particles == 0 && scale_step <= 1;
+}
+
+
+/* Cache buffers
+* Sized on the first frame like the other buffers: the previous bin planes and a cached
+* histogram per channel for every grid candidate (color), a frame sized gray reference and a
+* distance per grid candidate (HOG), the dirty blocks of any window and the dirty parts of a box
+*/
+void FusionTracker::_reserve_cache(Mat frame) {
+
+    int grid = (2*candidate_levels+1)*(2*candidate_levels+1);
+    if(_colortrack){
+        int channels = 0;
+        for(int i = 0;i < 6; i++){
+            if(_track_type[i]){
+                _previous_bin_planes[i].create(frame.size(), CV_8U);
+                channels++;
+            }
+        }
+        _color_blocks.reserve(frame.size());
+        _dirty_regions.reserve((_model.box.width/8 + 2)*(_model.box.height/8 + 2));
+        _histogram_cache.reserve(grid*channels, vector<float>(color_bins));
+    }
+    if(_gradtrack){
+        _cache_reference.create(frame.size(), frame.type());
+        _gray_blocks.reserve(frame.size());
+        _distance_cache.reserve(grid, 0.f);
+    }
+}
+
+
+/* Cached frame
+* Quantizes the window while keeping the bin planes of the last tracked frame and marks the
+* 8x8 blocks where a tracked channel changed bin (color) or a gray level changed (HOG), the
+* gray window being kept in place in a frame sized reference. Blocks outside the previous
+* window are unknown and count as changed
+*/
+void FusionTracker::_cache_frame(Mat frame, Rect window) {
+
+    _histogram_cache.next_frame();
+    _distance_cache.next_frame();
+
+    if(_colortrack){
+        for(int i = 0;i < 6; i++){
+            if(_track_type[i]){
+                swap(_bin_planes[i], _previous_bin_planes[i]);
+            }
+        }
+        _quantize_color_spaces(window);
+        _color_blocks.reset(window, _cache_window);
+        for(int i = 0;i < 6; i++){
+            if(_track_type[i] && !_previous_bin_planes[i].empty()){
+                _color_blocks.compare(_bin_planes[i], _previous_bin_planes[i], Point(0, 0));
+            }
+        }
+        _cache_stats.blocks += _color_blocks.blocks();
+        _cache_stats.dirty_blocks += _color_blocks.dirty();
+    }
+
+    if(_gradtrack){
+        _gray_blocks.reset(window, _cache_window);
+        _cache_reference.create(frame.size(), frame.type());
+        _gray_blocks.compare(frame, _cache_reference, Point(0, 0));
+        frame(window).copyTo(_cache_reference(window));
+        _cache_stats.blocks += _gray_blocks.blocks();
+        _cache_stats.dirty_blocks += _gray_blocks.dirty();
+    }
+    _cache_window = window;
+}
+
+
+/* Cached histogram
+* A candidate already scored in the last tracked frame takes its counts from then and only
+* recounts the pixels of its dirty blocks; any other candidate is counted and stored
+*/
+void FusionTracker::_cached_histogram(int channel, Rect candidate_box, float* hist) {
+
+    uint64_t key = box_key(candidate_box, channel);
+    bool stale = false;
+    vector<float>* entry = _histogram_cache.find(key, stale);
+    _cache_stats.lookups++;
+
+    if(entry && !stale){
+        _cache_stats.hits++;
+    }
+    else if(entry && _color_blocks.regions(candidate_box, _dirty_regions)){
+        for(size_t r = 0; r < _dirty_regions.size(); r++){
+            update_histogram(entry->data(), color_bins, _previous_bin_planes[channel], _bin_planes[channel], _dirty_regions[r]);
+        }
+        _cache_stats.hits++;
+    }
+    else{
+        if(!entry){
+            entry = &_histogram_cache.insert(key);
+        }
+        entry->resize(color_bins);
+        bin_histogram(_bin_planes[channel], candidate_box, color_bins, entry->data());
+    }
+    memcpy(hist, entry->data(), color_bins*sizeof(float));
+}
+
+
+// Region covered by all candidates of the current frame, at the largest scale
+Rect FusionTracker::_search_window(Size frame_size) {
+
+    const vector<double>& scales = _candidate_scales();
+    Rect box = _scaled_box(*max_element(scales.begin(), scales.end()));
+    int margin = candidate_levels*candidate_step;
+    Rect window(box.x - margin, box.y - margin, box.width + 2*margin, box.height + 2*margin);
+    return window & Rect(0, 0, frame_size.width, frame_size.height);
+}
+
+
+/* Candidate scales
+* With scale_step > 1 the box is also tested shrunk and grown by scale_step; the current
+* size comes first so it wins ties
+*/
+const vector<double>& FusionTracker::_candidate_scales() {
+
+    _scales.assign(1, 1.);
+    if(scale_step > 1){
+        _scales.push_back(1./scale_step);
+        _scales.push_back(scale_step);
+    }
+    return _scales;
+}
+
+
+// Model box resized by scale around its center, never below 8x8 pixels
+Rect FusionTracker::_scaled_box(double scale) {
+
+    int width = max(cvRound(_model.box.width*scale), min(_model.box.width, 8));
+    int height = max(cvRound(_model.box.height*scale), min(_model.box.height, 8));
+    return Rect(_model.box.x + (_model.box.width - width)/2, _model.box.y + (_model.box.height - height)/2, width, height);
+}
+
+
+// Memory of the integral histograms of window, one per tracked channel
+size_t FusionTracker::_integral_histograms_bytes(Size window) {
+
+    return integral_histogram_bytes(window, color_bins)*count(_track_type.begin(), _track_type.end(), true);
+}
+
+
+/* HOG pyramid level
+* Candidates from first on have the same size: the region they cover is resized once to
+* the HOG scale of that size and one HOG pass computes every candidate descriptor at its
+* location, computing the gradients of the region once. The LUT kernel also computes each
+* block once for candidates whose blocks coincide; OpenCV's HOG recomputes the blocks of
+* every location
+*/
+void FusionTracker::_get_gradient_scale_distances(Mat frame, size_t first) {
+
+    vector<Rect>& boxes = frame_candidates.boxes;
+    if(first == boxes.size()){
+        return;
+    }
+
+    Rect region = boxes[first];
+    for(size_t k = first + 1; k < boxes.size(); k++){
+        region |= boxes[k];
+    }
+
+    Size window = _hog_descriptor.winSize;
+    double fx = (double)window.width/boxes[first].width;
+    double fy = (double)window.height/boxes[first].height;
+    Size level_size(max(cvRound(region.width*fx), window.width), max(cvRound(region.height*fy), window.height));
+    resize(frame(region), _pyramid_level, level_size);
+
+    _locations.clear();
+    for(size_t k = first; k < boxes.size(); k++){
+        int x = min(cvRound((boxes[k].x - region.x)*fx), level_size.width - window.width);
+        int y = min(cvRound((boxes[k].y - region.y)*fy), level_size.height - window.height);
+        _locations.push_back(Point(x, y));
+    }
+
+    int descriptor_size = (int)_model.descriptors.size();
+    if(_quantized()){
+        _compute_quantized_hog(_pyramid_level, _locations);
+        if(check_quantization){
+            _compute_hog(_pyramid_level, _temp_descriptors, _locations);
+        }
+        for(size_t k = 0; k < _locations.size(); k++){
+            float distance = (float)(l2_distance_u8(_temp_quantized.data() + k*descriptor_size, _model_quantized.data(), descriptor_size)/_quantization_scale);
+            if(check_quantization){
+                _record_quantization(distance, l2_distance(_temp_descriptors.data() + k*descriptor_size, _model.descriptors.data(), descriptor_size));
+            }
+            frame_candidates.gradient_scores.push_back(distance);
+        }
+        return;
+    }
+
+    _compute_hog(_pyramid_level, _temp_descriptors, _locations);
+
+    for(size_t k = 0; k < _locations.size(); k++){
+        const float* descriptor = _temp_descriptors.data() + k*descriptor_size;
+        frame_candidates.gradient_scores.push_back(l2_distance(descriptor, _model.descriptors.data(), descriptor_size));
+    }
+}
+
+
+// Converts the tracked color channels inside window into bin index planes, once per frame
+void FusionTracker::_quantize_color_spaces(Rect window) {
+
+    for(int i = 0;i < 6; i++){
+        if(_track_type[i]){
+            quantize_plane(_color_spaces[i], window, _bin_luts[i], _bin_planes[i]);
+        }
+    }
+    if(_joint() && !_joint_hist.empty()){
+        _joint_model.index_plane(_bin_planes, window, _joint_indices);
+    }
+}
+
+
 /* Color histogram tracking
 * Obtains the histogram of one candidate according to the specified channel in track type 
 * Computes the Battacharyya distance between target and candidate histogram
 * If more than one color channel is specified, the difference distances are mixed using L2 distance
+* Histograms are computed over the candidate region only, in buffers owned by the tracker,
+* from at most max_samples pixels of it when max_samples > 0, or from all of them weighted by
+* the Epanechnikov kernel of the box with kernel_weights.
+* With joint_histogram a single distance between the sparse joint histograms of the tracked
+* channels replaces the L2 mix, counted from the model index plane of the window
 */
-float FusionTracker::_get_color_distance(Mat mask,Rect candidate_box) {
+float FusionTracker::_get_color_distance(Rect candidate_box) {
     
-    Mat hist_candidate;
-    vector<double> scores;
-    double score;
-    mask(candidate_box) = 1;
-
-    float bgrsRanges[] = {0,256};
-    float hRanges[] = {0,180};
-    const float* bgrs_histRange = { bgrsRanges };
-    const float* h_histRange = { hRanges };
-    bool uniform = true, accumulate = false;
-    int nimages = 1,  dimensions = 1;
+    if(_joint()){
+        _joint_model.histogram(_joint_indices, candidate_box, kernel_weights ? _kernel_table(candidate_box.size()) : NULL, _joint_hist.data());
+        return (float)_joint_model.distance(_joint_hist.data());
+    }
+
+    float* hist_candidate = _hist_candidate.ptr<float>();
+    _scores.clear();
 
     for(int i = 0;i < 6; i++){   
 
         if(_track_type[i]){
-            if(i==3){
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist_candidate, dimensions, &color_bins, &h_histRange, uniform, accumulate );
+            if(kernel_weights){
+                weighted_bin_histogram(_bin_planes[i], candidate_box, color_bins, _kernel_table(candidate_box.size()), hist_candidate);
+            }
+            else if(_use_integral_histograms){
+                integral_histogram_box(_integral_histograms[i], candidate_box - _window_origin, color_bins, hist_candidate);
+            }
+            else if(_block_cache() && max_samples <= 0){
+                _cached_histogram(i, candidate_box, hist_candidate);
             }
             else{
-                calcHist( &_color_spaces[i], nimages, 0, mask, hist_candidate, dimensions, &color_bins, &bgrs_histRange, uniform, accumulate );
+                sampled_bin_histogram(_bin_planes[i], candidate_box, color_bins, sample_stride(candidate_box.size(), max_samples), hist_candidate);
             }
-            normalize(hist_candidate, hist_candidate, 1, 100, NORM_MINMAX, -1, Mat() );      
-            score = compareHist(hist_candidate, _model.histograms[i],3);
-            scores.push_back(score);
+            normalize_histogram(hist_candidate, color_bins, 1, 100);
+            _scores.push_back(bhattacharyya_distance(hist_candidate, _model.histograms[i].ptr<float>(), color_bins));
         }            
     }   
-    return norm(scores, NORM_L2); 
+    return norm(_scores, NORM_L2); 
 }
 
 
@@ -149,61 +594,266 @@ float FusionTracker::_get_color_distance(Mat mask,Rect candidate_box) {
 /* HOG tracking
 * Obtains the HOG of one candidate according to grayscale 
 * Computes the L2 distance between target and candidate histogram
+* The candidate is resized straight from the frame into a buffer owned by the tracker
 */
 float FusionTracker::_get_gradient_distance(Mat frame,Rect candidate_box){
+
+    // The descriptor only depends on the pixels of the box, so a box without changed blocks keeps its distance
+    uint64_t key = box_key(candidate_box);
+    if(_block_cache()){
+        bool stale = false;
+        float* cached = _distance_cache.find(key, stale);
+        _cache_stats.lookups++;
+        if(cached && (!stale || _gray_blocks.clean(candidate_box))){
+            _cache_stats.hits++;
+            return *cached;
+        }
+    }
     
-    Mat croped_frame;
-    vector<float> temp_descriptors;
-    frame(candidate_box).copyTo(croped_frame);
-    resize(croped_frame,croped_frame,Size(64,128));
-    _hog_descriptor.compute(croped_frame, temp_descriptors);
-    return norm(temp_descriptors, _model.descriptors,NORM_L2);
+    resize(frame(candidate_box),_resized,_hog_descriptor.winSize);
+    int n = (int)_model.descriptors.size();
+    float distance;
+    if(_quantized()){
+        _compute_quantized_hog(_resized, vector<Point>());
+        distance = (float)(l2_distance_u8(_temp_quantized.data(), _model_quantized.data(), n)/_quantization_scale);
+        if(check_quantization){
+            _compute_hog(_resized, _temp_descriptors, vector<Point>());
+            _record_quantization(distance, l2_distance(_temp_descriptors.data(), _model.descriptors.data(), n));
+        }
+    }
+    else{
+        _compute_hog(_resized, _temp_descriptors, vector<Point>());
+        distance = l2_distance(_temp_descriptors.data(), _model.descriptors.data(), n);
+    }
+    if(_block_cache()){
+        _distance_cache.insert(key) = distance;
+    }
+    return distance;
+}
+
+
+
+/* HOG descriptors
+* Descriptors of the windows at locations (the whole image with none), from OpenCV or
+* from the LUT gradient kernel with the same geometry and bins
+*/
+void FusionTracker::_compute_hog(const Mat& image, vector<float>& descriptors, const vector<Point>& locations){
+
+    // Reduced descriptors: the LUT kernel projects block by block, OpenCV's descriptors are projected afterwards
+    if(!_projection.empty()){
+        if(lut_hog){
+            _lut_hog.compute(image, _projection, descriptors, locations);
+        }
+        else{
+            _hog_descriptor.compute(image, _full_descriptors, Size(), Size(), locations);
+            int windows = max((int)locations.size(), 1);
+            descriptors.resize(windows*_projection.rows);
+            Mat projected(windows, _projection.rows, CV_32F, descriptors.data());
+            gemm(Mat(windows, _projection.cols, CV_32F, _full_descriptors.data()), _projection, 1, noArray(), 0, projected, GEMM_2_T);
+        }
+        return;
+    }
+
+    if(lut_hog){
+        _lut_hog.compute(image, descriptors, locations);
+    }
+    else{
+        _hog_descriptor.compute(image, descriptors, Size(), Size(), locations);
+    }
 }
 
 
+/* PCA projection
+* Fits pca_components principal axes to the HOG descriptors of the model box shifted on a
+* 9x9 grid of up to an eighth of its size, at its size and scaled by 0.95 and 1.05, so the
+* reduced space keeps the directions in which the target varies around its position.
+* From then on every descriptor, the model's included, is computed projected.
+*/
+void FusionTracker::_fit_projection(Mat frame){
+
+    Rect bounds(0, 0, frame.cols, frame.rows);
+    Size step(max(_model.box.width/32, 1), max(_model.box.height/32, 1));
+    Point center(_model.box.x + _model.box.width/2, _model.box.y + _model.box.height/2);
+    double scales[3] = {1, 0.95, 1.05};
+
+    vector<Rect> boxes;
+    for(int s = 0; s < 3; s++){
+        Size size(cvRound(_model.box.width*scales[s]), cvRound(_model.box.height*scales[s]));
+        for(int dy = -4; dy <= 4; dy++){
+            for(int dx = -4; dx <= 4; dx++){
+                Rect box(center.x - size.width/2 + dx*step.width, center.y - size.height/2 + dy*step.height, size.width, size.height);
+                if(box.area() > 0 && (box & bounds) == box){
+                    boxes.push_back(box);
+                }
+            }
+        }
+    }
+    // A single sample has no variance to keep
+    if(boxes.size() < 2){
+        return;
+    }
+
+    int n = (int)_model.descriptors.size();
+    _pca_samples.create((int)boxes.size(), n, CV_32F);
+    for(size_t k = 0; k < boxes.size(); k++){
+        resize(frame(boxes[k]), _resized, _hog_descriptor.winSize);
+        _compute_hog(_resized, _temp_descriptors, vector<Point>());
+        std::copy(_temp_descriptors.begin(), _temp_descriptors.end(), _pca_samples.ptr<float>((int)k));
+    }
+
+    PCA pca(_pca_samples, noArray(), PCA::DATA_AS_ROW, min(pca_components, _pca_samples.rows));
+    _projection = pca.eigenvectors;
+
+    resize(frame(_model.box), _resized, _hog_descriptor.winSize);
+    _compute_hog(_resized, _model.descriptors, vector<Point>());
+}
+
+
+// Quantized descriptors are only used for the full HOG, the reduced one stays float
+bool FusionTracker::_quantized(){
+    return quantize_hog && pca_components <= 0;
+}
+
+
+/* Kernel table
+* Epanechnikov weights of a box size, built the first time a box of that size is scored and
+* shared by every later candidate of the same size. Multi-scale search uses a handful of
+* sizes; the tables are dropped if many more appear
+*/
+const float* FusionTracker::_kernel_table(Size box) {
+
+    for(size_t k = 0; k < _kernel_tables.size(); k++){
+        if(_kernel_tables[k].cols == box.width && _kernel_tables[k].rows == box.height){
+            return _kernel_tables[k].ptr<float>();
+        }
+    }
+    if(_kernel_tables.size() >= 16){
+        _kernel_tables.clear();
+    }
+    _kernel_tables.push_back(Mat(box, CV_32F));
+    epanechnikov_weights(box, _kernel_tables.back().ptr<float>());
+    return _kernel_tables.back().ptr<float>();
+}
+
+
+// Joint histograms of the tracked channels instead of one histogram per channel
+bool FusionTracker::_joint() {
+    return joint_histogram && _colortrack;
+}
+
+
+/* Quantized HOG descriptors
+* Descriptors of the windows at locations as uint8 with the model scale, into _temp_quantized.
+* The LUT kernel quantizes each block as it is normalized
+*/
+void FusionTracker::_compute_quantized_hog(const Mat& image, const vector<Point>& locations){
+
+    if(lut_hog){
+        _lut_hog.compute(image, _temp_quantized, _quantization_scale, locations);
+    }
+    else{
+        _hog_descriptor.compute(image, _temp_descriptors, Size(), Size(), locations);
+        _temp_quantized.resize(_temp_descriptors.size());
+        quantize_descriptor(_temp_descriptors.data(), (int)_temp_descriptors.size(), _quantization_scale, _temp_quantized.data());
+    }
+}
+
+
+// Relative error of a quantized distance against the float distance of the same descriptors, kept for _record_argmin
+void FusionTracker::_record_quantization(float quantized, double exact){
+
+    _exact_scores.push_back(exact);
+    double error = fabs(quantized - exact)/max(exact, 1e-6);
+    _quantize_stats.distances++;
+    _quantize_stats.error_sum += error;
+    _quantize_stats.max_error = max(_quantize_stats.max_error, error);
+}
+
+
+/* Argmin agreement
+* Fuses the float gradient distances with the colour scores as track() does and counts the
+* frame when the chosen candidate also has the smallest fused float score (ties included).
+* Frames with candidates served from the block cache have no float distance for them and
+* are not counted
+*/
+void FusionTracker::_record_argmin(int chosen){
+
+    if(_exact_scores.empty() || _exact_scores.size() != _fusion_scores.size()){
+        return;
+    }
+    if(_colortrack){
+        for(size_t k = 0; k < _exact_scores.size(); k++){
+            _exact_scores[k] += frame_candidates.color_scores[k];
+        }
+    }
+    double best = *min_element(_exact_scores.begin(), _exact_scores.end());
+    _quantize_stats.frames++;
+    if(_exact_scores[chosen] == best){
+        _quantize_stats.argmin_agree++;
+    }
+}
+
 
 /* Initialize model
 * Obtains the histogram(s) of region defined by ground truth  
 * Returns 0 "distances" for code consistency
 */
-void FusionTracker::_init_model(Mat frame, Mat mask) {
+void FusionTracker::_init_model(Mat frame) {
 
 //////////////////////////////////////////////////// COLOR HISTOGRAMS
     if(_colortrack){
-        Mat hist;
-        mask(_model.box) = 1;
-
-        float bgrsRanges[] = {0,256};
-        float hRanges[] = {0,180};
-        const float* bgrs_histRange = { bgrsRanges };
-        const float* h_histRange = { hRanges };
-        bool uniform = true, accumulate = false;
-        int nimages = 1,  dimensions = 1;
-
         for(int i = 0;i < 6; i++){        
             if(_track_type[i]){
-                if(i==3){
-                    calcHist( &_color_spaces[i], nimages, 0, mask, hist, dimensions, &color_bins, &h_histRange, uniform, accumulate );
+                _model.histograms[i].create(color_bins, 1, CV_32F);
+                float* hist = _model.histograms[i].ptr<float>();
+                if(kernel_weights){
+                    weighted_bin_histogram(_bin_planes[i], _model.box, color_bins, _kernel_table(_model.box.size()), hist);
                 }
                 else{
-                    calcHist( &_color_spaces[i], nimages, 0, mask, hist, dimensions, &color_bins, &bgrs_histRange, uniform, accumulate );
+                    sampled_bin_histogram(_bin_planes[i], _model.box, color_bins, sample_stride(_model.box.size(), max_samples), hist);
                 }
-                normalize(hist, hist, 1, 100, NORM_MINMAX, -1, Mat() );
-                _model.histograms.push_back(hist);
+                normalize_histogram(hist, color_bins, 1, 100);
             }            
-            else{
-                _model.histograms.push_back(Mat());
-            }
+        }
+        if(_joint()){
+            _joint_model.configure(color_bins, _track_type);
+            _joint_model.build(_bin_planes, _model.box, kernel_weights ? _kernel_table(_model.box.size()) : NULL);
+            _joint_hist.resize(_joint_model.size() + 2);
+            _joint_model.index_plane(_bin_planes, _model.box, _joint_indices);
         }
     }
 
 /////////////////////////////////////////////////////////// HOG
     if(_gradtrack){
-        Mat croped_frame;
-        frame(_model.box).copyTo(croped_frame);
-        resize(croped_frame,croped_frame,Size(64,128));
+        // With hog_pixels > 0 the HOG window follows the aspect ratio of the box instead of the 64x128 person window
+        if(hog_pixels > 0){
+            hog_geometry(_model.box.size(), hog_pixels, _hog_descriptor);
+            _lut_hog.configure(_hog_descriptor);
+            _temp_descriptors.reserve(_hog_descriptor.getDescriptorSize());
+        }
+
+        resize(frame(_model.box),_resized,_hog_descriptor.winSize);
 
-        _hog_descriptor.compute(croped_frame, _model.descriptors);
+        _compute_hog(_resized, _model.descriptors, vector<Point>());
+
+        // The scale of the quantized descriptors is fixed by the model
+        if(_quantized()){
+            int n = (int)_model.descriptors.size();
+            _quantization_scale = quantization_scale(_model.descriptors.data(), n);
+            _model_quantized.resize(n);
+            quantize_descriptor(_model.descriptors.data(), n, _quantization_scale, _model_quantized.data());
+        }
+
+        // How far the LUT descriptor of the model is from OpenCV's, relative to its norm
+        if(lut_hog){
+            _hog_descriptor.compute(_resized, _temp_descriptors);
+            double reference = norm(Mat(_temp_descriptors));
+            _lut_deviation = (float)(norm(Mat(_model.descriptors), Mat(_temp_descriptors))/max(reference, 1e-6));
+        }
+
+        if(pca_components > 0){
+            _fit_projection(frame);
+        }
     }
 ////////////////////////////////////////////////////////////////
     frame_candidates.boxes.push_back(_model.box);
@@ -213,39 +863,30 @@ void FusionTracker::_init_model(Mat frame, Mat mask) {
 
 
 // Converts the input frame into multiple color channels according to tracking type for color histogram tracking
+// Planes are written into buffers owned by the tracker, so after the first frame nothing is allocated
 void FusionTracker::_get_color_space(Mat frame){
 
-    vector<Mat> bgr_planes;
-    split(frame, bgr_planes);
-    
-    for(int i = 0;i < 3; i++){        
-        if(_track_type[i]){
-            _color_spaces.push_back(bgr_planes[i]);
-            }        
-        else{
-            _color_spaces.push_back(Mat()); }
+    if(_track_type[0] || _track_type[1] || _track_type[2]){
+        split(frame, &_bgr_planes[0]);
+        for(int i = 0;i < 3; i++){        
+            if(_track_type[i]){
+                _color_spaces[i] = _bgr_planes[i];
+            }
+        }
     }
 
-    for(int i = 3;i < 5; i++){ 
-        if(_track_type[i]){
-            Mat hsv;
-            vector<Mat> hsv_planes;
-            cvtColor(frame, hsv, 40);
-            split(hsv, hsv_planes);
-            _color_spaces.push_back(hsv_planes[i-3]);
-            }      
-        else{
-            _color_spaces.push_back(Mat());
+    if(_track_type[3] || _track_type[4]){
+        cvtColor(frame, _hsv, COLOR_BGR2HSV);
+        split(_hsv, &_hsv_planes[0]);
+        for(int i = 3;i < 5; i++){ 
+            if(_track_type[i]){
+                _color_spaces[i] = _hsv_planes[i-3];
+            }
         }
     }
 
     if(_track_type[5]){
-        Mat gray;
-        cvtColor(frame, gray, CV_BGR2GRAY);
-        _color_spaces.push_back(gray);
+        cvtColor(frame, _gray, CV_BGR2GRAY);
+        _color_spaces[5] = _gray;
     }
 }
-
-
-
-
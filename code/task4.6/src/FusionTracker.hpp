@@ -3,6 +3,13 @@
 #include <sstream>
 
 #include <opencv2/opencv.hpp>
+#include "HistogramKernels.hpp"
+#include "ParticleFilter.hpp"
+#include "SearchBudget.hpp"
+#include "StaticGate.hpp"
+#include "BlockCache.hpp"
+#include "JointHistogram.hpp"
+#include "HogKernels.hpp"
 
 using namespace std;
 using namespace cv;
@@ -28,16 +35,98 @@ class FusionTracker{
         bool _gradtrack;
         model _model;
         HOGDescriptor _hog_descriptor;
+        LutHog _lut_hog;
+        float _lut_deviation;
+
+        // quantized descriptors
+        vector<uchar> _model_quantized;
+        vector<uchar> _temp_quantized;
+        float _quantization_scale;
+        quantize_stats _quantize_stats;
+        vector<double> _exact_scores;   // float distance of every candidate of the frame (check_quantization only)
+
+        // PCA reduced descriptors
+        Mat _projection;
+        Mat _pca_samples;
+        vector<float> _full_descriptors;
         vector<bool> _track_type;
         vector<Mat> _color_spaces;
+        vector<Mat> _bin_planes;
+        uchar _bin_luts[6][256];
+
+        // buffers reused across frames
+        vector<Mat> _bgr_planes;
+        vector<Mat> _hsv_planes;
+        Mat _hsv;
+        Mat _gray;
+        Mat _hist_candidate;
+        Mat _resized;
+        vector<double> _scores;
+        vector<float> _temp_descriptors;
+        vector<double> _fusion_scores;
+        vector<Point> _offsets;
+
+        // deadline
+        SearchBudget _budget;
+
+        // static region gating
+        StaticGate _gate;
+
+        // Epanechnikov weight tables, one per box size
+        vector<Mat> _kernel_tables;
+
+        // sparse joint histogram of the tracked channels
+        JointModel _joint_model;
+        Mat _joint_indices;
+        vector<float> _joint_hist;
+
+        // block cache of candidate histograms and HOG distances
+        vector<Mat> _previous_bin_planes;
+        Mat _cache_reference;
+        Rect _cache_window;
+        DirtyBlocks _color_blocks;
+        DirtyBlocks _gray_blocks;
+        FrameCache< vector<float> > _histogram_cache;
+        FrameCache<float> _distance_cache;
+        vector<Rect> _dirty_regions;
+        cache_stats _cache_stats;
+
+        // multi-scale search
+        vector<double> _scales;
+        vector<Mat> _integral_histograms;
+        bool _use_integral_histograms;
+        Point _window_origin;
+        Mat _pyramid_level;
+        vector<Point> _locations;
 
+        // particle filter search
+        ParticleFilter _particle_filter;
 
         // functions
-        void _init_model(Mat frame, Mat mask);
+        void _init_model(Mat frame);
         void _get_color_space(Mat frame);
-        float _get_color_distance(Mat mask,Rect candidate_box);
+        float _get_color_distance(Rect candidate_box);
         float _get_gradient_distance(Mat frame,Rect candidate_box);
+        void _compute_hog(const Mat& image, vector<float>& descriptors, const vector<Point>& locations);
+        void _compute_quantized_hog(const Mat& image, const vector<Point>& locations);
+        void _fit_projection(Mat frame);
+        bool _quantized();
+        void _record_quantization(float quantized, double exact);
+        void _record_argmin(int chosen);
         void _generate_candidates(Mat frame);
+        void _quantize_color_spaces(Rect window);
+        Rect _search_window(Size frame_size);
+        const vector<double>& _candidate_scales();
+        Rect _scaled_box(double scale);
+        size_t _integral_histograms_bytes(Size window);
+        void _get_gradient_scale_distances(Mat frame, size_t first);
+        void _particle_search(Mat frame);
+        bool _block_cache();
+        const float* _kernel_table(Size box);
+        bool _joint();
+        void _reserve_cache(Mat frame);
+        void _cache_frame(Mat frame, Rect window);
+        void _cached_histogram(int channel, Rect candidate_box, float* hist);
 
 
     public:
@@ -46,10 +135,31 @@ class FusionTracker{
         
         // functions
         Rect track(Mat frame);
+        Rect track(Mat frame, double budget_ms);
+        const budget_stats& get_budget_stats() const;
+        const gate_stats& get_gate_stats() const;
+        const cache_stats& get_cache_stats() const;
+        float get_lut_deviation() const;
+        Size get_hog_window() const;
+        const quantize_stats& get_quantize_stats() const;
+        const JointModel& get_joint_model() const;
 
         //variables
         int candidate_levels;
         int candidate_step;
+        double scale_step;
+        int num_particles;
+        float particle_noise;
+        double static_threshold;
+        int max_samples;
+        bool cache_blocks;
+        bool kernel_weights;
+        bool joint_histogram;
+        bool lut_hog;
+        int hog_pixels;
+        bool quantize_hog;
+        bool check_quantization;
+        int pca_components;
         int color_bins;
         int num_candidates;
         candidates frame_candidates;
@@ -0,0 +1,429 @@
+#include "HogKernels.hpp"
+#include "HistogramKernels.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+namespace {
+
+// Square root by Newton iterations, usable in constant expressions
+constexpr double table_sqrt(double x) {
+    double r = x > 1 ? x : 1;
+    for(int k = 0; k < 40; k++){
+        r = 0.5*(r + x/r);
+    }
+    return r;
+}
+
+
+// Arc tangent of t in [0, 1]: the argument is halved twice with atan(t) = 2*atan(t/(1 + sqrt(1 + t^2)))
+// and the Taylor series converges below tan(pi/16)
+constexpr double table_atan(double t) {
+    for(int k = 0; k < 2; k++){
+        t = t/(1 + table_sqrt(1 + t*t));
+    }
+    double term = t;
+    double sum = 0;
+    for(int k = 0; k < 16; k++){
+        sum += term/(2*k + 1);
+        term *= -t*t;
+    }
+    return 4*sum;
+}
+
+
+/* Gradient tables
+* angle and norm are indexed by k = HOG_RATIO_STEPS*min(|dx|,|dy|)/max(|dx|,|dy|):
+* the angle of the gradient within the first octant in units of pi, and the factor that
+* turns the larger component into the magnitude. gamma and linear are the pixel values in
+* fixed point, with and without gamma correction.
+*/
+struct gradient_tables {
+    float angle[HOG_RATIO_STEPS + 1];
+    float norm[HOG_RATIO_STEPS + 1];
+    short gamma[256];
+    short linear[256];
+
+    constexpr gradient_tables() : angle(), norm(), gamma(), linear() {
+        for(int k = 0; k <= HOG_RATIO_STEPS; k++){
+            double t = (double)k/HOG_RATIO_STEPS;
+            angle[k] = (float)(table_atan(t)/CV_PI);
+            norm[k] = (float)table_sqrt(1 + t*t);
+        }
+        for(int v = 0; v < 256; v++){
+            gamma[v] = (short)(table_sqrt(v)*HOG_GAMMA_SCALE + 0.5);
+            linear[v] = (short)(v*HOG_LINEAR_SCALE);
+        }
+    }
+};
+
+constexpr gradient_tables TABLES;
+
+}
+
+
+LutHog::LutHog() {
+    _nbins = 0;
+    _block_hist_size = 0;
+    _angle_scale = 0;
+    _threshold = 0;
+    _gamma = false;
+    _share_blocks = false;
+    _stored_blocks = 0;
+}
+
+
+/* Configure
+* Takes the geometry, bins, block weighting, clipping threshold and gamma of hog and
+* precomputes the cells and weights each pixel of a block contributes to
+*/
+void LutHog::configure(const HOGDescriptor& hog) {
+
+    CV_Assert(hog.nbins > 0 && hog.nbins <= 256);
+    CV_Assert(hog.blockSize.width % hog.cellSize.width == 0 && hog.blockSize.height % hog.cellSize.height == 0);
+    CV_Assert((hog.winSize.width - hog.blockSize.width) % hog.blockStride.width == 0 &&
+              (hog.winSize.height - hog.blockSize.height) % hog.blockStride.height == 0);
+
+    _win_size = hog.winSize;
+    _block_size = hog.blockSize;
+    _block_stride = hog.blockStride;
+    _blocks = Size((_win_size.width - _block_size.width)/_block_stride.width + 1,
+                   (_win_size.height - _block_size.height)/_block_stride.height + 1);
+    _nbins = hog.nbins;
+    _angle_scale = hog.signedGradient ? 0.5f*_nbins : (float)_nbins;
+    _threshold = (float)hog.L2HysThreshold;
+    _gamma = hog.gammaCorrection;
+
+    Size cell = hog.cellSize;
+    Size cells(_block_size.width/cell.width, _block_size.height/cell.height);
+    _block_hist_size = cells.area()*_nbins;
+
+    float sigma = (float)hog.getWinSigma();
+    float scale = 1.f/(sigma*sigma*2);
+    _block_pixels.resize(_block_size.area());
+
+    for(int i = 0; i < _block_size.height; i++){
+        for(int j = 0; j < _block_size.width; j++){
+            float di = i - _block_size.height*0.5f;
+            float dj = j - _block_size.width*0.5f;
+            float gauss = std::exp(-(di*di*scale + dj*dj*scale));
+
+            // Bilinear weights to the (up to) four cells whose centers surround the pixel
+            float cx = (j + 0.5f)/cell.width - 0.5f;
+            float cy = (i + 0.5f)/cell.height - 0.5f;
+            int x0 = cvFloor(cx);
+            int y0 = cvFloor(cy);
+
+            block_pixel& pixel = _block_pixels[i*_block_size.width + j];
+            int n = 0;
+            for(int y = y0; y <= y0 + 1; y++){
+                for(int x = x0; x <= x0 + 1; x++){
+                    if((unsigned)x < (unsigned)cells.width && (unsigned)y < (unsigned)cells.height){
+                        pixel.cell_offset[n] = (x*cells.height + y)*_nbins;
+                        pixel.weight[n] = gauss*(1.f - std::fabs(cx - x))*(1.f - std::fabs(cy - y));
+                        n++;
+                    }
+                }
+            }
+            for(; n < 4; n++){
+                pixel.cell_offset[n] = 0;
+                pixel.weight[n] = 0;
+            }
+        }
+    }
+}
+
+
+// Length of the descriptor of one window
+size_t LutHog::descriptor_size() const {
+    return (size_t)_blocks.area()*_block_hist_size;
+}
+
+
+/* Compute
+* Descriptors of the windows whose top-left corners are given by locations, one after the
+* other; with no locations image is a single window. The gradients are computed once over
+* the region covered by all the windows, using the pixels around it where the image has them,
+* and blocks shared by several windows are computed once.
+* image is CV_8UC1 or CV_8UC3.
+*/
+void LutHog::compute(const Mat& image, vector<float>& descriptors, const vector<Point>& locations) {
+
+    Rect region = _prepare(image, locations);
+
+    size_t windows = max(locations.size(), (size_t)1);
+    descriptors.resize(windows*descriptor_size());
+    float* hist = descriptors.data();
+
+    for(size_t w = 0; w < windows; w++){
+        Point origin = locations.empty() ? Point(0, 0) : locations[w] - region.tl();
+        for(int bx = 0; bx < _blocks.width; bx++){
+            for(int by = 0; by < _blocks.height; by++){
+                const float* block = _normalized_block(origin + Point(bx*_block_stride.width, by*_block_stride.height));
+                std::copy(block, block + _block_hist_size, hist);
+                hist += _block_hist_size;
+            }
+        }
+    }
+}
+
+
+/* Quantized compute
+* Same descriptors rounded to uint8 with quantize_descriptor(scale) as each block is
+* normalized, so the float descriptor is never written out
+*/
+void LutHog::compute(const Mat& image, vector<uchar>& descriptors, float scale, const vector<Point>& locations) {
+
+    Rect region = _prepare(image, locations);
+
+    size_t windows = max(locations.size(), (size_t)1);
+    descriptors.resize(windows*descriptor_size());
+    uchar* dst = descriptors.data();
+
+    for(size_t w = 0; w < windows; w++){
+        Point origin = locations.empty() ? Point(0, 0) : locations[w] - region.tl();
+        for(int bx = 0; bx < _blocks.width; bx++){
+            for(int by = 0; by < _blocks.height; by++){
+                const float* block = _normalized_block(origin + Point(bx*_block_stride.width, by*_block_stride.height));
+                quantize_descriptor(block, _block_hist_size, scale, dst);
+                dst += _block_hist_size;
+            }
+        }
+    }
+}
+
+
+/* Projected compute
+* Descriptors multiplied by projection (CV_32F, one row per component, descriptor_size()
+* columns), one projection.rows vector per window. Each block is folded into the
+* components as soon as it is normalized, so the full descriptor is never written out.
+*/
+void LutHog::compute(const Mat& image, const Mat& projection, vector<float>& projected, const vector<Point>& locations) {
+
+    CV_Assert(projection.type() == CV_32F && projection.cols == (int)descriptor_size());
+    Rect region = _prepare(image, locations);
+
+    int components = projection.rows;
+    size_t windows = max(locations.size(), (size_t)1);
+    projected.assign(windows*components, 0.f);
+
+    for(size_t w = 0; w < windows; w++){
+        Point origin = locations.empty() ? Point(0, 0) : locations[w] - region.tl();
+        float* dst = projected.data() + w*components;
+        int offset = 0;
+        for(int bx = 0; bx < _blocks.width; bx++){
+            for(int by = 0; by < _blocks.height; by++){
+                const float* block = _normalized_block(origin + Point(bx*_block_stride.width, by*_block_stride.height));
+                for(int r = 0; r < components; r++){
+                    const float* axis = projection.ptr<float>(r) + offset;
+                    float sum = 0;
+                    for(int i = 0; i < _block_hist_size; i++){
+                        sum += axis[i]*block[i];
+                    }
+                    dst[r] += sum;
+                }
+                offset += _block_hist_size;
+            }
+        }
+    }
+}
+
+
+/* Prepare
+* Region covered by the windows at locations (a single window at the origin with none), with
+* its gradients computed. With several windows the block slots of the region are cleared so
+* _normalized_block shares the blocks between them
+*/
+Rect LutHog::_prepare(const Mat& image, const vector<Point>& locations) {
+
+    CV_Assert(_nbins > 0);
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3));
+
+    Rect region(Point(0, 0), _win_size);
+    if(!locations.empty()){
+        region = Rect(locations[0], _win_size);
+        for(size_t k = 1; k < locations.size(); k++){
+            region |= Rect(locations[k], _win_size);
+        }
+    }
+    CV_Assert((region & Rect(0, 0, image.cols, image.rows)) == region);
+
+    _gradients(image, region);
+
+    _block.resize(_block_hist_size);
+    _share_blocks = locations.size() > 1;
+    if(_share_blocks){
+        _block_slots.create(region.size(), CV_32S);
+        _block_slots.setTo(Scalar(-1));
+        _block_store.resize(max(_block_store.size(), locations.size()*descriptor_size()));
+        _stored_blocks = 0;
+    }
+    return region;
+}
+
+
+/* Gradients
+* Central differences of the fixed point pixel values, reflected at the image borders.
+* The octant of (dx, dy) and the table angle within it give the orientation, which is
+* split between the two nearest bins in proportion to the distance to their centers.
+* Color images keep the channel with the largest gradient, like cv::HOGDescriptor.
+*/
+void LutHog::_gradients(const Mat& image, Rect region) {
+
+    _bins.create(region.size(), CV_8UC2);
+    _weights.create(region.size(), CV_32FC2);
+
+    const short* values = _gamma ? TABLES.gamma : TABLES.linear;
+    float value_scale = 1.f/(_gamma ? HOG_GAMMA_SCALE : HOG_LINEAR_SCALE);
+    int cn = image.channels();
+
+    _xmap.resize(region.width + 2);
+    for(int x = -1; x <= region.width; x++){
+        _xmap[x + 1] = borderInterpolate(region.x + x, image.cols, BORDER_REFLECT_101)*cn;
+    }
+
+    for(int y = 0; y < region.height; y++){
+        const uchar* row = image.ptr<uchar>(region.y + y);
+        const uchar* prev = image.ptr<uchar>(borderInterpolate(region.y + y - 1, image.rows, BORDER_REFLECT_101));
+        const uchar* next = image.ptr<uchar>(borderInterpolate(region.y + y + 1, image.rows, BORDER_REFLECT_101));
+        uchar* bins = _bins.ptr<uchar>(y);
+        float* weights = _weights.ptr<float>(y);
+
+        for(int x = 0; x < region.width; x++){
+            int left = _xmap[x];
+            int center = _xmap[x + 1];
+            int right = _xmap[x + 2];
+
+            int dx = values[row[right]] - values[row[left]];
+            int dy = values[next[center]] - values[prev[center]];
+            for(int c = 1; c < cn; c++){
+                int cdx = values[row[right + c]] - values[row[left + c]];
+                int cdy = values[next[center + c]] - values[prev[center + c]];
+                if(cdx*cdx + cdy*cdy > dx*dx + dy*dy){
+                    dx = cdx;
+                    dy = cdy;
+                }
+            }
+
+            int ax = abs(dx);
+            int ay = abs(dy);
+            int hi = max(ax, ay);
+            int k = hi > 0 ? (min(ax, ay)*HOG_RATIO_STEPS + hi/2)/hi : 0;
+
+            // Angle in units of pi, from the first octant to the whole circle
+            float angle = TABLES.angle[k];
+            if(ay > ax){
+                angle = 0.5f - angle;
+            }
+            if(dx < 0){
+                angle = dy < 0 ? 1.f + angle : 1.f - angle;
+            }
+            else if(dy < 0){
+                angle = 2.f - angle;
+            }
+            float magnitude = hi*TABLES.norm[k]*value_scale;
+
+            // Unsigned gradients fold the upper half circle onto the lower one
+            float position = angle*_angle_scale - 0.5f;
+            int bin = cvFloor(position);
+            float upper_weight = position - bin;
+            if(bin < 0){
+                bin += _nbins;
+            }
+            else if(bin >= _nbins){
+                bin -= _nbins;
+            }
+            bins[2*x] = (uchar)bin;
+            bins[2*x + 1] = (uchar)(bin + 1 < _nbins ? bin + 1 : 0);
+            weights[2*x] = magnitude*(1.f - upper_weight);
+            weights[2*x + 1] = magnitude*upper_weight;
+        }
+    }
+}
+
+
+// Weighted orientation histograms of the cells of the block at origin, in buffer coordinates
+void LutHog::_block_histogram(Point origin, float* hist) {
+
+    std::fill(hist, hist + _block_hist_size, 0.f);
+
+    const block_pixel* pixel = _block_pixels.data();
+    for(int i = 0; i < _block_size.height; i++){
+        const uchar* bins = _bins.ptr<uchar>(origin.y + i) + 2*origin.x;
+        const float* weights = _weights.ptr<float>(origin.y + i) + 2*origin.x;
+        for(int j = 0; j < _block_size.width; j++, pixel++){
+            int lower = bins[2*j];
+            int upper = bins[2*j + 1];
+            for(int c = 0; c < 4; c++){
+                float* cell = hist + pixel->cell_offset[c];
+                cell[lower] += pixel->weight[c]*weights[2*j];
+                cell[upper] += pixel->weight[c]*weights[2*j + 1];
+            }
+        }
+    }
+}
+
+
+// Normalized histogram of the block at origin, computed once per origin when blocks are shared
+const float* LutHog::_normalized_block(Point origin) {
+
+    float* hist = _block.data();
+    if(_share_blocks){
+        int& slot = _block_slots.at<int>(origin.y, origin.x);
+        if(slot >= 0){
+            return _block_store.data() + (size_t)slot*_block_hist_size;
+        }
+        slot = _stored_blocks++;
+        hist = _block_store.data() + (size_t)slot*_block_hist_size;
+    }
+    _block_histogram(origin, hist);
+    _normalize(hist);
+    return hist;
+}
+
+
+// L2Hys: L2 normalization, clipping at the threshold and a second L2 normalization
+void LutHog::_normalize(float* hist) {
+
+    float sum = 0;
+    for(int i = 0; i < _block_hist_size; i++){
+        sum += hist[i]*hist[i];
+    }
+
+    float scale = 1.f/(std::sqrt(sum) + _block_hist_size*0.1f);
+    sum = 0;
+    for(int i = 0; i < _block_hist_size; i++){
+        hist[i] = std::min(hist[i]*scale, _threshold);
+        sum += hist[i]*hist[i];
+    }
+
+    scale = 1.f/(std::sqrt(sum) + 1e-3f);
+    for(int i = 0; i < _block_hist_size; i++){
+        hist[i] *= scale;
+    }
+}
+
+
+/* HOG geometry
+* The window keeps the aspect ratio of the box and covers about pixels pixels, in whole cells,
+* so a wide box is not stretched into the 64x128 person window. Cells are 8x8 unless the short
+* side of the window would hold fewer than 2 of them, then 4x4. Blocks are 2x2 cells moved one
+* cell at a time, as in the person window, and every side holds at least one block.
+*/
+void hog_geometry(Size box, int pixels, HOGDescriptor& hog) {
+
+    CV_Assert(box.area() > 0 && pixels > 0);
+
+    double aspect = (double)box.width/box.height;
+    double width = std::sqrt(pixels*aspect);
+    double height = std::sqrt(pixels/aspect);
+
+    int cell = min(width, height) >= 2*8 ? 8 : 4;
+    Size window(max(cvRound(width/cell), 2)*cell, max(cvRound(height/cell), 2)*cell);
+
+    hog.winSize = window;
+    hog.cellSize = Size(cell, cell);
+    hog.blockSize = Size(2*cell, 2*cell);
+    hog.blockStride = Size(cell, cell);
+}
@@ -0,0 +1,58 @@
+#ifndef JOINTHISTOGRAM_HPP_
+#define JOINTHISTOGRAM_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+/* Joint histogram model
+* Histogram of the joint bin of several bin index planes (bin b_k of plane k gives the key
+* sum b_k*bins^k), stored sparsely: an open addressing table maps the key of every occupied
+* bin of the model box to a compact index and the counts are kept per index, so a 64^3 BGR
+* histogram of a box takes memory for the bins the box actually uses only. Pixels with a
+* plane out of range are not counted.
+* Candidates are not histogrammed over the joint space: index_plane() looks up the joint
+* bin of every pixel of the search window once per frame, giving the model index or
+* absent() for a bin the model does not have (out_of_range() for skipped pixels), and
+* a candidate histogram is then the size() + 2 counts of those indices over its box.
+* distance() iterates over the model bins only; bins absent from the model add to the
+* candidate total but cannot add to the Bhattacharyya coefficient
+*/
+class JointModel {
+    private:
+        // variables
+        int _bins;
+        std::vector<int> _planes;
+        std::vector<uint64_t> _keys;        // key of each slot
+        std::vector<int> _slots;            // model index of each slot, -1 when empty
+        std::vector<float> _counts;         // count of each model bin
+        double _total;
+        int _shift;
+
+        // buffers
+        mutable std::vector<const uchar*> _rows;    // current row of each plane
+
+        // functions
+        uint64_t _key(const uchar* const* rows, int x, bool& valid) const;
+        int _slot(uint64_t key) const;
+        void _rehash(int capacity);
+
+    public:
+        // Constructor
+        JointModel();
+
+        // functions
+        void configure(int bins, const std::vector<bool>& use_plane);
+        void build(const std::vector<cv::Mat>& bin_planes, cv::Rect box, const float* weights);
+        void index_plane(const std::vector<cv::Mat>& bin_planes, cv::Rect window, cv::Mat& indices) const;
+        void histogram(const cv::Mat& indices, cv::Rect box, const float* weights, float* hist) const;
+        double distance(const float* hist) const;
+        int size() const;
+        int absent() const;
+        int out_of_range() const;
+        double dense_size() const;
+};
+
+
+#endif /* JOINTHISTOGRAM_HPP_ */
@@ -0,0 +1,60 @@
+#ifndef SEARCHBUDGET_HPP_
+#define SEARCHBUDGET_HPP_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+struct budget_stats {
+    int frames;                 // frames tracked with a budget
+    int evaluated;              // candidates evaluated in the last frame
+    int planned;                // grid positions (or particles) of the full search in the last frame
+    long total_evaluated;       // candidates evaluated over all budgeted frames
+    long total_planned;         // grid positions (or particles) over all budgeted frames
+    int overruns;               // frames that took longer than their budget
+    double worst_overrun_ms;    // largest time over budget
+};
+
+/* Per frame time budget
+* start() sets the deadline, the candidate loop polls expired() before each candidate
+* and finish() records how many candidates were evaluated and whether the frame overran.
+* A budget of 0 or less means no deadline and nothing is recorded.
+*/
+class SearchBudget {
+    private:
+        // variables
+        bool _active;
+        double _budget_ms;
+        int64 _start;
+        int64 _deadline;
+        budget_stats _stats;
+
+    public:
+        // Constructor
+        SearchBudget();
+
+        // functions
+        void start(double budget_ms);
+        bool active() const;
+        bool expired(size_t evaluated) const;
+        void finish(int evaluated, int planned);
+        const budget_stats& stats() const;
+};
+
+// Order in which grid_offsets lists the candidate grid
+enum grid_order {
+    GRID_RASTER = 0,            // x outer, y inner
+    GRID_RINGS = 1,             // center first, then square rings of growing radius
+    GRID_SNAKE_ROWS = 2,        // y outer, x inner alternating direction: consecutive offsets differ in x
+    GRID_SNAKE_COLUMNS = 3      // x outer, y inner alternating direction: consecutive offsets differ in y
+};
+
+/* Candidate offsets of a (2*levels+1)^2 grid with spacing step
+* Ring order lets a search cut by a deadline cover the neighbourhood of the predicted
+* position first. In the snake orders every offset is one step away from the previous
+* one, so candidate features can be updated incrementally
+*/
+void grid_offsets(int levels, int step, int order, std::vector<cv::Point>& offsets);
+
+
+#endif /* SEARCHBUDGET_HPP_ */
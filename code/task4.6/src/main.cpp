@@ -18,6 +18,9 @@
 #include <string> 								//For std::to_string function
 #include <opencv2/opencv.hpp>					//opencv libraries
 #include "utils.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
+#include "PoolAllocator.hpp" 					//pooled allocator for frame sized Mats
+#include "CpuFeatures.hpp" 						//instruction set used by the tracker kernels
+#include "WorkingResolution.hpp" 				//target size normalized processing resolution
 #include "FusionTracker.hpp" 							//for functions readGroundTruthFile & estimateTrackingPerformance
 
 //namespaces
@@ -46,11 +49,33 @@ int main(int argc, char ** argv)
 	hist_type.push_back(true);
 	int candidate_levels = 4;
 	int candidate_step = 4;
+	double scale_step = 1.0;	// > 1 also tests the box shrunk and grown by this factor (e.g. 1.05)
+	int num_particles = 0;		// > 0 replaces the candidate grid by a particle filter with this many particles
+	double frame_budget_ms = 0;		// > 0 stops the candidate search at this time per frame and keeps the best so far
+	int target_pixels = 0;		// > 0 tracks at a resolution where the initial box covers about this many pixels (e.g. 4096)
+	bool reference_run = true;	// with a reduced resolution or sampled histograms, also tracks at full resolution, every pixel, to report both performances (untimed)
+	double static_threshold = 0;	// > 0 keeps the previous box while no 8x8 block of the search window changes by this mean level (e.g. 4)
+	bool cache_blocks = false;	// reuses the candidate features of the last frame, recomputing only their changed 8x8 blocks
+	bool kernel_weights = false;	// weights pixels by an Epanechnikov kernel centred on the box in the colour histograms
+	bool joint_histogram = false;	// one sparse joint histogram of the tracked channels instead of one histogram per channel
+	bool lut_hog = false;		// computes HOG gradients through orientation/magnitude lookup tables instead of OpenCV
+	bool quantize_hog = false;	// compares uint8 HOG descriptors with integer kernels instead of float ones
+	bool check_quantization = false;	// also computes the float distances to measure the quantization error (slower)
+	int pca_components = 0;		// > 0 compares candidates in this many PCA dimensions fit around the model at init (e.g. 128)
+	int hog_pixels = 0;			// > 0 shapes the HOG window like the initial box with about this many pixels (e.g. 8192) instead of 64x128
+	int max_samples = 0;		// > 0 builds every color histogram from at most this many pixels of the box
 	int cbins = 8;
 	int gbins = 16;
 	////////////////////////////////////////////
 
 	int NumSeq = argc-1;																//number of sequences	
+
+	//Frame sized Mats (decoded frames, tracker planes, overlays, encoder buffers) reuse pooled memory.
+	//The pool is never deleted since OpenCV may still release Mats through it after main returns
+	PoolAllocator* frame_pool = new PoolAllocator();
+	Mat::setDefaultAllocator(frame_pool);
+	cout << "Kernel instruction set: " << simd_level_name(active_simd_level()) << endl;
+
 	std::string output_path = "./outvideos/";											//location to save output videos
     string makedir_cmd = "mkdir " + output_path;
     system(makedir_cmd.c_str());
@@ -98,7 +123,36 @@ int main(int argc, char ** argv)
 		std::cout << "Displaying sequence at " << inputvideo << std::endl;
 		std::cout << "  with groundtruth at " << inputGroundtruth << std::endl;
 
-		FusionTracker ftracker(list_bbox_gt[0],candidate_levels,candidate_step,cbins,hist_type,gbins);
+		//Tracking runs at the working resolution, boxes are mapped back to the full frame
+		WorkingResolution resolution(list_bbox_gt[0], frame_size, target_pixels);
+		std::cout << "  working resolution scale = " << resolution.scale() << std::endl;
+
+		FusionTracker ftracker(resolution.to_working(list_bbox_gt[0]),candidate_levels,candidate_step,cbins,hist_type,gbins);
+		auto configure = [&](FusionTracker& tracker){
+			tracker.scale_step = scale_step;
+			tracker.num_particles = num_particles;
+			tracker.static_threshold = static_threshold;
+			tracker.cache_blocks = cache_blocks;
+			tracker.kernel_weights = kernel_weights;
+			tracker.joint_histogram = joint_histogram;
+			tracker.lut_hog = lut_hog;
+			tracker.hog_pixels = hog_pixels;
+			tracker.quantize_hog = quantize_hog;
+			tracker.check_quantization = check_quantization;
+			tracker.pca_components = pca_components;
+			tracker.max_samples = max_samples;
+		};
+		configure(ftracker);
+
+		//Reference tracker on the full resolution frames with histograms of every pixel, not timed
+		bool reference = reference_run && (resolution.scale() < 1 || max_samples > 0);
+		Ptr<FusionTracker> rtracker;
+		std::vector<Rect> list_bbox_reference;
+		if(reference){
+			rtracker = makePtr<FusionTracker>(list_bbox_gt[0],candidate_levels,candidate_step,cbins,hist_type,gbins);
+			configure(*rtracker);
+			rtracker->max_samples = 0;
+		}
 
 		for (;;) {
 			//get frame & check if we achieved the end of the videofile (e.g. frame.data is empty)
@@ -111,10 +165,13 @@ int main(int argc, char ** argv)
 			frame_idx=cap.get(cv::CAP_PROP_POS_FRAMES);								//get the current frame
 
 			//DO TRACKING
-			list_bbox_est.push_back(ftracker.track(frame));//we use a fixed value only for this demo program. Remove this line when you use your code
+			list_bbox_est.push_back(resolution.to_full(ftracker.track(resolution.to_working(frame), frame_budget_ms)));//we use a fixed value only for this demo program. Remove this line when you use your code
 
 			//Time measurement
 			procTimes.push_back(((double)getTickCount() - t)*1000. / cv::getTickFrequency());
+			if(reference){
+				list_bbox_reference.push_back(rtracker->track(frame));
+			}
 			//std::cout << " processing time=" << procTimes[procTimes.size()-1] << " ms" << std::endl;
 
 			// plot frame number & groundtruth bounding box for each frame
@@ -140,6 +197,45 @@ int main(int argc, char ** argv)
 		//print stats about processing time and tracking performance
 		std::cout << "  Average processing time = " << std::accumulate( procTimes.begin(), procTimes.end(), 0.0) / procTimes.size() << " ms/frame" << std::endl;
 		std::cout << "  Average tracking performance = " << std::accumulate( trackPerf.begin(), trackPerf.end(), 0.0) / trackPerf.size() << std::endl;
+		if(reference){
+			vector<float> referencePerf = estimateTrackingPerformance(list_bbox_gt, list_bbox_reference);
+			std::cout << "  Full resolution, every pixel, tracking performance = " << std::accumulate( referencePerf.begin(), referencePerf.end(), 0.0) / referencePerf.size() << std::endl;
+		}
+		if(max_samples > 0){
+			Rect initial_box = resolution.to_working(list_bbox_gt[0]);
+			int stride = sample_stride(initial_box.size(), max_samples);
+			int sampled = ((initial_box.width + stride - 1)/stride)*((initial_box.height + stride - 1)/stride);
+			std::cout << "  Histogram sampling stride = " << stride << " (" << sampled << " of " << initial_box.area() << " pixels of the initial box)" << std::endl;
+		}
+		pool_stats pstats = frame_pool->stats();
+		std::cout << "  Frame pool hits = " << pstats.hits << ", misses = " << pstats.misses << ", peak = " << pstats.peak_bytes/(1024.*1024.) << " MB" << std::endl;
+		if(joint_histogram){
+			std::cout << "  Joint histogram bins = " << ftracker.get_joint_model().size() << " occupied of " << ftracker.get_joint_model().dense_size() << std::endl;
+		}
+		if(static_threshold > 0){
+			const gate_stats& gstats = ftracker.get_gate_stats();
+			std::cout << "  Static frames skipped = " << gstats.skipped << " of " << gstats.frames << std::endl;
+		}
+		if(hog_pixels > 0){
+			Size hog_window = ftracker.get_hog_window();
+			std::cout << "  HOG window = " << hog_window.width << "x" << hog_window.height << std::endl;
+		}
+		if(quantize_hog && check_quantization){
+			const quantize_stats& qstats = ftracker.get_quantize_stats();
+			std::cout << "  Quantized HOG distance error = " << (qstats.distances > 0 ? qstats.error_sum/qstats.distances : 0.) << " mean, " << qstats.max_error << " max over " << qstats.distances << " candidates" << std::endl;
+			std::cout << "  Quantized best candidate is also best by the float distances in " << qstats.argmin_agree << " of " << qstats.frames << " frames" << std::endl;
+		}
+		if(lut_hog){
+			std::cout << "  LUT HOG deviation from OpenCV on the model = " << ftracker.get_lut_deviation() << std::endl;
+		}
+		if(cache_blocks){
+			const cache_stats& cstats = ftracker.get_cache_stats();
+			std::cout << "  Cached candidate features = " << cstats.hits << " of " << cstats.lookups << ", changed blocks = " << cstats.dirty_blocks << " of " << cstats.blocks << std::endl;
+		}
+		if(frame_budget_ms > 0){
+			const budget_stats& bstats = ftracker.get_budget_stats();
+			std::cout << "  Candidates evaluated = " << bstats.total_evaluated << " of " << bstats.total_planned << ", budget overruns = " << bstats.overruns << " of " << bstats.frames << " frames (worst +" << bstats.worst_overrun_ms << " ms)" << std::endl;
+		}
 
 		//release all resources
 		cap.release();			// close inputvideo
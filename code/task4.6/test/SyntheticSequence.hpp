@@ -0,0 +1,62 @@
+#ifndef SYNTHETICSEQUENCE_HPP_
+#define SYNTHETICSEQUENCE_HPP_
+
+#include <math.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+struct synthetic_sequence {
+    std::vector<cv::Mat> frames;
+    std::vector<cv::Rect> boxes;    // ground truth of each frame
+};
+
+/* Synthetic sequence
+* A target of target_size moving over a blurred noise background, with its ground truth.
+* The target is a coloured ellipse crossed by diagonal stripes, so colour and gradient
+* trackers both have something to lock on to. It moves on an ellipse around the frame
+* center at no more than 2 pixels per frame and always stays inside the frame. Every
+* frame gets fresh uniform noise of up to noise levels. The generator is seeded, so the
+* sequences are reproducible
+*/
+inline synthetic_sequence make_synthetic_sequence(cv::Size frame_size, cv::Size target_size, int num_frames, double noise = 8, uint64 seed = 0x5eed) {
+
+    CV_Assert(target_size.width + 8 <= frame_size.width && target_size.height + 8 <= frame_size.height);
+    cv::RNG rng(seed);
+
+    cv::Mat background(frame_size, CV_8UC3);
+    rng.fill(background, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(background, background, cv::Size(0, 0), 3);
+
+    cv::Mat target(target_size, CV_8UC3, cv::Scalar(40, 150, 60));
+    cv::Point center(target_size.width/2, target_size.height/2);
+    cv::ellipse(target, center, cv::Size(target_size.width*3/8, target_size.height*3/8), 0, 0, 360, cv::Scalar(30, 60, 210), cv::FILLED);
+    for(int k = -target_size.height; k < target_size.width; k += 8){
+        cv::line(target, cv::Point(k, 0), cv::Point(k + target_size.height, target_size.height), cv::Scalar(210, 200, 40), 2);
+    }
+
+    // Amplitudes keep a 4 pixel border, the period keeps the speed at 2 pixels per frame at most
+    double ax = (frame_size.width - target_size.width)/2. - 4;
+    double ay = (frame_size.height - target_size.height)/2. - 4;
+    double period = std::max(ceil(CV_PI*std::max(ax, ay)), 20.);
+    cv::Point2d origin((frame_size.width - target_size.width)/2., (frame_size.height - target_size.height)/2.);
+
+    synthetic_sequence sequence;
+    cv::Mat grain(frame_size, CV_8UC3);
+    for(int f = 0; f < num_frames; f++){
+        double phase = 2*CV_PI*f/period;
+        cv::Rect box(cvRound(origin.x + ax*sin(phase)), cvRound(origin.y - ay*cos(phase)), target_size.width, target_size.height);
+
+        cv::Mat frame = background.clone();
+        target.copyTo(frame(box));
+        rng.fill(grain, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(noise + 1));
+        cv::add(frame, grain, frame);
+
+        sequence.frames.push_back(frame);
+        sequence.boxes.push_back(box);
+    }
+    return sequence;
+}
+
+
+#endif /* SYNTHETICSEQUENCE_HPP_ */
@@ -0,0 +1,143 @@
+/* Steady state allocation test
+* Tracks a synthetic sequence and counts every heap allocation (replaced global operator
+* new) and every Mat buffer allocation (counting MatAllocator) made by track() after the
+* first frame. The first frame sizes the model and the frame buffers; every later frame
+* must reuse them, so both counts must be zero for colour only fusion and the Mat count
+* must be zero with the lookup table HOG.
+* The heap count of the gradient cue is only reported: cv::resize of every candidate to
+* the HOG window takes its interpolation tables from the heap, and OpenCV's
+* HOGDescriptor::compute also builds its block cache on every call.
+* OpenCV runs single threaded here, since its thread pool allocates a job per parallel_for_
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <opencv2/opencv.hpp>
+#include "FusionTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+// Heap allocations of the whole process while counting is on
+static long heap_allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if(counting){
+        heap_allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+
+// Standard allocator that counts the Mat buffers it hands out
+class CountingAllocator : public MatAllocator {
+    public:
+        mutable long allocations;
+
+        CountingAllocator() {
+            allocations = 0;
+        }
+
+        UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, UMatUsageFlags usageFlags) const {
+            if(counting){
+                allocations++;
+            }
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        bool allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const {
+            return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+        }
+
+        void deallocate(UMatData* u) const {
+            Mat::getStdAllocator()->deallocate(u);
+        }
+};
+
+
+// Tracks the whole sequence (with a frame budget when budget_ms > 0), counting the allocations of every frame after the first one
+static bool check_tracker(const char* name, FusionTracker& tracker, const synthetic_sequence& sequence, const CountingAllocator& allocator, bool check_heap, bool check_mats, double budget_ms = 0) {
+
+    long heap = 0, mats = 0;
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        long heap_before = heap_allocations, mats_before = allocator.allocations;
+        counting = f > 0;
+        tracker.track(sequence.frames[f], budget_ms);
+        counting = false;
+        heap += heap_allocations - heap_before;
+        mats += allocator.allocations - mats_before;
+    }
+
+    bool passed = (!check_heap || heap == 0) && (!check_mats || mats == 0);
+    printf("%s %s: %ld heap and %ld Mat allocations after frame 1 (%.1f heap per frame)\n", passed ? "PASS" : "FAIL", name, heap, mats, heap/(double)(sequence.frames.size() - 1));
+    return passed;
+}
+
+
+int main() {
+
+    setNumThreads(0);
+    CountingAllocator* allocator = new CountingAllocator();
+    Mat::setDefaultAllocator(allocator);
+
+    synthetic_sequence sequence = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+    Rect box = sequence.boxes[0];
+    bool passed = true;
+
+    vector<bool> gray(6, false);
+    gray[5] = true;
+
+    // Colour cue only: gray histograms
+    FusionTracker color(box, 4, 4, 8, gray, 0);
+    passed &= check_tracker("gray histograms", color, sequence, *allocator, true, true);
+
+    // Colour cue only: one sparse joint histogram of the B, G and R planes
+    vector<bool> bgr(6, false);
+    bgr[0] = bgr[1] = bgr[2] = true;
+    FusionTracker joint(box, 4, 4, 8, bgr, 0);
+    joint.joint_histogram = true;
+    passed &= check_tracker("joint BGR histogram", joint, sequence, *allocator, true, true);
+
+    // Frame budget: candidates in ring order, with a deadline that is never reached
+    FusionTracker budgeted(box, 4, 4, 8, gray, 0);
+    passed &= check_tracker("budgeted gray histograms", budgeted, sequence, *allocator, true, true, 1000);
+
+    // Block cache of the colour cue
+    FusionTracker cached(box, 4, 4, 8, gray, 0);
+    cached.cache_blocks = true;
+    passed &= check_tracker("cached gray histograms", cached, sequence, *allocator, true, true);
+
+    // Gradient cue only, lookup table HOG
+    FusionTracker gradient(box, 4, 4, 0, gray, 16);
+    gradient.lut_hog = true;
+    passed &= check_tracker("lookup table HOG", gradient, sequence, *allocator, false, true);
+
+    // Both cues
+    FusionTracker fused(box, 4, 4, 8, gray, 16);
+    fused.lut_hog = true;
+    passed &= check_tracker("gray histograms + lookup table HOG", fused, sequence, *allocator, false, true);
+
+    // Both cues with the block cache
+    FusionTracker fused_cached(box, 4, 4, 8, gray, 16);
+    fused_cached.lut_hog = true;
+    fused_cached.cache_blocks = true;
+    passed &= check_tracker("cached gray histograms + lookup table HOG", fused_cached, sequence, *allocator, false, true);
+
+    Mat::setDefaultAllocator(NULL);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+/* Block cache test
+* Tracks synthetic sequences (without noise, so most blocks stay unchanged, and with fresh
+* noise on every frame) with the block cache on and off, for the colour cue, the gradient
+* cue and both. Cached histograms are exact counts corrected pixel by pixel and a cached
+* distance is only reused for a box whose pixels did not change, so every frame must give
+* the same candidates with bit identical colour and gradient scores. The noise free
+* sequence must also be served from the cache
+*/
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "FusionTracker.hpp"
+#include "SyntheticSequence.hpp"
+
+using namespace std;
+using namespace cv;
+
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, const char* name, int frame, double got, double expected) {
+
+    checks++;
+    if(!passed){
+        failures++;
+        if(failures <= 20){
+            printf("FAIL %s, %s, frame %d: %.17g, expected %.17g\n", what, name, frame, got, expected);
+        }
+    }
+}
+
+
+static void test_cache(const char* name, const synthetic_sequence& sequence, int color_bins, const vector<bool>& type, int gradient_bins, bool expect_hits) {
+
+    FusionTracker cached(sequence.boxes[0], 4, 4, color_bins, type, gradient_bins);
+    FusionTracker uncached(sequence.boxes[0], 4, 4, color_bins, type, gradient_bins);
+    cached.lut_hog = uncached.lut_hog = true;
+    cached.cache_blocks = true;
+
+    for(size_t f = 0; f < sequence.frames.size(); f++){
+        cached.track(sequence.frames[f]);
+        uncached.track(sequence.frames[f]);
+
+        const candidates& got = cached.frame_candidates;
+        const candidates& expected = uncached.frame_candidates;
+        check(got.boxes.size() == expected.boxes.size(), "candidate count", name, (int)f, (double)got.boxes.size(), (double)expected.boxes.size());
+        check(got.color_scores.size() == expected.color_scores.size(), "colour score count", name, (int)f, (double)got.color_scores.size(), (double)expected.color_scores.size());
+        check(got.gradient_scores.size() == expected.gradient_scores.size(), "gradient score count", name, (int)f, (double)got.gradient_scores.size(), (double)expected.gradient_scores.size());
+        for(size_t c = 0; c < min(got.boxes.size(), expected.boxes.size()); c++){
+            check(got.boxes[c] == expected.boxes[c], "candidate box", name, (int)f, got.boxes[c].x + got.boxes[c].y/1000., expected.boxes[c].x + expected.boxes[c].y/1000.);
+        }
+        for(size_t c = 0; c < min(got.color_scores.size(), expected.color_scores.size()); c++){
+            check(got.color_scores[c] == expected.color_scores[c], "colour score", name, (int)f, got.color_scores[c], expected.color_scores[c]);
+        }
+        for(size_t c = 0; c < min(got.gradient_scores.size(), expected.gradient_scores.size()); c++){
+            check(got.gradient_scores[c] == expected.gradient_scores[c], "gradient score", name, (int)f, got.gradient_scores[c], expected.gradient_scores[c]);
+        }
+    }
+
+    const cache_stats& stats = cached.get_cache_stats();
+    if(expect_hits){
+        check(stats.hits > 0, "cache hits", name, (int)sequence.frames.size(), (double)stats.hits, stats.lookups);
+    }
+    printf("%s: %ld of %ld features from the cache\n", name, stats.hits, stats.lookups);
+}
+
+
+int main() {
+
+    synthetic_sequence still = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30, 0);
+    synthetic_sequence noisy = make_synthetic_sequence(Size(320, 240), Size(40, 60), 30);
+
+    vector<bool> gray(6, false), bgr(6, false);
+    gray[5] = true;
+    bgr[0] = bgr[1] = bgr[2] = true;
+
+    test_cache("gray histograms, no noise", still, 8, gray, 0, true);
+    test_cache("lookup table HOG, no noise", still, 0, gray, 16, true);
+    test_cache("B+G+R histograms + lookup table HOG, no noise", still, 16, bgr, 16, true);
+    test_cache("gray histograms + lookup table HOG, noise", noisy, 8, gray, 16, false);
+
+    printf("%s: %d of %d checks failed\n", failures == 0 ? "PASS" : "FAIL", failures, checks);
+    return failures == 0 ? 0 : 1;
+}